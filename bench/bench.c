@@ -0,0 +1,516 @@
+
+/*
+ * bench, measures deflateTT and the decoders on synthetic data. The corpora
+ * (text, tile graphics, random data, runs and a mix of them) are generated
+ * using a fixed seed, so every run of the benchmark measures the same bytes
+ * on every machine. deflateTT is measured at every level through
+ * libdeflateTT, and the decoders on the output of level 6: inflateTT-MP
+ * (inflate(), inflateSafe() and the streaming inflate) and inflateTT-DS
+ * (built for the host using dsshim.h) in this process, and
+ * inflateTT by running it. The results go to stdout as JSON: the throughput,
+ * the ratio, and the median and the 99th percentile latencies of each file
+ * size bucket.
+ *
+ * This code is under GNU General Public Licence (GPL), version 2, June 1991.
+ */
+
+/* for clock_gettime() and fork() */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "defines.h"
+#include "deflate.h"
+#include "inflate.h"
+#include "bench.h"
+
+
+/* inflateTT-DS, see dsshim.h */
+void inflateDS(unsigned char *data, volatile unsigned short *output);
+
+
+static const char *corpusNames[CORPORA_N] = { "text", "tiles", "random", "runs", "mix" };
+
+static const int bucketSizes[BUCKETS_N] = { 1 << 10, 1 << 14, 1 << 18, 1 << 22 };
+
+static const char *words[] = {
+  "the", "of", "and", "a", "to", "in", "is", "you", "that", "it", "he", "was", "for", "on", "are", "as",
+  "with", "his", "they", "at", "be", "this", "have", "from", "or", "one", "had", "by", "word", "but",
+  "not", "what", "all", "were", "we", "when", "your", "can", "said", "there", "use", "an", "each",
+  "which", "she", "do", "how", "their", "if", "will", "up", "other", "about", "out", "many", "then",
+  "them", "these", "so", "some", "her", "would", "make", "like", "him", "into", "time", "has", "look",
+  "sprite", "palette", "tilemap", "compressed", "window", "block", "Huffman", "dictionary", "match"
+};
+
+static uint32_t _seed;
+
+
+/* a linear congruential generator, the same everywhere. returns 0 ... 32767 */
+static int _random(void) {
+
+  _seed = (_seed * 1103515245u + 12345u) & 0xFFFFFFFF;
+
+  return (int)((_seed >> 16) & 0x7FFF);
+}
+
+
+static void _generate_text(unsigned char *data, int size) {
+
+  const char *word;
+  int i, n, wordsN;
+
+  wordsN = sizeof(words) / sizeof(words[0]);
+
+  i = 0;
+  n = 0;
+  while (i < size) {
+    /* the short words are the common ones */
+    word = words[(_random() % wordsN) * (_random() % wordsN) / wordsN];
+    while (*word != 0 && i < size)
+      data[i++] = *word++;
+
+    /* sentences, and lines of about 70 characters */
+    n++;
+    if (i < size && _random() % 12 == 0)
+      data[i++] = '.';
+    if (i < size)
+      data[i++] = (n % 11 == 0) ? '\n' : ' ';
+  }
+}
+
+
+/* 8x8 tiles in 4 bits per pixel, picked out of a small set, and now and then touched up */
+static void _generate_tiles(unsigned char *data, int size) {
+
+  unsigned char tiles[64][32];
+  int i, j, n, color;
+
+  for (i = 0; i < 64; i++) {
+    color = _random() & 15;
+    for (j = 0; j < 32; j++) {
+      if (_random() % 4 == 0)
+        color = _random() & 15;
+      tiles[i][j] = (color << 4) | color;
+    }
+  }
+
+  for (i = 0; i < size; i += 32) {
+    n = _random() % 64;
+    for (j = 0; j < 32 && i + j < size; j++)
+      data[i + j] = tiles[n][j];
+    if (_random() % 8 == 0)
+      data[i + _random() % j] ^= 1 << (_random() % 8);
+  }
+}
+
+
+static void _generate_random(unsigned char *data, int size) {
+
+  int i;
+
+  for (i = 0; i < size; i++)
+    data[i] = _random() >> 7;
+}
+
+
+static void _generate_runs(unsigned char *data, int size) {
+
+  int i, n, value;
+
+  i = 0;
+  while (i < size) {
+    value = _random() & 15;
+    for (n = 1 + _random() % 64; n > 0 && i < size; n--)
+      data[i++] = value;
+  }
+}
+
+
+/* the other corpora in turns, 4K at a time */
+static void _generate_mix(unsigned char *data, unsigned char **corpora, int size) {
+
+  int i, n;
+
+  for (i = 0; i < size; i += 4096) {
+    n = size - i;
+    if (n > 4096)
+      n = 4096;
+    memcpy(data + i, corpora[(i / 4096) % CORPUS_MIX] + i, n);
+  }
+}
+
+
+static double _now(void) {
+
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+
+  return t.tv_sec * 1000000.0 + t.tv_nsec / 1000.0;
+}
+
+
+static int _compare_times(const void *a, const void *b) {
+
+  double t1 = *(const double *)a, t2 = *(const double *)b;
+
+  if (t1 != t2)
+    return t1 < t2 ? -1 : 1;
+
+  return 0;
+}
+
+
+/* the number of runs a measurement of size bytes takes */
+static int _runs(int size, int quick) {
+
+  int runs;
+
+  runs = BENCH_BYTES / size;
+  if (quick == YES)
+    runs /= 16;
+
+  if (runs < RUNS_MIN)
+    return RUNS_MIN;
+  if (runs > RUNS_MAX)
+    return RUNS_MAX;
+
+  return runs;
+}
+
+
+static void _print_result(int *resultsN, char *tool, int level, int corpus, int size, int compressedSize, struct measurement *m, int ok) {
+
+  double mbPerSecond = 0, p50 = 0, p99 = 0;
+
+  /* a measurement that failed has only the runs that finished, maybe none */
+  if (m->runs > 0) {
+    qsort(m->times, m->runs, sizeof(double), _compare_times);
+    mbPerSecond = (double)size * m->runs / (1 << 20) / (m->total / 1000000.0);
+    p50 = m->times[(m->runs - 1) * 50 / 100];
+    p99 = m->times[(m->runs - 1) * 99 / 100];
+  }
+
+  printf("%s    { \"tool\": \"%s\", \"level\": %d, \"corpus\": \"%s\", \"size\": %d, \"runs\": %d, \"ratio\": %.4f, \"mbPerSecond\": %.2f, "
+         "\"p50Microseconds\": %.1f, \"p99Microseconds\": %.1f, \"ok\": %s }",
+         *resultsN > 0 ? ",\n" : "", tool, level, corpusNames[corpus], size, m->runs, (double)compressedSize / size,
+         mbPerSecond, p50, p99, ok == YES ? "true" : "false");
+  fflush(stdout);
+
+  (*resultsN)++;
+}
+
+
+/* deflateTT at the level, returns the size of the output or -1 */
+static int _bench_deflate(struct DeflateContext *context, unsigned char *data, int size, unsigned char *output, int outputSizeMax, struct measurement *m) {
+
+  size_t outputSize = 0;
+  double t;
+  int i;
+
+  m->total = 0;
+  for (i = 0; i < m->runs; i++) {
+    outputSize = outputSizeMax;
+    t = _now();
+    if (deflate(data, size, output, &outputSize, context) != DEFLATE_OK) {
+      m->runs = i;
+      return -1;
+    }
+    m->times[i] = _now() - t;
+    m->total += m->times[i];
+  }
+
+  return (int)outputSize;
+}
+
+
+/* safe is YES to measure inflateSafe(), which is given the exact sizes */
+static int _bench_mp(unsigned char *compressed, int compressedSize, unsigned char *data, int size, unsigned char *output, int safe,
+                     struct InflateContext *context, struct measurement *m) {
+
+  double t;
+  int i, inflatedSize, ok = YES;
+
+  m->total = 0;
+  for (i = 0; i < m->runs; i++) {
+    t = _now();
+    if (safe == YES) {
+      if (inflateSafe(compressed, compressedSize, output, size, &inflatedSize, NULL, context) != INFLATE_OK || inflatedSize != size)
+        ok = NO;
+    }
+    else if (inflate(compressed, output, context) != INFLATE_OK)
+      ok = NO;
+    m->times[i] = _now() - t;
+    m->total += m->times[i];
+  }
+
+  if (memcmp(output, data, size) != 0)
+    ok = NO;
+
+  return ok;
+}
+
+
+/* the compressed data is fed to the stream BENCH_STREAM_CHUNK bytes at a time, as if it was being read */
+static int _bench_mp_stream(unsigned char *compressed, int compressedSize, unsigned char *data, int size, unsigned char *output,
+                            struct InflateStream *stream, struct measurement *m) {
+
+  double t;
+  int i, r, chunk, in, out, inputUsed, outputUsed, ok = YES;
+
+  m->total = 0;
+  for (i = 0; i < m->runs; i++) {
+    t = _now();
+    inflateStreamInit(stream, NULL);
+    in = 0;
+    out = 0;
+    do {
+      chunk = compressedSize - in;
+      if (chunk > BENCH_STREAM_CHUNK)
+        chunk = BENCH_STREAM_CHUNK;
+      r = inflateStreamFeed(stream, compressed + in, chunk, &inputUsed, output + out, size - out, &outputUsed);
+      in += inputUsed;
+      out += outputUsed;
+    } while (r == INFLATE_NEED_INPUT && in < compressedSize);
+    if (inflateStreamEnd(stream) != INFLATE_OK || out != size)
+      ok = NO;
+    m->times[i] = _now() - t;
+    m->total += m->times[i];
+  }
+
+  if (memcmp(output, data, size) != 0)
+    ok = NO;
+
+  return ok;
+}
+
+
+static int _bench_ds(unsigned char *compressed, unsigned char *data, int size, unsigned short *output, struct measurement *m) {
+
+  double t;
+  int i;
+
+  m->total = 0;
+  for (i = 0; i < m->runs; i++) {
+    t = _now();
+    inflateDS(compressed, output);
+    m->times[i] = _now() - t;
+    m->total += m->times[i];
+  }
+
+  /* the halfwords are little endian on the DS, and on the hosts we run on */
+  return (memcmp(output, data, size) == 0) ? YES : NO;
+}
+
+
+/* runs inflateTT, returns YES if it succeeded */
+static int _run_inflatett(char *inflatett) {
+
+  pid_t pid;
+  int fd, status;
+
+  pid = fork();
+  if (pid < 0)
+    return NO;
+
+  if (pid == 0) {
+    /* inflateTT prints the sizes */
+    fd = open("/dev/null", O_WRONLY);
+    if (fd >= 0)
+      dup2(fd, 2);
+    execl(inflatett, inflatett, BENCH_FILE_DEF, BENCH_FILE_RAW, (char *)NULL);
+    _exit(127);
+  }
+
+  if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    return NO;
+
+  return YES;
+}
+
+
+static int _bench_cli(char *inflatett, unsigned char *compressed, int compressedSize, unsigned char *data, int size, unsigned char *output, struct measurement *m) {
+
+  double t;
+  int i, n, ok = YES;
+  FILE *f;
+
+  /* nothing is measured if the input can't be written */
+  f = fopen(BENCH_FILE_DEF, "wb");
+  if (f == NULL) {
+    fprintf(stderr, "_bench_cli(): Could not open file \"%s\" for writing.\n", BENCH_FILE_DEF);
+    m->runs = 0;
+    return NO;
+  }
+  n = (int)fwrite(compressed, 1, compressedSize, f);
+  if (fclose(f) != 0 || n != compressedSize) {
+    fprintf(stderr, "_bench_cli(): Could not write file \"%s\".\n", BENCH_FILE_DEF);
+    remove(BENCH_FILE_DEF);
+    m->runs = 0;
+    return NO;
+  }
+
+  m->total = 0;
+  for (i = 0; i < m->runs; i++) {
+    t = _now();
+    if (_run_inflatett(inflatett) == NO)
+      ok = NO;
+    m->times[i] = _now() - t;
+    m->total += m->times[i];
+  }
+
+  f = fopen(BENCH_FILE_RAW, "rb");
+  if (f == NULL)
+    ok = NO;
+  else {
+    n = fread(output, 1, size + 1, f);
+    fclose(f);
+    if (n != size || memcmp(output, data, size) != 0)
+      ok = NO;
+  }
+
+  remove(BENCH_FILE_DEF);
+  remove(BENCH_FILE_RAW);
+
+  return ok;
+}
+
+
+int main(int argc, char *argv[]) {
+
+  unsigned char *corpora[CORPORA_N], *compressed, *output;
+  struct DeflateContext contexts[DEFLATE_LEVEL_ULTRA + 1];
+  struct InflateContext *inflateContext;
+  struct InflateStream *inflateStream;
+  struct measurement m;
+  char *inflatett;
+  int i, corpus, bucket, bucketsN, level, size, compressedSize, compressedSizeMax, resultsN, quick, ok;
+
+  quick = NO;
+  inflatett = "../inflateTT/inflateTT";
+  for (i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--quick") == 0)
+      quick = YES;
+    else if (strcmp(argv[i], "--inflatett") == 0 && i + 1 < argc)
+      inflatett = argv[++i];
+    else {
+      fprintf(stderr, "bench Written by Ville Helin 2007\n");
+      fprintf(stderr, "USAGE: %s [--quick] [--inflatett PATH] > RESULTS.json\n", argv[0]);
+      fprintf(stderr, "--quick          Fewer runs, and no 4MB files\n");
+      fprintf(stderr, "--inflatett PATH The inflateTT to run (default: %s)\n", inflatett);
+      return 1;
+    }
+  }
+
+  bucketsN = (quick == YES) ? BUCKETS_N - 1 : BUCKETS_N;
+  size = bucketSizes[bucketsN - 1];
+
+  /* the smaller buckets are the starts of the corpora */
+  for (corpus = 0; corpus < CORPORA_N; corpus++) {
+    corpora[corpus] = malloc(size);
+    if (corpora[corpus] == NULL) {
+      fprintf(stderr, "main(): Out of memory error.\n");
+      return 1;
+    }
+
+    _seed = BENCH_SEED + corpus;
+    if (corpus == CORPUS_TEXT)
+      _generate_text(corpora[corpus], size);
+    else if (corpus == CORPUS_TILES)
+      _generate_tiles(corpora[corpus], size);
+    else if (corpus == CORPUS_RANDOM)
+      _generate_random(corpora[corpus], size);
+    else if (corpus == CORPUS_RUNS)
+      _generate_runs(corpora[corpus], size);
+    else
+      _generate_mix(corpora[corpus], corpora, size);
+  }
+
+  compressedSizeMax = (int)deflateBound(size);
+  compressed = malloc(compressedSizeMax);
+  output = malloc(size + 1024);
+  inflateContext = malloc(sizeof(struct InflateContext));
+  inflateStream = malloc(sizeof(struct InflateStream));
+  m.times = malloc(sizeof(double) * RUNS_MAX);
+  if (compressed == NULL || output == NULL || inflateContext == NULL || inflateStream == NULL || m.times == NULL) {
+    fprintf(stderr, "main(): Out of memory error.\n");
+    return 1;
+  }
+
+  for (level = 1; level <= DEFLATE_LEVEL_ULTRA; level++) {
+    if (deflateContextInit(&contexts[level], level, DEFLATE_FORMAT_DEFD) != DEFLATE_OK) {
+      fprintf(stderr, "main(): Out of memory error.\n");
+      return 1;
+    }
+  }
+
+  printf("{\n  \"seed\": %d,\n  \"quick\": %s,\n  \"results\": [\n", BENCH_SEED, quick == YES ? "true" : "false");
+
+  resultsN = 0;
+  for (bucket = 0; bucket < bucketsN; bucket++) {
+    size = bucketSizes[bucket];
+
+    for (corpus = 0; corpus < CORPORA_N; corpus++) {
+      /* deflateTT at every level, the warm-up call isn't measured */
+      for (level = 1; level <= DEFLATE_LEVEL_ULTRA; level++) {
+        m.runs = 1;
+        _bench_deflate(&contexts[level], corpora[corpus], size, compressed, compressedSizeMax, &m);
+
+        m.runs = _runs(size, quick);
+        compressedSize = _bench_deflate(&contexts[level], corpora[corpus], size, compressed, compressedSizeMax, &m);
+        _print_result(&resultsN, "deflateTT", level, corpus, size, compressedSize, &m, compressedSize >= 0 ? YES : NO);
+      }
+
+      /* the decoders */
+      m.runs = 1;
+      compressedSize = _bench_deflate(&contexts[BENCH_DECODE_LEVEL], corpora[corpus], size, compressed, compressedSizeMax, &m);
+      if (compressedSize < 0)
+        return 1;
+
+      m.runs = _runs(size, quick);
+      ok = _bench_mp(compressed, compressedSize, corpora[corpus], size, output, NO, inflateContext, &m);
+      _print_result(&resultsN, "inflateTT-MP", BENCH_DECODE_LEVEL, corpus, size, compressedSize, &m, ok);
+
+      memset(output, 0, size + 1024);
+      ok = _bench_mp(compressed, compressedSize, corpora[corpus], size, output, YES, inflateContext, &m);
+      _print_result(&resultsN, "inflateTT-MP-safe", BENCH_DECODE_LEVEL, corpus, size, compressedSize, &m, ok);
+
+      memset(output, 0, size + 1024);
+      ok = _bench_mp_stream(compressed, compressedSize, corpora[corpus], size, output, inflateStream, &m);
+      _print_result(&resultsN, "inflateTT-MP-stream", BENCH_DECODE_LEVEL, corpus, size, compressedSize, &m, ok);
+
+      memset(output, 0, size + 1024);
+      ok = _bench_ds(compressed, corpora[corpus], size, (unsigned short *)output, &m);
+      _print_result(&resultsN, "inflateTT-DS", BENCH_DECODE_LEVEL, corpus, size, compressedSize, &m, ok);
+
+      m.runs = _runs(size, quick) / RUNS_CLI_DIVISOR;
+      if (m.runs < RUNS_MIN)
+        m.runs = RUNS_MIN;
+      if (m.runs > RUNS_CLI_MAX)
+        m.runs = RUNS_CLI_MAX;
+      ok = _bench_cli(inflatett, compressed, compressedSize, corpora[corpus], size, output, &m);
+      _print_result(&resultsN, "inflateTT", BENCH_DECODE_LEVEL, corpus, size, compressedSize, &m, ok);
+    }
+  }
+
+  printf("\n  ]\n}\n");
+
+  for (level = 1; level <= DEFLATE_LEVEL_ULTRA; level++)
+    deflateContextFree(&contexts[level]);
+  for (corpus = 0; corpus < CORPORA_N; corpus++)
+    free(corpora[corpus]);
+  free(compressed);
+  free(output);
+  free(inflateContext);
+  free(inflateStream);
+  free(m.times);
+
+  return 0;
+}
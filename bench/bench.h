@@ -0,0 +1,45 @@
+
+#ifndef _BENCH_H
+#define _BENCH_H
+
+/* the corpora */
+#define CORPUS_TEXT   0
+#define CORPUS_TILES  1
+#define CORPUS_RANDOM 2
+#define CORPUS_RUNS   3
+#define CORPUS_MIX    4
+#define CORPORA_N     5
+
+/* the file size buckets, --quick skips the last one */
+#define BUCKETS_N 4
+
+/* each measurement compresses about this many bytes in total, in at least RUNS_MIN and at most RUNS_MAX runs */
+#define BENCH_BYTES (1 << 22)
+#define RUNS_MIN    3
+#define RUNS_MAX    1000
+
+/* inflateTT is a separate process, so it gets fewer runs */
+#define RUNS_CLI_DIVISOR 10
+#define RUNS_CLI_MAX     50
+
+/* the decoders inflate the output of this level */
+#define BENCH_DECODE_LEVEL 6
+
+/* the streaming inflate is fed this many bytes at a time */
+#define BENCH_STREAM_CHUNK 4096
+
+/* the corpora are generated using a fixed seed, so every run measures the same bytes */
+#define BENCH_SEED 20070127
+
+/* the temporary files inflateTT is run on */
+#define BENCH_FILE_DEF "bench.tmp.def"
+#define BENCH_FILE_RAW "bench.tmp.raw"
+
+/* the timings of one measurement, in microseconds */
+struct measurement {
+  double *times;
+  int runs;
+  double total;
+};
+
+#endif
@@ -0,0 +1,22 @@
+
+#ifndef _DEFINES_H
+#define _DEFINES_H
+
+#ifndef M_PI
+#define M_PI 3.14159265
+#endif
+
+#define FAILED    0
+#define SUCCEEDED 1
+
+#define NO  0
+#define YES 1
+
+#define OFF 0
+#define ON  1
+
+#define VIEW_MODE_RGB   0
+#define VIEW_MODE_ALPHA 1
+#define VIEW_MODE_RGBA  2
+
+#endif
@@ -0,0 +1,23 @@
+
+/*
+ * The types inflateTT-DS takes from the Nintendo DS headers, for building it
+ * on the host. inflateTT-MP has an inflate() of its own, so the DS version
+ * is renamed to inflateDS(). See the makefile.
+ *
+ * This code is under GNU General Public Licence (GPL), version 2, June 1991.
+ */
+
+#ifndef _DSSHIM_H
+#define _DSSHIM_H
+
+/* NULL comes with the DS headers */
+#include <stddef.h>
+
+typedef unsigned char u8;
+typedef unsigned short u16;
+typedef int s32;
+typedef volatile unsigned short vu16;
+
+#define inflate inflateDS
+
+#endif
@@ -0,0 +1,390 @@
+
+/*
+ * deflateTT's bit writer. The codes are collected MSB first into a 64-bit
+ * accumulator, which is emptied 32 bits at a time into a large output
+ * buffer, and the buffer goes out to the file using one fwrite() when it's
+ * full. This replaces writing the output one bit and one fprintf() at a time.
+ *
+ * The standard formats (RFC-1951) fill the bytes starting from the lowest
+ * bit instead. In that order a value goes out starting from its lowest bit
+ * as well, so the Huffman codes, which must go out starting from their
+ * highest bit, are reversed beforehand (see block.c).
+ *
+ * A writer without a file keeps everything in memory. That's how the threads
+ * compress their chunks, and the results are then appended to the file's
+ * writer in order. The chunks don't end at byte boundaries, so the bytes of
+ * a chunk are shifted into place 64 bits at a time, or copied as they are
+ * if the file's writer happens to be aligned. A chunk can't know where in
+ * the file it's going to be, so bitWriterAlign() in a memory writer pads to
+ * its own byte boundary, and bitWriterAppend() redoes the first padding of
+ * the source at the right position. After that both writers are aligned,
+ * and the rest of the source is simply copied.
+ *
+ * This code is under GNU General Public Licence (GPL), version 2, June 1991.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defines.h"
+#include "bitwriter.h"
+
+
+static void _write_buffer(struct bitWriter *w) {
+
+  unsigned char *buffer;
+
+  /* a fixed buffer is full, the rest goes into our own buffer, which is emptied every time it fills up */
+  if (w->fixed == YES) {
+    w->full = YES;
+    w->buffer = w->ownBuffer;
+    w->bufferSize = w->ownBufferSize;
+    w->bufferN = 0;
+    return;
+  }
+
+  if (w->bufferN == 0)
+    return;
+
+  /* a memory writer grows instead */
+  if (w->f == NULL) {
+    buffer = realloc(w->buffer, w->bufferSize * 2);
+    if (buffer == NULL) {
+      w->error = YES;
+      /* start over, the result is useless anyway */
+      w->bufferN = 0;
+      return;
+    }
+
+    w->buffer = buffer;
+    w->bufferSize *= 2;
+    w->ownBuffer = buffer;
+    w->ownBufferSize = w->bufferSize;
+    return;
+  }
+
+  if (fwrite(w->buffer, 1, w->bufferN, w->f) != (size_t)w->bufferN)
+    w->error = YES;
+
+  w->written += w->bufferN;
+  w->bufferN = 0;
+}
+
+
+int bitWriterInit(struct bitWriter *w, FILE *f) {
+
+  w->f = f;
+  w->bufferN = 0;
+  w->bufferSize = BIT_WRITER_BUFFER_SIZE;
+  w->bits = 0;
+  w->bitsN = 0;
+  w->order = BIT_WRITER_MSB_FIRST;
+  w->written = 0;
+  w->error = NO;
+  w->alignedAt = 0;
+  w->alignedFrom = -1;
+  w->fixed = NO;
+  w->full = NO;
+
+  w->buffer = malloc(BIT_WRITER_BUFFER_SIZE);
+  w->ownBuffer = w->buffer;
+  w->ownBufferSize = BIT_WRITER_BUFFER_SIZE;
+  if (w->buffer == NULL)
+    return FAILED;
+
+  return SUCCEEDED;
+}
+
+
+void bitWriterFree(struct bitWriter *w) {
+
+  free(w->ownBuffer);
+  w->ownBuffer = NULL;
+  w->buffer = NULL;
+}
+
+
+/* BIT_WRITER_MSB_FIRST or BIT_WRITER_LSB_FIRST, set before anything is written */
+void bitWriterSetOrder(struct bitWriter *w, int order) {
+
+  w->order = order;
+}
+
+
+/* makes a memory writer write into buffer, which is size bytes and doesn't grow, instead of its own.
+   NULL switches back to the writer's own buffer. either way the buffer starts empty */
+void bitWriterSetBuffer(struct bitWriter *w, unsigned char *buffer, int size) {
+
+  w->fixed = NO;
+  w->full = NO;
+  w->buffer = w->ownBuffer;
+  w->bufferSize = w->ownBufferSize;
+  w->bufferN = 0;
+
+  if (buffer != NULL) {
+    w->fixed = YES;
+    w->buffer = buffer;
+    w->bufferSize = size;
+  }
+}
+
+
+/* writes the codeLength (0-32) lowest bits of code, the highest of them first (the lowest if LSB first) */
+void bitWriterWrite(struct bitWriter *w, unsigned int code, int codeLength) {
+
+  unsigned int n;
+
+  if (w->order == BIT_WRITER_LSB_FIRST) {
+    w->bits |= (uint64_t)code << w->bitsN;
+    w->bitsN += codeLength;
+
+    if (w->bitsN < 32)
+      return;
+
+    n = (unsigned int)(w->bits & 0xFFFFFFFF);
+    w->bits >>= 32;
+    w->bitsN -= 32;
+
+    if (w->bufferN > w->bufferSize - 4)
+      _write_buffer(w);
+
+    w->buffer[w->bufferN++] = n & 0xFF;
+    w->buffer[w->bufferN++] = (n >> 8) & 0xFF;
+    w->buffer[w->bufferN++] = (n >> 16) & 0xFF;
+    w->buffer[w->bufferN++] = (n >> 24) & 0xFF;
+    return;
+  }
+
+  w->bits = (w->bits << codeLength) | code;
+  w->bitsN += codeLength;
+
+  if (w->bitsN < 32)
+    return;
+
+  w->bitsN -= 32;
+  n = (unsigned int)(w->bits >> w->bitsN);
+
+  if (w->bufferN > w->bufferSize - 4)
+    _write_buffer(w);
+
+  w->buffer[w->bufferN++] = (n >> 24) & 0xFF;
+  w->buffer[w->bufferN++] = (n >> 16) & 0xFF;
+  w->buffer[w->bufferN++] = (n >> 8) & 0xFF;
+  w->buffer[w->bufferN++] = n & 0xFF;
+}
+
+
+/* takes the oldest whole byte out of the accumulator */
+static int _take_byte(struct bitWriter *w) {
+
+  int n;
+
+  w->bitsN -= 8;
+
+  if (w->order == BIT_WRITER_LSB_FIRST) {
+    n = (int)(w->bits & 0xFF);
+    w->bits >>= 8;
+    return n;
+  }
+
+  return (int)((w->bits >> w->bitsN) & 0xFF);
+}
+
+
+void bitWriterWriteU8(struct bitWriter *w, int data) {
+
+  bitWriterWrite(w, data & 0xFF, 8);
+}
+
+
+/* writes a little endian u32, like in the headers */
+void bitWriterWriteU32(struct bitWriter *w, unsigned int data) {
+
+  bitWriterWrite(w, data & 0xFF, 8);
+  bitWriterWrite(w, (data >> 8) & 0xFF, 8);
+  bitWriterWrite(w, (data >> 16) & 0xFF, 8);
+  bitWriterWrite(w, (data >> 24) & 0xFF, 8);
+}
+
+
+/* moves the whole bytes from the accumulator to the buffer */
+static void _drain_bits(struct bitWriter *w) {
+
+  while (w->bitsN >= 8) {
+    if (w->bufferN == w->bufferSize)
+      _write_buffer(w);
+
+    w->buffer[w->bufferN++] = _take_byte(w);
+  }
+}
+
+
+/* pads with zeros to the next byte boundary */
+void bitWriterAlign(struct bitWriter *w) {
+
+  if (w->alignedFrom < 0)
+    w->alignedAt = (w->written + w->bufferN) * 8 + w->bitsN;
+
+  if (w->bitsN & 7)
+    bitWriterWrite(w, 0, 8 - (w->bitsN & 7));
+
+  _drain_bits(w);
+
+  if (w->alignedFrom < 0)
+    w->alignedFrom = w->bufferN;
+}
+
+
+/* writes n bytes using memcpy(), the writer must be aligned */
+void bitWriterWriteBytes(struct bitWriter *w, unsigned char *data, int n) {
+
+  int k;
+
+  _drain_bits(w);
+
+  while (n > 0) {
+    if (w->bufferN == w->bufferSize)
+      _write_buffer(w);
+
+    k = w->bufferSize - w->bufferN;
+    if (k > n)
+      k = n;
+
+    memcpy(w->buffer + w->bufferN, data, k);
+    w->bufferN += k;
+    data += k;
+    n -= k;
+  }
+}
+
+
+/* writes n bytes, the writer doesn't need to be aligned. if it isn't, the bytes go in 8 at a time: the bits
+   waiting in the accumulator are put in front of a 64-bit word, and the last bits of the word wait for the
+   next one */
+static void _write_bytes_unaligned(struct bitWriter *w, unsigned char *data, int n) {
+
+  uint64_t word, out;
+  int k;
+
+  _drain_bits(w);
+
+  k = w->bitsN;
+  if (k == 0) {
+    bitWriterWriteBytes(w, data, n);
+    return;
+  }
+
+  while (n >= 8) {
+    if (w->bufferN > w->bufferSize - 8)
+      _write_buffer(w);
+
+    if (w->order == BIT_WRITER_LSB_FIRST) {
+      word = ((uint64_t)data[0] | ((uint64_t)data[1] << 8) | ((uint64_t)data[2] << 16) | ((uint64_t)data[3] << 24) |
+              ((uint64_t)data[4] << 32) | ((uint64_t)data[5] << 40) | ((uint64_t)data[6] << 48) | ((uint64_t)data[7] << 56));
+      out = (w->bits & (((uint64_t)1 << k) - 1)) | (word << k);
+      w->bits = word >> (64 - k);
+
+      w->buffer[w->bufferN++] = out & 0xFF;
+      w->buffer[w->bufferN++] = (out >> 8) & 0xFF;
+      w->buffer[w->bufferN++] = (out >> 16) & 0xFF;
+      w->buffer[w->bufferN++] = (out >> 24) & 0xFF;
+      w->buffer[w->bufferN++] = (out >> 32) & 0xFF;
+      w->buffer[w->bufferN++] = (out >> 40) & 0xFF;
+      w->buffer[w->bufferN++] = (out >> 48) & 0xFF;
+      w->buffer[w->bufferN++] = (out >> 56) & 0xFF;
+    }
+    else {
+      word = (((uint64_t)data[0] << 56) | ((uint64_t)data[1] << 48) | ((uint64_t)data[2] << 40) | ((uint64_t)data[3] << 32) |
+              ((uint64_t)data[4] << 24) | ((uint64_t)data[5] << 16) | ((uint64_t)data[6] << 8) | (uint64_t)data[7]);
+      out = (w->bits << (64 - k)) | (word >> k);
+      w->bits = word & (((uint64_t)1 << k) - 1);
+
+      w->buffer[w->bufferN++] = (out >> 56) & 0xFF;
+      w->buffer[w->bufferN++] = (out >> 48) & 0xFF;
+      w->buffer[w->bufferN++] = (out >> 40) & 0xFF;
+      w->buffer[w->bufferN++] = (out >> 32) & 0xFF;
+      w->buffer[w->bufferN++] = (out >> 24) & 0xFF;
+      w->buffer[w->bufferN++] = (out >> 16) & 0xFF;
+      w->buffer[w->bufferN++] = (out >> 8) & 0xFF;
+      w->buffer[w->bufferN++] = out & 0xFF;
+    }
+
+    data += 8;
+    n -= 8;
+  }
+
+  /* the last few bytes one at a time */
+  while (n > 0) {
+    bitWriterWrite(w, *data++, 8);
+    n--;
+  }
+}
+
+
+/* appends everything written into a memory writer, the bits don't need to be byte aligned */
+void bitWriterAppend(struct bitWriter *w, struct bitWriter *source) {
+
+  int k, n;
+
+  if (source->error == YES)
+    w->error = YES;
+
+  n = source->bufferN;
+  if (source->alignedFrom >= 0)
+    n = (int)(source->alignedAt >> 3);
+
+  _write_bytes_unaligned(w, source->buffer, n);
+
+  if (source->alignedFrom >= 0) {
+    /* the bits before the padding, and then our own padding */
+    k = (int)(source->alignedAt & 7);
+    if (k > 0 && source->order == BIT_WRITER_LSB_FIRST)
+      bitWriterWrite(w, source->buffer[n] & ((1 << k) - 1), k);
+    else if (k > 0)
+      bitWriterWrite(w, source->buffer[n] >> (8 - k), k);
+
+    bitWriterAlign(w);
+    bitWriterWriteBytes(w, source->buffer + source->alignedFrom, source->bufferN - source->alignedFrom);
+  }
+
+  if (source->bitsN > 0)
+    bitWriterWrite(w, (unsigned int)(source->bits & ((1u << source->bitsN) - 1)), source->bitsN);
+}
+
+
+/* empties a memory writer for reuse */
+void bitWriterReset(struct bitWriter *w) {
+
+  w->bufferN = 0;
+  w->bits = 0;
+  w->bitsN = 0;
+  w->written = 0;
+  w->error = NO;
+  w->alignedAt = 0;
+  w->alignedFrom = -1;
+}
+
+
+/* pads the last byte with zeros, and writes out everything we have */
+int bitWriterFlush(struct bitWriter *w) {
+
+  if (w->bitsN & 7)
+    bitWriterWrite(w, 0, 8 - (w->bitsN & 7));
+
+  while (w->bitsN > 0) {
+    if (w->bufferN == w->bufferSize)
+      _write_buffer(w);
+
+    w->buffer[w->bufferN++] = _take_byte(w);
+  }
+
+  /* a memory writer keeps everything in its buffer */
+  if (w->f != NULL)
+    _write_buffer(w);
+
+  if (w->error == YES)
+    return FAILED;
+
+  return SUCCEEDED;
+}
@@ -0,0 +1,56 @@
+
+#ifndef _BITWRITER_H
+#define _BITWRITER_H
+
+#include <stdint.h>
+
+/* the output is collected into a buffer this big, and written out when it fills up */
+#define BIT_WRITER_BUFFER_SIZE (1 << 20)
+
+/* the bit orders: deflateTT's own formats fill the bytes from the highest bit, RFC-1951 from the lowest */
+#define BIT_WRITER_MSB_FIRST 0
+#define BIT_WRITER_LSB_FIRST 1
+
+struct bitWriter {
+  /* if f is NULL, everything stays in the buffer, which grows when needed */
+  FILE *f;
+  unsigned char *buffer;
+  int bufferN;
+  int bufferSize;
+
+  /* the writer's own buffer, buffer can be a fixed one of the caller instead (see bitWriterSetBuffer()).
+     a fixed buffer doesn't grow, full is set when it fills up and the rest is thrown away */
+  unsigned char *ownBuffer;
+  int ownBufferSize;
+  int fixed;
+  int full;
+
+  /* the bits not yet in the buffer, the oldest bit is the highest one, or the lowest one if LSB first */
+  uint64_t bits;
+  int bitsN;
+  int order;
+
+  /* the number of bytes written to the file */
+  uint64_t written;
+  int error;
+
+  /* where the first bitWriterAlign() started, in bits, and where the data after it starts in the buffer.
+     alignedFrom is -1 if there hasn't been one */
+  uint64_t alignedAt;
+  int alignedFrom;
+};
+
+int bitWriterInit(struct bitWriter *w, FILE *f);
+void bitWriterFree(struct bitWriter *w);
+void bitWriterSetOrder(struct bitWriter *w, int order);
+void bitWriterSetBuffer(struct bitWriter *w, unsigned char *buffer, int size);
+void bitWriterWrite(struct bitWriter *w, unsigned int code, int codeLength);
+void bitWriterWriteU8(struct bitWriter *w, int data);
+void bitWriterWriteU32(struct bitWriter *w, unsigned int data);
+void bitWriterAlign(struct bitWriter *w);
+void bitWriterWriteBytes(struct bitWriter *w, unsigned char *data, int n);
+void bitWriterAppend(struct bitWriter *w, struct bitWriter *source);
+void bitWriterReset(struct bitWriter *w);
+int bitWriterFlush(struct bitWriter *w);
+
+#endif
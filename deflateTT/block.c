@@ -0,0 +1,613 @@
+
+/*
+ * deflateTT's blocks. Each block codes a run of the lz77 tokens with its own
+ * literal/length and distance trees, so the codes can follow the data when
+ * e.g., a tilemap is followed by a palette and a bitmap.
+ *
+ * blockSplit() first cuts the items into small pieces, and then keeps on
+ * merging the two neighbouring blocks that save the most bits when coded
+ * together, until no merge saves anything.
+ *
+ * Data that doesn't compress, e.g., already compressed or random data, goes
+ * into stored blocks. blockIsIncompressible() estimates the entropy of a
+ * region from a few samples so that such regions can skip the match finding
+ * altogether, and a Huffman block that would still be bigger than its bytes
+ * is stored instead. As the entropy doesn't see repeats, e.g., the same
+ * random tile used over and over again, a region that looks incompressible
+ * is also checked for repeats using a quick single probe match finder.
+ *
+ * A small block can spend more bits on its trees than on its data. Such a
+ * block uses one of the predefined table sets (see tables.c) instead, if
+ * that gives a smaller block.
+ *
+ * The standard formats code the trees the RFC-1951 way instead, where the
+ * code lengths use a fixed 19 symbol alphabet, and the fixed codes are the
+ * only predefined table set there is.
+ *
+ * This code is under GNU General Public Licence (GPL), version 2, June 1991.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "defines.h"
+#include "huffman.h"
+#include "match.h"
+#include "lz77.h"
+#include "stats.h"
+#include "block.h"
+#include "tables.h"
+
+
+/* in deflate.c */
+extern const int deflateTTExtraBitsLengths[], deflateTTExtraBitsDistances[], deflateTTBaseValueLengths[], deflateTTCodeLengthOrder[];
+
+
+void blockFrequencies(struct block *b, struct lz77Tokens *t) {
+
+  int i;
+
+  /* zero the frequencies */
+  for (i = 0; i < 286; i++)
+    b->freqLiterals[i] = 0;
+  for (i = 0; i < 30; i++)
+    b->freqDistances[i] = 0;
+
+  /* calculate the frequencies */
+  for (i = b->start; i < b->end; i++)
+    b->freqLiterals[t->symbols[i]]++;
+  for (i = b->matchStart; i < b->matchEnd; i++)
+    b->freqDistances[LZ77_MATCH_DISTANCE_SYMBOL(t->matches[i])]++;
+
+  /* the end marker */
+  b->freqLiterals[256]++;
+}
+
+
+/* the number of bits the lz77 symbols of the block take using the code lengths, the extra bits included */
+static int64_t _payload_bits(struct block *b, int *codeLengthLiterals, int *codeLengthDistances) {
+
+  int64_t bits = 0;
+  int i;
+
+  for (i = 0; i < 286; i++)
+    bits += (int64_t)b->freqLiterals[i] * codeLengthLiterals[i];
+  for (i = 0; i < 29; i++)
+    bits += (int64_t)b->freqLiterals[257 + i] * deflateTTExtraBitsLengths[i];
+  for (i = 0; i < 30; i++)
+    bits += (int64_t)b->freqDistances[i] * (codeLengthDistances[i] + deflateTTExtraBitsDistances[i]);
+
+  return bits;
+}
+
+
+/* RFC-1951 sends the Huffman codes starting from their highest bit, and everything else starting from the lowest bit */
+static void _reverse_codes(int *codes, int *codeLengths, int n) {
+
+  int i, j, code;
+
+  for (i = 0; i < n; i++) {
+    code = 0;
+    for (j = 0; j < codeLengths[i]; j++)
+      code |= ((codes[i] >> j) & 1) << (codeLengths[i] - 1 - j);
+    codes[i] = code;
+  }
+}
+
+
+/* compresses the code lengths the RFC-1951 way: 16 repeats the previous length 3-6 times, 17 and 18 give 3-10 and 11-138 zeros */
+static void _build_rfc_header(struct block *b) {
+
+  int lengths[286+30], i, j, k, m, n, r;
+
+  /* the zeros at the ends are not sent */
+  b->literalsN = 286;
+  while (b->literalsN > 257 && b->codeLengthLiterals[b->literalsN - 1] == 0)
+    b->literalsN--;
+  b->distancesN = 30;
+  while (b->distancesN > 1 && b->codeLengthDistances[b->distancesN - 1] == 0)
+    b->distancesN--;
+
+  n = 0;
+  for (i = 0; i < b->literalsN; i++)
+    lengths[n++] = b->codeLengthLiterals[i];
+  for (i = 0; i < b->distancesN; i++)
+    lengths[n++] = b->codeLengthDistances[i];
+
+  i = 0;
+  j = 0;
+  while (i < n) {
+    m = lengths[i];
+
+    /* the length repeats k times */
+    k = 1;
+    while (i + k < n && lengths[i + k] == m)
+      k++;
+    i += k;
+
+    if (m == 0) {
+      while (k >= 11) {
+        r = k > 138 ? 138 : k;
+        b->codeLengths[j++] = 18 | ((r - 11) << 16);
+        k -= r;
+      }
+      if (k >= 3) {
+        b->codeLengths[j++] = 17 | ((k - 3) << 16);
+        k = 0;
+      }
+    }
+    else {
+      b->codeLengths[j++] = m;
+      k--;
+      while (k >= 3) {
+        r = k > 6 ? 6 : k;
+        b->codeLengths[j++] = 16 | ((r - 3) << 16);
+        k -= r;
+      }
+    }
+
+    while (k > 0) {
+      b->codeLengths[j++] = m;
+      k--;
+    }
+  }
+
+  b->codeLengthsN = j;
+
+  for (i = 0; i < 19; i++)
+    b->freqCombined[i] = 0;
+  for (i = 0; i < b->codeLengthsN; i++)
+    b->freqCombined[b->codeLengths[i] & 0xFFFF]++;
+
+  huffmanCodeLengths(b->freqCombined, 19, HUFFMAN_CODE_LENGTH_CODE_MAX_BITS, b->codeLengthCombined);
+  huffmanCodes(19, b->codeLengthCombined, b->codeCombined);
+
+  /* the code lengths of the code length codes are sent in a fixed order, without the zeros at the end */
+  b->codesN = 19;
+  while (b->codesN > 4 && b->codeLengthCombined[deflateTTCodeLengthOrder[b->codesN - 1]] == 0)
+    b->codesN--;
+
+  /* HLIT, HDIST, HCLEN, and the code lengths of the code length codes */
+  b->bits = 5 + 5 + 4 + b->codesN * 3;
+
+  /* the compressed code lengths */
+  for (i = 0; i < 19; i++)
+    b->bits += b->freqCombined[i] * b->codeLengthCombined[i];
+  b->bits += b->freqCombined[16] * 2 + b->freqCombined[17] * 3 + b->freqCombined[18] * 7;
+
+  b->bits += _payload_bits(b, b->codeLengthLiterals, b->codeLengthDistances);
+  b->tableSet = -1;
+
+  _reverse_codes(b->codeLiterals, b->codeLengthLiterals, 286);
+  _reverse_codes(b->codeDistances, b->codeLengthDistances, 30);
+  _reverse_codes(b->codeCombined, b->codeLengthCombined, 19);
+}
+
+
+/* builds the trees from the frequencies, and calculates the size of the block. the time spent compressing
+   the code lengths is added to the stats */
+void blockBuildTrees(struct block *b, struct stats *stats) {
+
+  double time;
+  int i, j, k, m, n;
+
+  /* create the trees, and the codes so that the decoder can create them as well using the same code */
+  huffmanCodeLengths(b->freqLiterals, 286, HUFFMAN_CODE_MAX_BITS, b->codeLengthLiterals);
+  huffmanCodeLengths(b->freqDistances, 30, HUFFMAN_CODE_MAX_BITS, b->codeLengthDistances);
+  huffmanCodes(286, b->codeLengthLiterals, b->codeLiterals);
+  huffmanCodes(30, b->codeLengthDistances, b->codeDistances);
+
+  stats->treesBuilt++;
+  time = statsNow();
+
+  if (b->headerFormat == BLOCK_HEADER_RFC) {
+    _build_rfc_header(b);
+    stats->phases[STATS_RLE] += statsNow() - time;
+    return;
+  }
+
+  /********************************************************************************/
+  /* COMPRESS CODE LENGTHS */
+  /********************************************************************************/
+
+  /* merge the code lengths */
+  j = 0;
+  for (i = 0; i < 286; i++)
+    b->codeLengths[j++] = b->codeLengthLiterals[i];
+  for (i = 0; i < 30; i++)
+    b->codeLengths[j++] = b->codeLengthDistances[i];
+
+  /* find the longest code */
+  b->codeLengthMax = 0;
+  for (i = 0; i < 286+30; i++) {
+    if (b->codeLengthMax < b->codeLengths[i])
+      b->codeLengthMax = b->codeLengths[i];
+  }
+  b->codesN = b->codeLengthMax + 4;
+
+  /* RLE compress the code lengths */
+  i = 0;
+  j = 0;
+  while (i < 286 + 30) {
+    m = b->codeLengths[i];
+
+    if (m != 0) {
+      /* output nonzeros as they are */
+      b->codeLengths[j++] = m;
+
+      /* ... but does the symbol repeat? */
+      k = 0;
+      while (i + k < 286+30) {
+        if (b->codeLengths[i + k] != m)
+          break;
+        if (k == 7)
+          break;
+        k++;
+      }
+
+      i++;
+      k--;
+
+      if (k < 3)
+        continue;
+
+      b->codeLengths[j++] = (b->codeLengthMax + 1) | ((k - 3) << 16);
+      i += k;
+    }
+    else {
+      /* RLE compress zeros */
+      k = 1;
+      i++;
+      while (i < 286+30 && k < 138) {
+        if (b->codeLengths[i] != 0)
+          break;
+        k++;
+        i++;
+      }
+
+      /* got k zeros */
+      if (k < 3) {
+        while (k > 0) {
+          b->codeLengths[j++] = 0;
+          k--;
+        }
+      }
+      else if (k < 11)
+        b->codeLengths[j++] = (b->codeLengthMax + 2) | ((k -  3) << 16);
+      else
+        b->codeLengths[j++] = (b->codeLengthMax + 3) | ((k - 11) << 16);
+    }
+  }
+
+  /* now we have j items in the code length array */
+  b->codeLengthsN = j;
+
+  /* calculate the frequencies */
+  for (i = 0; i < b->codesN; i++)
+    b->freqCombined[i] = 0;
+
+  for (i = 0; i < b->codeLengthsN; i++)
+    b->freqCombined[b->codeLengths[i] & 0xFFFF]++;
+
+  /* create the trees */
+  huffmanCodeLengths(b->freqCombined, b->codesN, HUFFMAN_CODE_LENGTH_CODE_MAX_BITS, b->codeLengthCombined);
+  huffmanCodes(b->codesN, b->codeLengthCombined, b->codeCombined);
+
+  /* find the longest code */
+  n = 0;
+  for (i = 0; i < b->codesN; i++) {
+    if (n < b->codeLengthCombined[i])
+      n = b->codeLengthCombined[i];
+  }
+
+  /* calculate the number of bits we need in order to write out the code length bits */
+  if (n < 4)
+    b->codeLengthBits = 2;
+  else if (n < 8)
+    b->codeLengthBits = 3;
+  else if (n < 16)
+    b->codeLengthBits = 4;
+  else if (n < 32)
+    b->codeLengthBits = 5;
+  else if (n < 64)
+    b->codeLengthBits = 6;
+  else
+    b->codeLengthBits = 7;
+
+  stats->phases[STATS_RLE] += statsNow() - time;
+
+  /********************************************************************************/
+  /* SIZE */
+  /********************************************************************************/
+
+  /* the number of code lengths, the bits per code length, and the combined code lengths */
+  b->bits = 8 + 3 + b->codesN * b->codeLengthBits;
+
+  /* the compressed code lengths */
+  for (i = 0; i < b->codesN; i++)
+    b->bits += b->freqCombined[i] * b->codeLengthCombined[i];
+  b->bits += b->freqCombined[b->codeLengthMax + 1] * 2;
+  b->bits += b->freqCombined[b->codeLengthMax + 2] * 3;
+  b->bits += b->freqCombined[b->codeLengthMax + 3] * 7;
+
+  /* the payload */
+  b->bits += _payload_bits(b, b->codeLengthLiterals, b->codeLengthDistances);
+  b->tableSet = -1;
+}
+
+
+/* uses the predefined table set that gives the smallest block, if it's smaller than the block with trees of its own */
+void blockChooseTables(struct block *b) {
+
+  int64_t bits;
+  int i, j, setsN, setBits;
+
+  /* RFC-1951 has only the fixed codes, and doesn't need to name them */
+  setsN = TABLE_SETS_N;
+  setBits = TABLE_SET_BITS;
+  if (b->headerFormat == BLOCK_HEADER_RFC) {
+    setsN = 1;
+    setBits = 0;
+  }
+
+  for (i = 0; i < setsN; i++) {
+    bits = setBits + _payload_bits(b, deflateTTTableCodes[i].codeLengthLiterals, deflateTTTableCodes[i].codeLengthDistances);
+    if (bits >= b->bits)
+      continue;
+
+    b->bits = bits;
+    b->tableSet = i;
+    for (j = 0; j < 286; j++) {
+      b->codeLengthLiterals[j] = deflateTTTableCodes[i].codeLengthLiterals[j];
+      b->codeLiterals[j] = deflateTTTableCodes[i].codeLiterals[j];
+    }
+    for (j = 0; j < 30; j++) {
+      b->codeLengthDistances[j] = deflateTTTableCodes[i].codeLengthDistances[j];
+      b->codeDistances[j] = deflateTTTableCodes[i].codeDistances[j];
+    }
+  }
+
+  if (b->tableSet >= 0 && b->headerFormat == BLOCK_HEADER_RFC) {
+    _reverse_codes(b->codeLiterals, b->codeLengthLiterals, 286);
+    _reverse_codes(b->codeDistances, b->codeLengthDistances, 30);
+  }
+}
+
+
+/* how many bits we'd save by coding the two blocks as one */
+static int _merge_saving(struct block *a, struct block *b, struct block *merged, struct stats *stats) {
+
+  int i;
+
+  merged->headerFormat = a->headerFormat;
+  merged->start = a->start;
+  merged->end = b->end;
+  merged->matchStart = a->matchStart;
+  merged->matchEnd = b->matchEnd;
+
+  for (i = 0; i < 286; i++)
+    merged->freqLiterals[i] = a->freqLiterals[i] + b->freqLiterals[i];
+  for (i = 0; i < 30; i++)
+    merged->freqDistances[i] = a->freqDistances[i] + b->freqDistances[i];
+
+  /* there is only one end marker */
+  merged->freqLiterals[256]--;
+
+  blockBuildTrees(merged, stats);
+
+  /* 3 is the size of a block header. only the blocks of a chunk are merged, so the saving fits */
+  return (int)(a->bits + b->bits + 3 - merged->bits);
+}
+
+
+void blockListInit(struct blockList *l) {
+
+  l->blocks = NULL;
+  l->merged = NULL;
+  l->savings = NULL;
+  l->blocksMax = 0;
+}
+
+
+void blockListFree(struct blockList *l) {
+
+  free(l->blocks);
+  free(l->merged);
+  free(l->savings);
+
+  blockListInit(l);
+}
+
+
+/* makes room for blocksN blocks, the list only grows */
+int blockListReserve(struct blockList *l, int blocksN) {
+
+  struct block *blocks;
+  int *savings;
+
+  if (l->merged == NULL) {
+    l->merged = malloc(sizeof(struct block));
+    if (l->merged == NULL)
+      return FAILED;
+  }
+
+  if (blocksN <= l->blocksMax)
+    return SUCCEEDED;
+
+  blocks = realloc(l->blocks, sizeof(struct block) * blocksN);
+  if (blocks == NULL)
+    return FAILED;
+  l->blocks = blocks;
+
+  savings = realloc(l->savings, sizeof(int) * blocksN);
+  if (savings == NULL)
+    return FAILED;
+  l->savings = savings;
+
+  l->blocksMax = blocksN;
+
+  return SUCCEEDED;
+}
+
+
+/* splits the lz77 tokens into the list's blocks, returns the number of blocks or -1 */
+int blockSplit(struct lz77Tokens *t, struct blockList *l, int headerFormat, struct stats *stats) {
+
+  struct block *b, *merged;
+  int *savings, i, j, k, n, blocksN, best;
+
+  /* cut the tokens into pieces */
+  if (blockListReserve(l, t->symbolsN / BLOCK_SPLIT_TOKENS + 1) == FAILED)
+    return -1;
+
+  b = l->blocks;
+  merged = l->merged;
+  savings = l->savings;
+
+  i = 0;
+  j = 0;
+  n = 0;
+  while (n == 0 || i < t->symbolsN) {
+    b[n].headerFormat = headerFormat;
+    b[n].start = i;
+    b[n].matchStart = j;
+
+    /* the length symbols tell where the piece's matches end */
+    for (k = 0; k < BLOCK_SPLIT_TOKENS && i < t->symbolsN; k++, i++) {
+      if (t->symbols[i] > 256)
+        j++;
+    }
+
+    b[n].end = i;
+    b[n].matchEnd = j;
+
+    blockFrequencies(&b[n], t);
+    blockBuildTrees(&b[n], stats);
+    n++;
+  }
+
+  blocksN = n;
+
+  /* how much does merging each block with the next one save? */
+  for (i = 0; i < blocksN - 1; i++)
+    savings[i] = _merge_saving(&b[i], &b[i + 1], merged, stats);
+
+  while (blocksN > 1) {
+    best = 0;
+    for (i = 1; i < blocksN - 1; i++) {
+      if (savings[i] > savings[best])
+        best = i;
+    }
+
+    if (savings[best] <= 0)
+      break;
+
+    /* merge the best pair */
+    _merge_saving(&b[best], &b[best + 1], &b[best], stats);
+
+    for (i = best + 1; i < blocksN - 1; i++) {
+      b[i] = b[i + 1];
+      savings[i] = savings[i + 1];
+    }
+    blocksN--;
+
+    /* the neighbours' savings changed */
+    if (best > 0)
+      savings[best - 1] = _merge_saving(&b[best - 1], &b[best], merged, stats);
+    if (best < blocksN - 1)
+      savings[best] = _merge_saving(&b[best], &b[best + 1], merged, stats);
+  }
+
+  return blocksN;
+}
+
+
+/* the number of bytes the block decodes into */
+int blockRawSize(struct block *b, struct lz77Tokens *t) {
+
+  int i, m, n, size;
+
+  size = 0;
+  m = b->matchStart;
+  for (i = b->start; i < b->end; i++) {
+    n = t->symbols[i];
+    if (n < 256)
+      size++;
+    else if (n > 256)
+      size += deflateTTBaseValueLengths[n - 257] + LZ77_MATCH_LENGTH_EXTRA(t->matches[m++]);
+  }
+
+  return size;
+}
+
+
+/* returns the number of bytes in the data that are repeats, found using the newest position of each hash only */
+static int _repeated_bytes(unsigned char *data, int size) {
+
+  int last[1 << BLOCK_SCAN_HASH_BITS], i, h, n, position, repeats;
+
+  for (i = 0; i < (1 << BLOCK_SCAN_HASH_BITS); i++)
+    last[i] = -1;
+
+  repeats = 0;
+  i = 0;
+  while (i + 4 <= size) {
+    h = (int)((((data[i] | (data[i+1] << 8) | (data[i+2] << 16) | ((unsigned int)data[i+3] << 24)) * 2654435761u) & 0xFFFFFFFF) >> (32 - BLOCK_SCAN_HASH_BITS));
+    position = last[h];
+    last[h] = i;
+
+    if (position >= 0 && i - position <= MATCH_DISTANCE_MAX) {
+      n = 0;
+      while (i + n < size && n < MATCH_LENGTH_MAX && data[position + n] == data[i + n])
+        n++;
+
+      if (n >= 4) {
+        repeats += n;
+        i += n;
+        continue;
+      }
+    }
+
+    i++;
+  }
+
+  return repeats;
+}
+
+
+/* estimates the order-0 entropy of the data from samples spread over it, returns YES if it's too high for Huffman coding */
+int blockIsIncompressible(unsigned char *data, int size) {
+
+  int histogram[256], i, j, n, step;
+  double entropy, p;
+
+  if (size < BLOCK_SCAN_REGION_MIN)
+    return NO;
+
+  for (i = 0; i < 256; i++)
+    histogram[i] = 0;
+
+  step = size / BLOCK_SCAN_SAMPLES;
+  for (i = 0; i < BLOCK_SCAN_SAMPLES; i++) {
+    for (j = 0; j < BLOCK_SCAN_SAMPLE_SIZE; j++)
+      histogram[data[i*step + j]]++;
+  }
+
+  n = BLOCK_SCAN_SAMPLES * BLOCK_SCAN_SAMPLE_SIZE;
+  entropy = 0;
+  for (i = 0; i < 256; i++) {
+    if (histogram[i] > 0) {
+      p = (double)histogram[i] / n;
+      entropy -= p * log(p);
+    }
+  }
+
+  if (entropy / log(2.0) <= BLOCK_SCAN_ENTROPY_MAX)
+    return NO;
+
+  if (_repeated_bytes(data, size) >= (size >> BLOCK_SCAN_REPEATS_SHIFT))
+    return NO;
+
+  return YES;
+}
@@ -0,0 +1,101 @@
+
+#ifndef _BLOCK_H
+#define _BLOCK_H
+
+#include <stdint.h>
+
+/* the block types in DEFd files */
+#define BLOCK_TYPE_STORED     0
+#define BLOCK_TYPE_PREDEFINED 1
+#define BLOCK_TYPE_HUFFMAN    2
+
+/* how a block codes its trees: deflateTT's own way, or the standard way of RFC-1951 */
+#define BLOCK_HEADER_DEF 0
+#define BLOCK_HEADER_RFC 1
+
+/* a stored block is byte aligned, starts with its size (u16) and the size's complement (u16), and holds this many bytes at most */
+#define BLOCK_STORED_SIZE_MAX 65535
+
+/* the bits a stored block costs in addition to its bytes, at most: the block header, the padding and the sizes */
+#define BLOCK_STORED_OVERHEAD (3 + 7 + 32)
+
+/* the entropy scan looks at regions this big, taking samples of this many bytes from each */
+#define BLOCK_SCAN_REGION_SIZE  (1 << 16)
+#define BLOCK_SCAN_REGION_MIN   4096
+#define BLOCK_SCAN_SAMPLES      16
+#define BLOCK_SCAN_SAMPLE_SIZE  256
+
+/* a region with more bits of entropy per byte than this is stored as it is... */
+#define BLOCK_SCAN_ENTROPY_MAX  7.9
+
+/* ...unless at least 1/64th of it repeats, found using one hash probe per position */
+#define BLOCK_SCAN_REPEATS_SHIFT 6
+#define BLOCK_SCAN_HASH_BITS     14
+
+/* block splitting starts from pieces of this many lz77 tokens */
+#define BLOCK_SPLIT_TOKENS 4096
+
+struct block {
+  /* BLOCK_HEADER_DEF or BLOCK_HEADER_RFC */
+  int headerFormat;
+
+  /* the lz77 symbols [start, end) and matches [matchStart, matchEnd) coded in this block, the end marker is not included */
+  int start;
+  int end;
+  int matchStart;
+  int matchEnd;
+
+  /* the huffman frequencies */
+  int freqLiterals[286];
+  int freqDistances[30];
+  int freqCombined[HUFFMAN_CODE_MAX_BITS + 4];
+
+  /* code lengths */
+  int codeLengthLiterals[286];
+  int codeLengthDistances[30];
+  int codeLengthCombined[HUFFMAN_CODE_MAX_BITS + 4];
+
+  /* codes */
+  int codeLiterals[286];
+  int codeDistances[30];
+  int codeCombined[HUFFMAN_CODE_MAX_BITS + 4];
+
+  /* the RLE compressed code lengths */
+  int codeLengths[286+30];
+  int codeLengthsN;
+  int codeLengthMax;
+  int codesN;
+
+  /* RFC-1951: the number of literal/length and distance code lengths sent */
+  int literalsN;
+  int distancesN;
+
+  /* the number of bits per combined code length */
+  int codeLengthBits;
+
+  /* the predefined table set the block uses, or -1 if it has trees of its own */
+  int tableSet;
+
+  /* the size of the coded block in bits, without the block header. a DEFc block can be 256MB */
+  int64_t bits;
+};
+
+/* the blocks of a run, and the memory blockSplit() works in. it's kept between the runs, and grows when needed */
+struct blockList {
+  struct block *blocks;
+  struct block *merged;
+  int *savings;
+  int blocksMax;
+};
+
+void blockFrequencies(struct block *b, struct lz77Tokens *t);
+void blockBuildTrees(struct block *b, struct stats *stats);
+void blockListInit(struct blockList *l);
+void blockListFree(struct blockList *l);
+int blockListReserve(struct blockList *l, int blocksN);
+int blockSplit(struct lz77Tokens *t, struct blockList *l, int headerFormat, struct stats *stats);
+void blockChooseTables(struct block *b);
+int blockRawSize(struct block *b, struct lz77Tokens *t);
+int blockIsIncompressible(unsigned char *data, int size);
+
+#endif
@@ -0,0 +1,72 @@
+
+/*
+ * deflateTT's checksums: Adler-32 (RFC-1950) for zlib streams and the
+ * dictionary ids, and CRC-32 (RFC-1952) for gzip files. Both can be
+ * computed a piece at a time, passing the previous result in.
+ *
+ * This code is under GNU General Public Licence (GPL), version 2, June 1991.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "defines.h"
+#include "checksum.h"
+
+
+/* the sums can grow this many bytes before they must be reduced modulo 65521 */
+#define ADLER32_RUN 5552
+
+static uint32_t _crcTable[256];
+
+
+uint32_t checksumAdler32(uint32_t adler, unsigned char *data, int size) {
+
+  uint32_t a, b;
+  int i, n;
+
+  a = adler & 0xFFFF;
+  b = (adler >> 16) & 0xFFFF;
+
+  while (size > 0) {
+    n = size < ADLER32_RUN ? size : ADLER32_RUN;
+    for (i = 0; i < n; i++) {
+      a += data[i];
+      b += a;
+    }
+    a %= 65521;
+    b %= 65521;
+
+    data += n;
+    size -= n;
+  }
+
+  return (b << 16) | a;
+}
+
+
+/* builds the CRC-32 table, once before any checksums are computed, see deflateSetup() */
+void checksumInit(void) {
+
+  uint32_t c;
+  int i, j;
+
+  for (i = 0; i < 256; i++) {
+    c = (uint32_t)i;
+    for (j = 0; j < 8; j++)
+      c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+    _crcTable[i] = c;
+  }
+}
+
+
+uint32_t checksumCrc32(uint32_t crc, unsigned char *data, int size) {
+
+  int i;
+
+  crc = ~crc & 0xFFFFFFFF;
+  for (i = 0; i < size; i++)
+    crc = _crcTable[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+
+  return ~crc & 0xFFFFFFFF;
+}
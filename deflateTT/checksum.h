@@ -0,0 +1,15 @@
+
+#ifndef _CHECKSUM_H
+#define _CHECKSUM_H
+
+#include <stdint.h>
+
+/* the checksums start from these */
+#define CHECKSUM_ADLER32_INIT 1
+#define CHECKSUM_CRC32_INIT   0
+
+void checksumInit(void);
+uint32_t checksumAdler32(uint32_t adler, unsigned char *data, int size);
+uint32_t checksumCrc32(uint32_t crc, unsigned char *data, int size);
+
+#endif
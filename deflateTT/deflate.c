@@ -0,0 +1,742 @@
+
+/*
+ * deflateTT's compressor as a library. deflate() compresses a buffer into
+ * a buffer in any of deflateTT's formats, using a DeflateContext that holds
+ * the match finder, the lz77 tokens, the blocks and the output. The context
+ * keeps all that between the calls, so a server can keep one context per
+ * thread and compress request after request without any allocations, and
+ * without running deflateTT for each of them. The contexts don't share
+ * anything but the constant tables, which deflateSetup() builds only once.
+ *
+ * deflateTT itself uses deflateChunk() to compress its files a chunk at a
+ * time, in many threads.
+ *
+ * This code is under GNU General Public Licence (GPL), version 2, June 1991.
+ */
+
+/* for pthreads */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <pthread.h>
+
+#include "defines.h"
+#include "huffman.h"
+#include "match.h"
+#include "lz77.h"
+#include "stats.h"
+#include "block.h"
+#include "bitwriter.h"
+#include "dictionary.h"
+#include "tables.h"
+#include "checksum.h"
+#include "deflate.h"
+#include "main.h"
+
+
+/* the number of extra bits in the compressed data */
+const int deflateTTExtraBitsLengths[] = {
+  0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+  1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+  4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+const int deflateTTExtraBitsDistances[] = {
+  0, 0, 0, 0, 1, 1, 2, 2, 3, 3,
+  4, 4, 5, 5, 6, 6, 7, 7, 8, 8,
+  9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+/* the smallest length and distance of each symbol */
+const int deflateTTBaseValueLengths[] = {
+  3, 4, 5, 6, 7, 8, 9, 10, 11, 13,
+  15, 17, 19, 23, 27, 31, 35, 43, 51, 59,
+  67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+const int deflateTTBaseValueDistances[] = {
+  1, 2, 3, 4, 5, 7, 9, 13, 17, 25,
+  33, 49, 65, 97, 129, 193, 257, 385, 513, 769,
+  1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+
+/* the order in which RFC-1951 sends the code lengths of the code length codes */
+const int deflateTTCodeLengthOrder[] = {
+  16, 17, 18, 0, 8, 7, 9, 6, 10, 5,
+  11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+/* compression levels: how hard the match finder tries, and how the matches are used */
+const struct level deflateTTLevels[] = {
+  /* finder, chainMax, niceLength, parser, lazyLength, iterations */
+  { MATCH_FINDER_HASH_CHAIN,     0,   0, LZ77_PARSER_GREEDY,    0, 0 },
+  { MATCH_FINDER_HASH_CHAIN,     4,   8, LZ77_PARSER_GREEDY,    0, 0 },
+  { MATCH_FINDER_HASH_CHAIN,     8,  16, LZ77_PARSER_GREEDY,    0, 0 },
+  { MATCH_FINDER_HASH_CHAIN,    16,  32, LZ77_PARSER_GREEDY,    0, 0 },
+  { MATCH_FINDER_HASH_CHAIN,    16,  32, LZ77_PARSER_LAZY,     16, 0 },
+  { MATCH_FINDER_HASH_CHAIN,    32,  64, LZ77_PARSER_LAZY,     32, 0 },
+  { MATCH_FINDER_HASH_CHAIN,   128, 128, LZ77_PARSER_LAZY,    128, 0 },
+  { MATCH_FINDER_HASH_CHAIN,   256, 258, LZ77_PARSER_LAZY2,   258, 0 },
+  { MATCH_FINDER_BINARY_TREE,  128, 258, LZ77_PARSER_LAZY2,   258, 0 },
+  { MATCH_FINDER_BINARY_TREE, 1024, 258, LZ77_PARSER_LAZY2,   258, 0 },
+  /* ultra */
+  { MATCH_FINDER_BINARY_TREE, 1024, 258, LZ77_PARSER_OPTIMAL,   0, 8 }
+};
+
+
+/*
+  Extra               Extra               Extra
+  Code Bits Length(s) Code Bits Lengths   Code Bits Length(s)
+  ---- ---- ------     ---- ---- -------   ---- ---- -------
+  257   0     3       267   1   15,16     277   4   67-82
+  258   0     4       268   1   17,18     278   4   83-98
+  259   0     5       269   2   19-22     279   4   99-114
+  260   0     6       270   2   23-26     280   4  115-130
+  261   0     7       271   2   27-30     281   5  131-162
+  262   0     8       272   2   31-34     282   5  163-194
+  263   0     9       273   3   35-42     283   5  195-226
+  264   0    10       274   3   43-50     284   5  227-257
+  265   1  11,12      275   3   51-58     285   0    258
+  266   1  13,14      276   3   59-66
+
+  Extra           Extra               Extra
+  Code Bits Dist  Code Bits   Dist     Code Bits Distance
+  ---- ---- ----  ---- ----  ------    ---- ---- --------
+  0   0    1     10   4     33-48    20    9   1025-1536
+  1   0    2     11   4     49-64    21    9   1537-2048
+  2   0    3     12   5     65-96    22   10   2049-3072
+  3   0    4     13   5     97-128   23   10   3073-4096
+  4   1   5,6    14   6    129-192   24   11   4097-6144
+  5   1   7,8    15   6    193-256   25   11   6145-8192
+  6   2   9-12   16   7    257-384   26   12  8193-12288
+  7   2  13-16   17   7    385-512   27   12 12289-16384
+  8   3  17-24   18   8    513-768   28   13 16385-24576
+  9   3  25-32   19   8   769-1024   29   13 24577-32768
+*/
+
+
+/* writes the code lengths of a block's trees */
+static void _write_trees(struct bitWriter *w, struct block *b) {
+
+  int i, n;
+
+  /* the number of code lengths */
+  bitWriterWrite(w, b->codesN, 8);
+
+  /* the number of bits per code length */
+  bitWriterWrite(w, b->codeLengthBits, 3);
+
+  /* combined code lengths */
+  for (i = 0; i < b->codesN; i++)
+    bitWriterWrite(w, b->codeLengthCombined[i], b->codeLengthBits);
+
+  /* compress combined code lengths */
+  for (i = 0; i < b->codeLengthsN; i++) {
+    n = b->codeLengths[i] & 0xFFFF;
+
+    bitWriterWrite(w, b->codeCombined[n], b->codeLengthCombined[n]);
+
+    /* extra bits? */
+    if (n > b->codeLengthMax) {
+      if (n == b->codeLengthMax + 1)
+        bitWriterWrite(w, b->codeLengths[i] >> 16, 2);
+      else if (n == b->codeLengthMax + 2)
+        bitWriterWrite(w, b->codeLengths[i] >> 16, 3);
+      else
+        bitWriterWrite(w, b->codeLengths[i] >> 16, 7);
+    }
+  }
+}
+
+
+/* writes the code lengths of a block's trees the RFC-1951 way */
+static void _write_trees_rfc(struct bitWriter *w, struct block *b) {
+
+  int i, n;
+
+  bitWriterWrite(w, b->literalsN - 257, 5);
+  bitWriterWrite(w, b->distancesN - 1, 5);
+  bitWriterWrite(w, b->codesN - 4, 4);
+
+  for (i = 0; i < b->codesN; i++)
+    bitWriterWrite(w, b->codeLengthCombined[deflateTTCodeLengthOrder[i]], 3);
+
+  for (i = 0; i < b->codeLengthsN; i++) {
+    n = b->codeLengths[i] & 0xFFFF;
+
+    bitWriterWrite(w, b->codeCombined[n], b->codeLengthCombined[n]);
+
+    /* extra bits? */
+    if (n == 16)
+      bitWriterWrite(w, b->codeLengths[i] >> 16, 2);
+    else if (n == 17)
+      bitWriterWrite(w, b->codeLengths[i] >> 16, 3);
+    else if (n == 18)
+      bitWriterWrite(w, b->codeLengths[i] >> 16, 7);
+  }
+}
+
+
+/* writes the trees (or the id of the predefined table set), the payload and the end marker of a block */
+static void _write_block(struct bitWriter *w, struct block *b, struct lz77Tokens *t) {
+
+  uint32_t match;
+  int i, m, n;
+
+  if (b->tableSet >= 0) {
+    /* RFC-1951 has only the fixed codes, so they don't need an id */
+    if (b->headerFormat == BLOCK_HEADER_DEF)
+      bitWriterWrite(w, b->tableSet, TABLE_SET_BITS);
+  }
+  else if (b->headerFormat == BLOCK_HEADER_RFC)
+    _write_trees_rfc(w, b);
+  else
+    _write_trees(w, b);
+
+  /* compress payload */
+  m = b->matchStart;
+  for (i = b->start; i < b->end; i++) {
+    n = t->symbols[i];
+
+    bitWriterWrite(w, b->codeLiterals[n], b->codeLengthLiterals[n]);
+
+    if (n > 256) {
+      match = t->matches[m++];
+
+      /* length extra bits */
+      bitWriterWrite(w, LZ77_MATCH_LENGTH_EXTRA(match), deflateTTExtraBitsLengths[n - 257]);
+
+      /* distance, and its extra bits */
+      n = LZ77_MATCH_DISTANCE_SYMBOL(match);
+      bitWriterWrite(w, b->codeDistances[n], b->codeLengthDistances[n]);
+      bitWriterWrite(w, LZ77_MATCH_DISTANCE_EXTRA(match), deflateTTExtraBitsDistances[n]);
+    }
+  }
+
+  /* the end marker */
+  bitWriterWrite(w, b->codeLiterals[256], b->codeLengthLiterals[256]);
+}
+
+
+/* writes the bytes as they are, into as many stored blocks as needed, returns the number of blocks */
+static int _write_stored(struct bitWriter *w, unsigned char *data, int size, int last) {
+
+  int n, blocksN = 0;
+
+  do {
+    n = size;
+    if (n > BLOCK_STORED_SIZE_MAX)
+      n = BLOCK_STORED_SIZE_MAX;
+
+    bitWriterWrite(w, (last == YES && n == size) ? 1 : 0, 1);
+    bitWriterWrite(w, BLOCK_TYPE_STORED, 2);
+
+    /* the decoder can copy the bytes as they are */
+    bitWriterAlign(w);
+    bitWriterWriteU8(w, n & 0xFF);
+    bitWriterWriteU8(w, n >> 8);
+    bitWriterWriteU8(w, ~n & 0xFF);
+    bitWriterWriteU8(w, (~n >> 8) & 0xFF);
+    bitWriterWriteBytes(w, data, n);
+
+    data += n;
+    size -= n;
+    blocksN++;
+  } while (size > 0);
+
+  return blocksN;
+}
+
+
+/* compresses data[start, end), the 32K before start are the dictionary. returns the number of blocks or -1 */
+static int _deflate_run(struct DeflateContext *context, struct bitWriter *w, unsigned char *data, int start, int end, int last) {
+
+  struct deflateState *s = context->state;
+  const struct level *l = s->level;
+  struct lz77Tokens *t = &s->tokens;
+  struct lz77Stats runStats;
+  struct stats *stats = &s->stats;
+  struct block *blocks;
+  double time, rleTime;
+  int i, n, blocksN, blocksWritten, windowStart, size;
+
+  /********************************************************************************/
+  /* ~LZ77 */
+  /********************************************************************************/
+
+  windowStart = start - MATCH_WINDOW_SIZE;
+  if (windowStart < 0)
+    windowStart = 0;
+
+  time = statsNow();
+
+  matchFinderReset(&s->matchFinder, data + windowStart, end - windowStart);
+
+  if (lz77Parse(&s->matchFinder, start - windowStart, l->parser, l->lazyLength, l->iterations, t, &runStats) < 0)
+    return -1;
+
+  context->matches += runStats.matches;
+  context->duplicateBytes += runStats.duplicateBytes;
+
+  stats->searches += s->matchFinder.searches;
+  stats->probes += s->matchFinder.probes;
+  s->matchFinder.searches = 0;
+  s->matchFinder.probes = 0;
+
+  /* the huffman phase doesn't include the code length compression, that's a phase of its own */
+  rleTime = stats->phases[STATS_RLE];
+  stats->phases[STATS_LZ77] += statsNow() - time;
+  time = statsNow();
+
+  /********************************************************************************/
+  /* HUFFMAN */
+  /********************************************************************************/
+
+  if (context->format == DEFLATE_FORMAT_DEFC) {
+    /* everything goes into one block */
+    if (blockListReserve(&s->blocks, 1) == FAILED)
+      return -1;
+
+    blocks = s->blocks.blocks;
+    blocksN = 1;
+    blocks[0].headerFormat = BLOCK_HEADER_DEF;
+    blocks[0].start = 0;
+    blocks[0].end = t->symbolsN;
+    blocks[0].matchStart = 0;
+    blocks[0].matchEnd = t->matchesN;
+    blockFrequencies(&blocks[0], t);
+    blockBuildTrees(&blocks[0], stats);
+  }
+  else {
+    blocksN = blockSplit(t, &s->blocks, context->format == DEFLATE_FORMAT_DEFD ? BLOCK_HEADER_DEF : BLOCK_HEADER_RFC, stats);
+    if (blocksN < 0)
+      return -1;
+    blocks = s->blocks.blocks;
+  }
+
+  stats->phases[STATS_HUFFMAN] += statsNow() - time - (stats->phases[STATS_RLE] - rleTime);
+
+  /********************************************************************************/
+  /* OUTPUT (DEF) */
+  /********************************************************************************/
+
+  blocksWritten = 0;
+  for (i = 0; i < blocksN; i++) {
+    time = statsNow();
+
+    if (context->format == DEFLATE_FORMAT_DEFC) {
+      _write_block(w, &blocks[i], t);
+      blocksWritten++;
+      stats->phases[STATS_EMIT] += statsNow() - time;
+      continue;
+    }
+
+    /* is the block smaller using a predefined table set, or as it is? */
+    blockChooseTables(&blocks[i]);
+    size = blockRawSize(&blocks[i], t);
+
+    stats->phases[STATS_HUFFMAN] += statsNow() - time;
+    time = statsNow();
+    n = (size + BLOCK_STORED_SIZE_MAX - 1) / BLOCK_STORED_SIZE_MAX;
+    if (size > 0 && size*8 + n*BLOCK_STORED_OVERHEAD < blocks[i].bits + 3) {
+      blocksWritten += _write_stored(w, data + start, size, (last == YES && i == blocksN - 1) ? YES : NO);
+      context->storedBytes += size;
+    }
+    else {
+      /* is this the last block? */
+      bitWriterWrite(w, (last == YES && i == blocksN - 1) ? 1 : 0, 1);
+      /* block type */
+      bitWriterWrite(w, blocks[i].tableSet >= 0 ? BLOCK_TYPE_PREDEFINED : BLOCK_TYPE_HUFFMAN, 2);
+
+      _write_block(w, &blocks[i], t);
+      blocksWritten++;
+    }
+
+    stats->phases[STATS_EMIT] += statsNow() - time;
+    start += size;
+  }
+
+  return blocksWritten;
+}
+
+
+/* YES if the region starting at position looks incompressible */
+static int _region_is_stored(int format, unsigned char *data, int position, int end) {
+
+  int size;
+
+  /* DEFc has only one block */
+  if (format == DEFLATE_FORMAT_DEFC)
+    return NO;
+
+  size = end - position;
+  if (size > BLOCK_SCAN_REGION_SIZE)
+    size = BLOCK_SCAN_REGION_SIZE;
+
+  return blockIsIncompressible(data + position, size);
+}
+
+
+/* compresses one chunk, the dictionary is in front of it in data[], returns the number of blocks or -1.
+   the incompressible regions are stored as they are, and the rest is compressed in runs between them.
+   the results are added to the context's */
+int deflateChunk(struct DeflateContext *context, struct bitWriter *w, unsigned char *data, int dictionarySize, int chunkSize, int last) {
+
+  struct deflateState *s = context->state;
+  double time;
+  int n, blocksN, start, end, runEnd, stored, nextStored, runLast, format;
+
+  /* the tokens of a run take as much room as its bytes, a DEFc file is one big chunk */
+  if (chunkSize > s->tokens.size) {
+    lz77TokensFree(&s->tokens);
+    if (lz77TokensInit(&s->tokens, chunkSize) == FAILED)
+      return -1;
+  }
+
+  format = context->format;
+  blocksN = 0;
+  start = dictionarySize;
+  end = dictionarySize + chunkSize;
+
+  time = statsNow();
+  stored = _region_is_stored(format, data, start, end);
+  s->stats.phases[STATS_PREPROCESS] += statsNow() - time;
+
+  do {
+    /* the run goes on as long as the regions are alike */
+    time = statsNow();
+    runEnd = start;
+    nextStored = stored;
+    while (runEnd < end && nextStored == stored) {
+      runEnd += BLOCK_SCAN_REGION_SIZE;
+      if (runEnd > end)
+        runEnd = end;
+      else
+        nextStored = _region_is_stored(format, data, runEnd, end);
+    }
+
+    runLast = (last == YES && runEnd == end) ? YES : NO;
+    s->stats.phases[STATS_PREPROCESS] += statsNow() - time;
+
+    if (stored == YES) {
+      time = statsNow();
+      n = _write_stored(w, data + start, runEnd - start, runLast);
+      context->storedBytes += runEnd - start;
+      s->stats.phases[STATS_EMIT] += statsNow() - time;
+    }
+    else
+      n = _deflate_run(context, w, data, start, runEnd, runLast);
+
+    if (n < 0)
+      return -1;
+
+    blocksN += n;
+    start = runEnd;
+    stored = nextStored;
+  } while (start < end && w->full == NO);
+
+  context->blocksN += blocksN;
+
+  return blocksN;
+}
+
+
+static void _write_u32_big_endian(struct bitWriter *w, uint32_t data) {
+
+  bitWriterWriteU8(w, data >> 24);
+  bitWriterWriteU8(w, data >> 16);
+  bitWriterWriteU8(w, data >> 8);
+  bitWriterWriteU8(w, data);
+}
+
+
+/* writes the header of the format, the DEFd size flags are given. the level is only a hint for zlib and gzip */
+void deflateWriteHeader(struct bitWriter *w, int format, int flags, uint64_t inputSize, int level, unsigned char *dictionary, int dictionarySize) {
+
+  int n;
+
+  /* RFC-1951 doesn't have a header */
+  if (format == DEFLATE_FORMAT_RAW)
+    return;
+
+  /* RFC-1950: deflate with a 32K window, the level, and the id of the dictionary. the first two bytes are a multiple of 31 */
+  if (format == DEFLATE_FORMAT_ZLIB) {
+    if (level <= 1)
+      n = ZLIB_LEVEL_FASTEST;
+    else if (level <= 5)
+      n = ZLIB_LEVEL_FAST;
+    else if (level == DEFLATE_LEVEL_DEFAULT)
+      n = ZLIB_LEVEL_DEFAULT;
+    else
+      n = ZLIB_LEVEL_MAX;
+
+    n = (n << 6) | (dictionarySize > 0 ? ZLIB_FLAG_DICTIONARY : 0);
+    n += 31 - ((ZLIB_METHOD_DEFLATE_32K << 8) | n) % 31;
+
+    bitWriterWriteU8(w, ZLIB_METHOD_DEFLATE_32K);
+    bitWriterWriteU8(w, n);
+
+    if (dictionarySize > 0)
+      _write_u32_big_endian(w, dictionaryId(dictionary, dictionarySize));
+    return;
+  }
+
+  /* RFC-1952: deflate, no flags, no time stamp, the level, and an unknown OS */
+  if (format == DEFLATE_FORMAT_GZIP) {
+    bitWriterWriteU8(w, 0x1F);
+    bitWriterWriteU8(w, 0x8B);
+    bitWriterWriteU8(w, GZIP_METHOD_DEFLATE);
+    bitWriterWriteU8(w, 0);
+    bitWriterWriteU32(w, 0);
+    bitWriterWriteU8(w, level >= 9 ? GZIP_LEVEL_MAX : (level == 1 ? GZIP_LEVEL_FASTEST : 0));
+    bitWriterWriteU8(w, GZIP_OS_UNKNOWN);
+    return;
+  }
+
+  bitWriterWriteU8(w, 'D');
+  bitWriterWriteU8(w, 'E');
+  bitWriterWriteU8(w, 'F');
+
+  if (format == DEFLATE_FORMAT_DEFC)
+    bitWriterWriteU8(w, 'c');
+  else {
+    bitWriterWriteU8(w, 'd');
+    bitWriterWriteU8(w, flags | (dictionarySize > 0 ? DEFD_FLAG_DICTIONARY : 0));
+  }
+
+  /* unpacked size */
+  if (flags == 0)
+    bitWriterWriteU32(w, (unsigned int)inputSize);
+  else if (flags == DEFD_FLAG_SIZE_64) {
+    bitWriterWriteU32(w, (unsigned int)(inputSize & 0xFFFFFFFF));
+    bitWriterWriteU32(w, (unsigned int)(inputSize >> 32));
+  }
+
+  if (dictionarySize > 0)
+    bitWriterWriteU32(w, dictionaryId(dictionary, dictionarySize));
+}
+
+
+
+
+/* the trailers start at a byte boundary: zlib has the Adler-32 of the data (big endian), gzip the CRC-32 and the size */
+void deflateWriteTrailer(struct bitWriter *w, int format, uint32_t checksum, uint64_t inputSize) {
+
+  if (format == DEFLATE_FORMAT_ZLIB) {
+    bitWriterAlign(w);
+    _write_u32_big_endian(w, checksum);
+  }
+  else if (format == DEFLATE_FORMAT_GZIP) {
+    bitWriterAlign(w);
+    bitWriterWriteU32(w, checksum);
+    bitWriterWriteU32(w, (unsigned int)(inputSize & 0xFFFFFFFF));
+  }
+}
+
+
+static pthread_once_t _setupOnce = PTHREAD_ONCE_INIT;
+
+
+static void _setup(void) {
+
+  matchFinderSetup();
+  tablesInit();
+  checksumInit();
+}
+
+
+/* builds the tables all the contexts share, only the first call does anything */
+void deflateSetup(void) {
+
+  pthread_once(&_setupOnce, _setup);
+}
+
+
+int deflateContextInit(struct DeflateContext *context, int level, int format) {
+
+  struct deflateState *s;
+  const struct level *l;
+
+  deflateSetup();
+
+  context->level = level;
+  context->format = format;
+  context->matches = 0;
+  context->duplicateBytes = 0;
+  context->storedBytes = 0;
+  context->blocksN = 0;
+  context->state = NULL;
+
+  if (level < 0 || level > DEFLATE_LEVEL_ULTRA || format < DEFLATE_FORMAT_DEFC || format > DEFLATE_FORMAT_GZIP)
+    return DEFLATE_UNSUPPORTED;
+
+  /* everything starts as NULL, so that deflateContextFree() can clean up after a failure */
+  s = calloc(1, sizeof(struct deflateState));
+  if (s == NULL)
+    return DEFLATE_OUT_OF_MEMORY;
+
+  l = &deflateTTLevels[level];
+  s->level = l;
+  blockListInit(&s->blocks);
+  context->state = s;
+
+  /* DEFc's tokens grow to the size of the data on the first call */
+  if (matchFinderInit(&s->matchFinder, l->finder, l->chainMax, l->niceLength) == FAILED ||
+      lz77TokensInit(&s->tokens, format == DEFLATE_FORMAT_DEFC ? 0 : CHUNK_SIZE) == FAILED ||
+      bitWriterInit(&s->writer, NULL) == FAILED) {
+    deflateContextFree(context);
+    return DEFLATE_OUT_OF_MEMORY;
+  }
+  if (format >= DEFLATE_FORMAT_RAW)
+    bitWriterSetOrder(&s->writer, BIT_WRITER_LSB_FIRST);
+
+  return DEFLATE_OK;
+}
+
+
+/* the dictionary is copied into the context, and used by all the following calls. size 0 removes it */
+int deflateContextSetDictionary(struct DeflateContext *context, const uint8_t *dictionary, int size) {
+
+  struct deflateState *s = context->state;
+
+  if (context->format == DEFLATE_FORMAT_DEFC || context->format == DEFLATE_FORMAT_GZIP || size < 0)
+    return DEFLATE_UNSUPPORTED;
+
+  /* only the last 32K can be reached */
+  if (size > MATCH_WINDOW_SIZE) {
+    dictionary += size - MATCH_WINDOW_SIZE;
+    size = MATCH_WINDOW_SIZE;
+  }
+
+  if (size > 0 && s->window == NULL) {
+    s->dictionary = malloc(MATCH_WINDOW_SIZE);
+    s->window = malloc(MATCH_WINDOW_SIZE + CHUNK_SIZE);
+    if (s->dictionary == NULL || s->window == NULL) {
+      free(s->dictionary);
+      free(s->window);
+      s->dictionary = NULL;
+      s->window = NULL;
+      s->dictionarySize = 0;
+      return DEFLATE_OUT_OF_MEMORY;
+    }
+  }
+
+  if (size > 0)
+    memcpy(s->dictionary, dictionary, size);
+  s->dictionarySize = size;
+
+  return DEFLATE_OK;
+}
+
+
+void deflateContextFree(struct DeflateContext *context) {
+
+  struct deflateState *s = context->state;
+
+  if (s == NULL)
+    return;
+
+  matchFinderFree(&s->matchFinder);
+  lz77TokensFree(&s->tokens);
+  blockListFree(&s->blocks);
+  bitWriterFree(&s->writer);
+  free(s->dictionary);
+  free(s->window);
+  free(s);
+
+  context->state = NULL;
+}
+
+
+/* the most bytes deflate() can output for size bytes of input: DEFc codes a literal in 9 bits at most,
+   the other formats store what doesn't compress, and have room for the header, the trees and the trailer */
+size_t deflateBound(size_t size) {
+
+  return size + (size >> 3) + DEFLATE_BOUND_OVERHEAD;
+}
+
+
+/* compresses data into output. *outputSize is the size of output, and it's set to the size of the
+   compressed data. the compressed data goes right into output, and if it doesn't fit, deflate() stops
+   at the end of the run that filled it up and sets *outputSize to deflateBound(size), which is enough */
+int deflate(const uint8_t *data, size_t size, uint8_t *output, size_t *outputSize, struct DeflateContext *context) {
+
+  struct deflateState *s = context->state;
+  struct bitWriter *w = &s->writer;
+  unsigned char *chunk;
+  uint32_t checksum;
+  int n, position, dictionarySize, chunkSizeMax, last, result;
+
+  if (size > DEFLATE_SIZE_MAX || (context->format == DEFLATE_FORMAT_DEFC && size > CHUNK_SIZE_MAX_DEFC))
+    return DEFLATE_TOO_BIG;
+
+  if (output == NULL) {
+    *outputSize = deflateBound(size);
+    return DEFLATE_OUTPUT_FULL;
+  }
+
+  context->matches = 0;
+  context->duplicateBytes = 0;
+  context->storedBytes = 0;
+  context->blocksN = 0;
+  statsClear(&s->stats);
+
+  /* the writer's own buffer only takes what doesn't fit into output */
+  bitWriterReset(w);
+  bitWriterSetBuffer(w, output, *outputSize > (size_t)INT_MAX ? INT_MAX : (int)*outputSize);
+  deflateWriteHeader(w, context->format, 0, (uint64_t)size, context->level, s->dictionary, s->dictionarySize);
+
+  /* DEFc has only one chunk */
+  chunkSizeMax = (context->format == DEFLATE_FORMAT_DEFC) ? (int)size : CHUNK_SIZE;
+
+  /* the chunks are compressed right where they are (the data is only read), the data before a chunk
+     is its dictionary. only the first chunk is copied, behind the preset dictionary */
+  result = DEFLATE_OK;
+  position = 0;
+  do {
+    n = (int)size - position;
+    if (n > chunkSizeMax)
+      n = chunkSizeMax;
+    last = (position + n == (int)size) ? YES : NO;
+
+    chunk = (unsigned char *)data + position;
+    dictionarySize = MATCH_WINDOW_SIZE;
+    if (position == 0) {
+      dictionarySize = s->dictionarySize;
+      if (dictionarySize > 0) {
+        memcpy(s->window, s->dictionary, dictionarySize);
+        memcpy(s->window + dictionarySize, data, n);
+        chunk = s->window + dictionarySize;
+      }
+    }
+
+    if (deflateChunk(context, w, chunk - dictionarySize, dictionarySize, n, last) < 0)
+      result = DEFLATE_OUT_OF_MEMORY;
+
+    position += n;
+  } while (last == NO && result == DEFLATE_OK && w->full == NO);
+
+  if (result == DEFLATE_OK && w->full == NO) {
+    checksum = 0;
+    if (context->format == DEFLATE_FORMAT_ZLIB)
+      checksum = checksumAdler32(CHECKSUM_ADLER32_INIT, (unsigned char *)data, (int)size);
+    else if (context->format == DEFLATE_FORMAT_GZIP)
+      checksum = checksumCrc32(CHECKSUM_CRC32_INIT, (unsigned char *)data, (int)size);
+    deflateWriteTrailer(w, context->format, checksum, (uint64_t)size);
+
+    if (bitWriterFlush(w) == FAILED)
+      result = DEFLATE_OUT_OF_MEMORY;
+  }
+
+  if (result == DEFLATE_OK && w->full == YES) {
+    *outputSize = deflateBound(size);
+    result = DEFLATE_OUTPUT_FULL;
+  }
+  else if (result == DEFLATE_OK)
+    *outputSize = w->bufferN;
+
+  bitWriterSetBuffer(w, NULL, 0);
+
+  return result;
+}
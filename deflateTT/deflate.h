@@ -0,0 +1,73 @@
+
+#ifndef _DEFLATE_H
+#define _DEFLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* libdeflateTT is built using -fvisibility=hidden, only the functions marked with this are exported */
+#if defined(__GNUC__) && __GNUC__ >= 4
+#define DEFLATE_EXPORT __attribute__((visibility("default")))
+#else
+#define DEFLATE_EXPORT
+#endif
+
+/* the compression level used when none is given */
+#define DEFLATE_LEVEL_DEFAULT 6
+
+/* the optimal parsing level, --ultra */
+#define DEFLATE_LEVEL_ULTRA 10
+
+/* the output formats. the ones from DEFLATE_FORMAT_RAW on are standard RFC-1951 deflate, raw or in a zlib (RFC-1950) or a gzip (RFC-1952) wrapper */
+#define DEFLATE_FORMAT_DEFC 0
+#define DEFLATE_FORMAT_DEFD 1
+#define DEFLATE_FORMAT_RAW  2
+#define DEFLATE_FORMAT_ZLIB 3
+#define DEFLATE_FORMAT_GZIP 4
+
+/* deflate() takes at most 512MB at a time, and its output fits into deflateBound() bytes. it writes
+   right into the output, and returns DEFLATE_OUTPUT_FULL as soon as that is full */
+#define DEFLATE_SIZE_MAX       (512 << 20)
+#define DEFLATE_BOUND_OVERHEAD 1024
+
+struct deflateState;
+
+/* the deflate context. one context compresses one input at a time, so each thread needs a context
+   of its own. the context keeps its memory between the calls, and once it has compressed an input
+   as big as the next one, deflate() doesn't allocate anything */
+struct DeflateContext {
+  int level;
+  int format;
+
+  /* the results of the last call */
+  uint64_t matches;
+  uint64_t duplicateBytes;
+  uint64_t storedBytes;
+  int blocksN;
+
+  /* the match finder, the lz77 tokens, the blocks and the output, see main.h */
+  struct deflateState *state;
+};
+
+/* the return values */
+#define DEFLATE_OK            0
+#define DEFLATE_UNSUPPORTED   1
+#define DEFLATE_TOO_BIG       2
+#define DEFLATE_OUTPUT_FULL   3
+#define DEFLATE_OUT_OF_MEMORY 4
+
+DEFLATE_EXPORT int deflateContextInit(struct DeflateContext *context, int level, int format);
+DEFLATE_EXPORT int deflateContextSetDictionary(struct DeflateContext *context, const uint8_t *dictionary, int size);
+DEFLATE_EXPORT void deflateContextFree(struct DeflateContext *context);
+DEFLATE_EXPORT size_t deflateBound(size_t size);
+DEFLATE_EXPORT int deflate(const uint8_t *data, size_t size, uint8_t *output, size_t *outputSize, struct DeflateContext *context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
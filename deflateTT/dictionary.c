@@ -0,0 +1,163 @@
+
+/*
+ * deflateTT's preset dictionaries. A dictionary is raw data that both the
+ * compressor and the decompressor put into the window before the first byte
+ * of a file, so that even the first bytes of a small file can be coded as
+ * matches.
+ *
+ * dictionaryTrain() builds one from a set of sample files. The samples are
+ * cut into epochs, and from each epoch we take the segment whose 8-byte
+ * strings (dmers) occur in the most samples. The dmers of a taken segment
+ * don't count anymore, so the other segments bring in something new. The
+ * best segments go to the end of the dictionary, as close to the data as
+ * possible, where they are the cheapest to reach. This is a simplified
+ * version of the COVER algorithm by Liao, Petri, Moffat and Wirth.
+ *
+ * This code is under GNU General Public Licence (GPL), version 2, June 1991.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "defines.h"
+#include "match.h"
+#include "dictionary.h"
+#include "checksum.h"
+
+
+static int _hash_dmer(unsigned char *data) {
+
+  uint32_t h = 0;
+  int i;
+
+  for (i = 0; i < DICTIONARY_DMER_SIZE; i++)
+    h = (h << 5) + h + data[i];
+
+  return (int)(((h * 2654435761u) & 0xFFFFFFFF) >> (32 - DICTIONARY_HASH_BITS));
+}
+
+
+/* a dmer found in only one sample is worth nothing */
+static int _dmer_score(int *counts, unsigned char *data) {
+
+  int count = counts[_hash_dmer(data)];
+
+  return count > 1 ? count - 1 : 0;
+}
+
+
+static int _compare_segments(const void *a, const void *b) {
+
+  const struct dictionarySegment *s1 = a, *s2 = b;
+
+  if (s1->score != s2->score)
+    return s1->score < s2->score ? -1 : 1;
+
+  return s1->position - s2->position;
+}
+
+
+/* builds a dictionary from the samples that follow each other in samples[], returns the size of the dictionary or -1 */
+int dictionaryTrain(unsigned char *samples, int *sampleSizes, int samplesN, unsigned char *dictionary, int dictionarySizeMax) {
+
+  struct dictionarySegment *segments;
+  int *counts, *lastSample;
+  int i, j, p, s, end, total, epochStart, epochEnd, epochSize, score, segmentsN, segmentsMax, size;
+
+  total = 0;
+  for (i = 0; i < samplesN; i++)
+    total += sampleSizes[i];
+
+  segmentsMax = dictionarySizeMax / DICTIONARY_SEGMENT_SIZE;
+
+  counts = malloc(sizeof(int) * DICTIONARY_HASH_SIZE);
+  lastSample = malloc(sizeof(int) * DICTIONARY_HASH_SIZE);
+  segments = malloc(sizeof(struct dictionarySegment) * (segmentsMax + 1));
+  if (counts == NULL || lastSample == NULL || segments == NULL) {
+    free(counts);
+    free(lastSample);
+    free(segments);
+    return -1;
+  }
+
+  /* count in how many samples each dmer occurs */
+  for (i = 0; i < DICTIONARY_HASH_SIZE; i++) {
+    counts[i] = 0;
+    lastSample[i] = -1;
+  }
+
+  p = 0;
+  for (s = 0; s < samplesN; s++) {
+    end = p + sampleSizes[s];
+    for (; p + DICTIONARY_DMER_SIZE <= end; p++) {
+      i = _hash_dmer(samples + p);
+      if (lastSample[i] != s) {
+        lastSample[i] = s;
+        counts[i]++;
+      }
+    }
+    p = end;
+  }
+
+  /* take the best segment of each epoch */
+  epochSize = total / (segmentsMax > 0 ? segmentsMax : 1);
+  if (epochSize < DICTIONARY_SEGMENT_SIZE)
+    epochSize = DICTIONARY_SEGMENT_SIZE;
+
+  segmentsN = 0;
+  for (epochStart = 0; epochStart + DICTIONARY_SEGMENT_SIZE <= total && segmentsN < segmentsMax; epochStart += epochSize) {
+    epochEnd = epochStart + epochSize;
+    if (epochEnd > total - DICTIONARY_SEGMENT_SIZE + 1)
+      epochEnd = total - DICTIONARY_SEGMENT_SIZE + 1;
+
+    /* the score of the first segment, the rest are slid from it */
+    score = 0;
+    for (j = 0; j <= DICTIONARY_SEGMENT_SIZE - DICTIONARY_DMER_SIZE; j++)
+      score += _dmer_score(counts, samples + epochStart + j);
+
+    segments[segmentsN].position = epochStart;
+    segments[segmentsN].score = score;
+
+    for (p = epochStart + 1; p < epochEnd; p++) {
+      score -= _dmer_score(counts, samples + p - 1);
+      score += _dmer_score(counts, samples + p + DICTIONARY_SEGMENT_SIZE - DICTIONARY_DMER_SIZE);
+
+      if (score > segments[segmentsN].score) {
+        segments[segmentsN].position = p;
+        segments[segmentsN].score = score;
+      }
+    }
+
+    if (segments[segmentsN].score == 0)
+      continue;
+
+    /* the dmers we took are now covered */
+    p = segments[segmentsN].position;
+    for (j = 0; j <= DICTIONARY_SEGMENT_SIZE - DICTIONARY_DMER_SIZE; j++)
+      counts[_hash_dmer(samples + p + j)] = 0;
+
+    segmentsN++;
+  }
+
+  /* the best segments last */
+  qsort(segments, segmentsN, sizeof(struct dictionarySegment), _compare_segments);
+
+  size = 0;
+  for (i = 0; i < segmentsN; i++) {
+    memcpy(dictionary + size, samples + segments[i].position, DICTIONARY_SEGMENT_SIZE);
+    size += DICTIONARY_SEGMENT_SIZE;
+  }
+
+  free(counts);
+  free(lastSample);
+  free(segments);
+
+  return size;
+}
+
+
+/* the Adler-32 checksum of the dictionary, so that the decompressor can tell if it has the right one */
+uint32_t dictionaryId(unsigned char *data, int size) {
+
+  return checksumAdler32(CHECKSUM_ADLER32_INIT, data, size);
+}
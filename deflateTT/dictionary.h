@@ -0,0 +1,27 @@
+
+#ifndef _DICTIONARY_H
+#define _DICTIONARY_H
+
+#include <stdint.h>
+
+/* the dictionary fills at most the window, so every byte of it can be reached */
+#define DICTIONARY_SIZE_MAX MATCH_WINDOW_SIZE
+#define DICTIONARY_SIZE_MIN 256
+
+/* the trainer scores the segments by the 8-byte strings (dmers) they contain */
+#define DICTIONARY_DMER_SIZE    8
+#define DICTIONARY_SEGMENT_SIZE 64
+
+/* the dmers are counted in a hash table this big, collisions are just noise */
+#define DICTIONARY_HASH_BITS 20
+#define DICTIONARY_HASH_SIZE (1 << DICTIONARY_HASH_BITS)
+
+struct dictionarySegment {
+  int position;
+  int score;
+};
+
+int dictionaryTrain(unsigned char *samples, int *sampleSizes, int samplesN, unsigned char *dictionary, int dictionarySizeMax);
+uint32_t dictionaryId(unsigned char *data, int size);
+
+#endif
@@ -0,0 +1,156 @@
+
+/*
+ * deflateTT's Huffman code length builder, and the canonical code assignment
+ * described in RFC-1951 section 3.2.2.
+ *
+ * The code lengths are built using the package-merge algorithm, which gives
+ * the optimal code lengths under a length limit. Without a limit the codes
+ * of a skewed block can grow too long to be decoded using lookup tables.
+ *
+ * Programmed by Ville Helin <vhelin#iki.fi> in 2007.
+ *
+ * This code is under GNU General Public Licence (GPL), version 2, June 1991.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "defines.h"
+#include "huffman.h"
+
+
+struct leaf {
+  int weight;
+  int symbol;
+};
+
+
+static int _compare_leaves(const void *a, const void *b) {
+
+  const struct leaf *l1 = a, *l2 = b;
+
+  if (l1->weight != l2->weight)
+    return l1->weight < l2->weight ? -1 : 1;
+
+  /* keep the result the same on every platform */
+  return l1->symbol - l2->symbol;
+}
+
+
+void huffmanCodeLengths(int *frequencies, int n, int lengthMax, int *codeLengths) {
+
+  struct leaf leaves[HUFFMAN_SYMBOLS_MAX];
+  int weights[2][HUFFMAN_SYMBOLS_MAX*2];
+  unsigned char packaged[HUFFMAN_CODE_MAX_BITS][HUFFMAN_SYMBOLS_MAX*2];
+  int i, j, k, m, level, leavesN, itemsN, itemsMax, packagesN, *previous, *current;
+
+  for (i = 0; i < n; i++)
+    codeLengths[i] = 0;
+
+  /* collect the used symbols */
+  leavesN = 0;
+  for (i = 0; i < n; i++) {
+    if (frequencies[i] > 0) {
+      leaves[leavesN].weight = frequencies[i];
+      leaves[leavesN].symbol = i;
+      leavesN++;
+    }
+  }
+
+  /* a tree needs at least two leaves for the decoder, and e.g., a block without matches has no distances */
+  for (i = 0; i < n && leavesN < 2; i++) {
+    if (frequencies[i] == 0) {
+      leaves[leavesN].weight = 0;
+      leaves[leavesN].symbol = i;
+      leavesN++;
+    }
+  }
+
+  qsort(leaves, leavesN, sizeof(struct leaf), _compare_leaves);
+
+  /* package-merge: the deepest level holds the leaves only. every level above it
+     merges the leaves with the pairs (packages) of the level below it. we never
+     need more than the 2*leavesN - 2 cheapest items of a level */
+  itemsMax = 2*leavesN - 2;
+
+  previous = weights[0];
+  for (i = 0; i < leavesN; i++) {
+    previous[i] = leaves[i].weight;
+    packaged[0][i] = NO;
+  }
+  itemsN = leavesN;
+
+  for (level = 1; level < lengthMax; level++) {
+    current = weights[level & 1];
+    packagesN = itemsN >> 1;
+
+    i = 0;
+    j = 0;
+    k = 0;
+    while (k < itemsMax && (i < leavesN || j < packagesN)) {
+      if (j >= packagesN || (i < leavesN && leaves[i].weight <= previous[j*2] + previous[j*2 + 1])) {
+        current[k] = leaves[i++].weight;
+        packaged[level][k++] = NO;
+      }
+      else {
+        current[k] = previous[j*2] + previous[j*2 + 1];
+        packaged[level][k++] = YES;
+        j++;
+      }
+    }
+
+    itemsN = k;
+    previous = current;
+  }
+
+  /* walk back down: every leaf in the items we use makes its code one bit longer.
+     the leaves are merged in order, so the used ones are always the cheapest */
+  itemsN = itemsMax;
+  for (level = lengthMax - 1; level >= 0; level--) {
+    m = 0;
+    for (i = 0; i < itemsN; i++) {
+      if (packaged[level][i] == NO)
+        m++;
+    }
+
+    for (i = 0; i < m; i++)
+      codeLengths[leaves[i].symbol]++;
+
+    itemsN = (itemsN - m) << 1;
+  }
+}
+
+
+void huffmanCodes(int n, int *lengths, int *codes) {
+
+  int count[HUFFMAN_CODE_MAX_BITS+1], nextCode[HUFFMAN_CODE_MAX_BITS+1];
+  int i, code, bits, length;
+
+  /* for more information about this, see RFC-1951 section 3.2.2 */
+
+  /* step 1: count the lengths */
+  for (i = 0; i <= HUFFMAN_CODE_MAX_BITS; i++)
+    count[i] = 0;
+
+  for (i = 0; i < n; i++)
+    count[lengths[i]]++;
+
+  /* step 2: find the numerical value of the smallest code for each code length */
+  code = 0;
+  count[0] = 0;
+  for (bits = 1; bits <= HUFFMAN_CODE_MAX_BITS; bits++) {
+    code = (code + count[bits - 1]) << 1;
+    nextCode[bits] = code;
+  }
+
+  /* step 3: assign numerical values to all codes, using consecutive
+     values for all codes of the same length with the base
+     values determined at step 2. */
+  for (i = 0; i < n; i++) {
+    length = lengths[i];
+    if (length != 0) {
+      codes[i] = nextCode[length];
+      nextCode[length]++;
+    }
+  }
+}
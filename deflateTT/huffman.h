@@ -0,0 +1,16 @@
+#ifndef _HUFFMAN_H
+#define _HUFFMAN_H
+
+/* the number of bits we can have in a code */
+#define HUFFMAN_CODE_MAX_BITS 15
+
+/* the longest code length code */
+#define HUFFMAN_CODE_LENGTH_CODE_MAX_BITS 7
+
+/* the most symbols we can have in a tree */
+#define HUFFMAN_SYMBOLS_MAX 286
+
+void huffmanCodeLengths(int *frequencies, int n, int lengthMax, int *codeLengths);
+void huffmanCodes(int n, int *lengths, int *codes);
+
+#endif
@@ -0,0 +1,496 @@
+
+/*
+ * deflateTT's LZ77 parsers. They turn the input into literals and
+ * [length, distance] pairs, asking the match finder for the candidates.
+ *
+ * The greedy parser takes the longest match at each position. The lazy
+ * parsers first look at the next position (LZ77_PARSER_LAZY), or the next
+ * two (LZ77_PARSER_LAZY2), and if a better match starts there, they output
+ * a literal instead and move on.
+ *
+ * The optimal parser (LZ77_PARSER_OPTIMAL) finds the cheapest path through
+ * the data, pricing literals and matches with the code lengths of Huffman
+ * trees. The first parse uses fixed prices, then the trees are rebuilt from
+ * the parse's own frequencies and the data parsed again, until the output
+ * stops getting smaller.
+ *
+ * The parsed data is stored as tokens: the literals and the length symbols
+ * go into one array, and each match's distance symbol and extra bits are
+ * packed into one u32 in another, so a token costs 2 bytes, plus 4 for a
+ * match, instead of the 12 bytes per input byte of the old int array.
+ *
+ * The data before the start position is a dictionary (e.g., the end of the
+ * previous chunk): it's only fed to the match finder, so that the matches
+ * can reach back into it, but it's not parsed.
+ *
+ * This code is under GNU General Public Licence (GPL), version 2, June 1991.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "defines.h"
+#include "huffman.h"
+#include "match.h"
+#include "lz77.h"
+
+
+/* in deflate.c */
+extern const int deflateTTExtraBitsLengths[], deflateTTExtraBitsDistances[], deflateTTBaseValueLengths[], deflateTTBaseValueDistances[];
+
+/* length - 3 -> length code - 257 */
+static const unsigned char lengthSymbols[256] = {
+   0,  1,  2,  3,  4,  5,  6,  7,  8,  8,  9,  9, 10, 10, 11, 11,
+  12, 12, 12, 12, 13, 13, 13, 13, 14, 14, 14, 14, 15, 15, 15, 15,
+  16, 16, 16, 16, 16, 16, 16, 16, 17, 17, 17, 17, 17, 17, 17, 17,
+  18, 18, 18, 18, 18, 18, 18, 18, 19, 19, 19, 19, 19, 19, 19, 19,
+  20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20, 20,
+  21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21, 21,
+  22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22, 22,
+  23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23, 23,
+  24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+  24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+  25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25,
+  25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25,
+  26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
+  26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
+  27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27,
+  27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 28
+};
+
+/* distance - 1 -> distance code, the distances above 256 are looked up with (distance - 1) >> 7 from the second half */
+static const unsigned char distanceSymbols[512] = {
+   0,  1,  2,  3,  4,  4,  5,  5,  6,  6,  6,  6,  7,  7,  7,  7,
+   8,  8,  8,  8,  8,  8,  8,  8,  9,  9,  9,  9,  9,  9,  9,  9,
+  10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10, 10,
+  11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11, 11,
+  12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+  12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12, 12,
+  13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13,
+  13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13,
+  14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+  14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+  14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+  14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14, 14,
+  15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+  15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+  15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+  15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15, 15,
+   0,  0, 16, 17, 18, 18, 19, 19, 20, 20, 20, 20, 21, 21, 21, 21,
+  22, 22, 22, 22, 22, 22, 22, 22, 23, 23, 23, 23, 23, 23, 23, 23,
+  24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24, 24,
+  25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25, 25,
+  26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
+  26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26, 26,
+  27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27,
+  27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27, 27,
+  28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+  28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+  28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+  28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+  29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29,
+  29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29,
+  29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29,
+  29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29, 29
+};
+
+
+static int _highest_bit(int n) {
+
+  int bit = 0;
+
+  while (n > 1) {
+    n >>= 1;
+    bit++;
+  }
+
+  return bit;
+}
+
+
+/* a rough estimate of what a match saves, longer matches save more and far away ones cost more */
+static int _gain(struct match *match) {
+
+  return match->length * 4 - _highest_bit(match->distance + 1);
+}
+
+
+int lz77TokensInit(struct lz77Tokens *t, int dataSize) {
+
+  /* every token covers at least one byte, and every match at least three */
+  t->symbols = malloc(sizeof(uint16_t) * (dataSize + 1));
+  t->matches = malloc(sizeof(uint32_t) * (dataSize / MATCH_LENGTH_MIN + 1));
+  t->symbolsN = 0;
+  t->matchesN = 0;
+  t->size = dataSize;
+  t->costs = NULL;
+  t->lengths = NULL;
+  t->distances = NULL;
+
+  if (t->symbols == NULL || t->matches == NULL) {
+    lz77TokensFree(t);
+    return FAILED;
+  }
+
+  return SUCCEEDED;
+}
+
+
+void lz77TokensFree(struct lz77Tokens *t) {
+
+  free(t->symbols);
+  free(t->matches);
+  free(t->costs);
+  free(t->lengths);
+  free(t->distances);
+
+  t->symbols = NULL;
+  t->matches = NULL;
+  t->costs = NULL;
+  t->lengths = NULL;
+  t->distances = NULL;
+}
+
+
+static void _literal(struct lz77Tokens *t, int literal) {
+
+  t->symbols[t->symbolsN++] = literal;
+}
+
+
+static void _match(struct lz77Tokens *t, int length, int distance) {
+
+  int lengthSymbol, distanceSymbol;
+
+  lengthSymbol = lz77LengthSymbol(length);
+  distanceSymbol = lz77DistanceSymbol(distance);
+
+  t->symbols[t->symbolsN++] = lengthSymbol;
+  t->matches[t->matchesN++] = LZ77_MATCH_PACK(distanceSymbol, length - deflateTTBaseValueLengths[lengthSymbol - 257], distance - deflateTTBaseValueDistances[distanceSymbol]);
+}
+
+
+/* greedy and lazy parsing */
+static int _parse(struct matchFinder *mf, int parser, int lazyLength, struct lz77Tokens *t, struct lz77Stats *stats) {
+
+  struct match match, next;
+  unsigned char *data = mf->data;
+  int i, dataSize = mf->dataSize;
+
+  stats->matches = 0;
+  stats->duplicateBytes = 0;
+
+  i = mf->position;
+  t->symbolsN = 0;
+  t->matchesN = 0;
+
+  /* find the longest match for the first position */
+  if (i < dataSize)
+    matchFinderFind(mf, &match);
+
+  while (i < dataSize) {
+    if (match.length >= MATCH_LENGTH_MIN && parser != LZ77_PARSER_GREEDY && match.length < lazyLength && i + 1 < dataSize) {
+      /* is there a better match at the next position? */
+      matchFinderFind(mf, &next);
+
+      if (next.length >= MATCH_LENGTH_MIN && _gain(&next) > _gain(&match) + 4) {
+        _literal(t, data[i]);
+        match = next;
+        i++;
+        continue;
+      }
+
+      /* ... or at the one after that? */
+      if (parser == LZ77_PARSER_LAZY2 && i + 2 < dataSize) {
+        matchFinderFind(mf, &next);
+
+        if (next.length >= MATCH_LENGTH_MIN && _gain(&next) > _gain(&match) + 7) {
+          _literal(t, data[i]);
+          _literal(t, data[i + 1]);
+          match = next;
+          i += 2;
+          continue;
+        }
+      }
+    }
+
+    if (match.length >= MATCH_LENGTH_MIN) {
+      /* we found a good match -> store */
+      _match(t, match.length, match.distance);
+
+      /* count statistics */
+      stats->matches++;
+      stats->duplicateBytes += match.length;
+
+      /* move to pointer over the copied area, some of which we might have searched already */
+      i += match.length;
+      matchFinderSkip(mf, i - mf->position);
+    }
+    else {
+      /* just output the data byte */
+      _literal(t, data[i]);
+      i++;
+    }
+
+    /* find the longest match for the next position */
+    if (i < dataSize)
+      matchFinderFind(mf, &match);
+  }
+
+  return t->symbolsN;
+}
+
+
+int lz77LengthSymbol(int length) {
+
+  return 257 + lengthSymbols[length - MATCH_LENGTH_MIN];
+}
+
+
+int lz77DistanceSymbol(int distance) {
+
+  distance--;
+  if (distance < 256)
+    return distanceSymbols[distance];
+
+  return distanceSymbols[256 + (distance >> 7)];
+}
+
+
+static void _prices(int *codeLengths, int n, int *prices) {
+
+  int i, unused;
+
+  /* the symbols that weren't used last time still need a price, make it a bit higher than any other */
+  unused = 0;
+  for (i = 0; i < n; i++) {
+    if (unused < codeLengths[i])
+      unused = codeLengths[i];
+  }
+  unused++;
+
+  for (i = 0; i < n; i++) {
+    if (codeLengths[i] == 0)
+      prices[i] = unused;
+    else
+      prices[i] = codeLengths[i];
+  }
+}
+
+
+/* finds the cheapest parse with the given code lengths, from the match finder's position onwards */
+static int _parse_optimal(struct matchFinder *mf, int *codeLengthLiterals, int *codeLengthDistances, struct lz77Tokens *t, struct lz77Stats *stats,
+                          int64_t *costs, unsigned short *lengths, unsigned short *distances) {
+
+  struct match matches[MATCH_CANDIDATES_MAX];
+  int pricesLiterals[286], pricesDistances[30], pricesLengths[MATCH_LENGTH_MAX + 1];
+  int64_t cost, price;
+  int i, j, n, l, symbol, dataSize = mf->dataSize - mf->position;
+  unsigned char *data = mf->data + mf->position;
+
+  _prices(codeLengthLiterals, 286, pricesLiterals);
+  _prices(codeLengthDistances, 30, pricesDistances);
+
+  for (i = 0; i < 30; i++)
+    pricesDistances[i] += deflateTTExtraBitsDistances[i];
+  for (i = MATCH_LENGTH_MIN; i <= MATCH_LENGTH_MAX; i++) {
+    symbol = lz77LengthSymbol(i);
+    pricesLengths[i] = pricesLiterals[symbol] + deflateTTExtraBitsLengths[symbol - 257];
+  }
+
+  costs[0] = 0;
+  for (i = 1; i <= dataSize; i++)
+    costs[i] = INT64_MAX;
+
+  /* find the cheapest way to get to each position */
+  for (i = 0; i < dataSize; i++) {
+    cost = costs[i];
+    n = matchFinderFindAll(mf, matches);
+
+    /* a literal */
+    price = cost + pricesLiterals[data[i]];
+    if (price < costs[i + 1]) {
+      costs[i + 1] = price;
+      lengths[i + 1] = 1;
+      distances[i + 1] = 0;
+    }
+
+    /* the matches, each match also covers the lengths the previous one couldn't reach */
+    l = MATCH_LENGTH_MIN;
+    for (j = 0; j < n; j++) {
+      price = cost + pricesDistances[lz77DistanceSymbol(matches[j].distance)];
+      for ( ; l <= matches[j].length; l++) {
+        if (price + pricesLengths[l] < costs[i + l]) {
+          costs[i + l] = price + pricesLengths[l];
+          lengths[i + l] = l;
+          distances[i + l] = matches[j].distance;
+        }
+      }
+    }
+
+    /* a match this long is taken as it is, searching inside it would be slow and hardly pays off */
+    if (n > 0 && matches[n - 1].length >= mf->niceLength) {
+      matchFinderSkip(mf, matches[n - 1].length - 1);
+      i += matches[n - 1].length - 1;
+    }
+  }
+
+  /* count the tokens on the cheapest path, walking backwards */
+  t->symbolsN = 0;
+  t->matchesN = 0;
+  for (i = dataSize; i > 0; i -= lengths[i]) {
+    t->symbolsN++;
+    if (lengths[i] > 1)
+      t->matchesN++;
+  }
+
+  stats->matches = t->matchesN;
+  stats->duplicateBytes = 0;
+
+  /* ... and store them */
+  j = t->symbolsN;
+  n = t->matchesN;
+  for (i = dataSize; i > 0; i -= lengths[i]) {
+    if (lengths[i] == 1)
+      t->symbols[--j] = data[i - 1];
+    else {
+      symbol = lz77LengthSymbol(lengths[i]);
+      l = lz77DistanceSymbol(distances[i]);
+      t->symbols[--j] = symbol;
+      t->matches[--n] = LZ77_MATCH_PACK(l, lengths[i] - deflateTTBaseValueLengths[symbol - 257], distances[i] - deflateTTBaseValueDistances[l]);
+
+      stats->duplicateBytes += lengths[i];
+    }
+  }
+
+  return t->symbolsN;
+}
+
+
+/* the size of the parse in bits, when it's coded using the trees built from its own frequencies */
+static int64_t _parse_bits(struct lz77Tokens *t, int *codeLengthLiterals, int *codeLengthDistances) {
+
+  int freqLiterals[286], freqDistances[30];
+  int64_t bits;
+  int i;
+
+  for (i = 0; i < 286; i++)
+    freqLiterals[i] = 0;
+  for (i = 0; i < 30; i++)
+    freqDistances[i] = 0;
+
+  /* the end marker */
+  freqLiterals[256] = 1;
+
+  for (i = 0; i < t->symbolsN; i++)
+    freqLiterals[t->symbols[i]]++;
+  for (i = 0; i < t->matchesN; i++)
+    freqDistances[LZ77_MATCH_DISTANCE_SYMBOL(t->matches[i])]++;
+
+  huffmanCodeLengths(freqLiterals, 286, HUFFMAN_CODE_MAX_BITS, codeLengthLiterals);
+  huffmanCodeLengths(freqDistances, 30, HUFFMAN_CODE_MAX_BITS, codeLengthDistances);
+
+  bits = 0;
+  for (i = 0; i < 286; i++)
+    bits += (int64_t)freqLiterals[i] * codeLengthLiterals[i];
+  for (i = 0; i < 29; i++)
+    bits += (int64_t)freqLiterals[257 + i] * deflateTTExtraBitsLengths[i];
+  for (i = 0; i < 30; i++)
+    bits += (int64_t)freqDistances[i] * (codeLengthDistances[i] + deflateTTExtraBitsDistances[i]);
+
+  return bits;
+}
+
+
+/* optimal parsing */
+static int _optimal(struct matchFinder *mf, int start, int iterations, struct lz77Tokens *t, struct lz77Stats *stats) {
+
+  int codeLengthLiterals[286], codeLengthDistances[30], bestLengthLiterals[286], bestLengthDistances[30], nextLengthLiterals[286], nextLengthDistances[30];
+  int i, iteration, parseIsBest;
+  int64_t bits, bitsBest, *costs;
+  unsigned short *lengths, *distances;
+
+  /* the parse covers at most t->size bytes, the buffers are kept for the next parses */
+  if (t->costs == NULL) {
+    t->costs = malloc(sizeof(int64_t) * (t->size + 1));
+    t->lengths = malloc(sizeof(unsigned short) * (t->size + 1));
+    t->distances = malloc(sizeof(unsigned short) * (t->size + 1));
+    if (t->costs == NULL || t->lengths == NULL || t->distances == NULL) {
+      free(t->costs);
+      free(t->lengths);
+      free(t->distances);
+      t->costs = NULL;
+      t->lengths = NULL;
+      t->distances = NULL;
+      return -1;
+    }
+  }
+
+  costs = t->costs;
+  lengths = t->lengths;
+  distances = t->distances;
+
+  /* the first parse uses the code lengths of RFC-1951's fixed Huffman codes */
+  for (i = 0; i < 286; i++) {
+    if (i < 144)
+      codeLengthLiterals[i] = 8;
+    else if (i < 256)
+      codeLengthLiterals[i] = 9;
+    else if (i < 280)
+      codeLengthLiterals[i] = 7;
+    else
+      codeLengthLiterals[i] = 8;
+  }
+  for (i = 0; i < 30; i++)
+    codeLengthDistances[i] = 5;
+
+  bitsBest = INT64_MAX;
+  parseIsBest = NO;
+
+  for (iteration = 0; iteration < iterations; iteration++) {
+    matchFinderReset(mf, mf->data, mf->dataSize);
+    matchFinderSkip(mf, start);
+    _parse_optimal(mf, codeLengthLiterals, codeLengthDistances, t, stats, costs, lengths, distances);
+    bits = _parse_bits(t, nextLengthLiterals, nextLengthDistances);
+
+    /* did the parse stop getting smaller? */
+    if (bits >= bitsBest) {
+      parseIsBest = NO;
+      break;
+    }
+
+    bitsBest = bits;
+    parseIsBest = YES;
+
+    for (i = 0; i < 286; i++) {
+      bestLengthLiterals[i] = codeLengthLiterals[i];
+      codeLengthLiterals[i] = nextLengthLiterals[i];
+    }
+    for (i = 0; i < 30; i++) {
+      bestLengthDistances[i] = codeLengthDistances[i];
+      codeLengthDistances[i] = nextLengthDistances[i];
+    }
+  }
+
+  /* the last parse wasn't the best one -> redo the best */
+  if (parseIsBest == NO) {
+    matchFinderReset(mf, mf->data, mf->dataSize);
+    matchFinderSkip(mf, start);
+    _parse_optimal(mf, bestLengthLiterals, bestLengthDistances, t, stats, costs, lengths, distances);
+  }
+
+  return t->symbolsN;
+}
+
+
+/* parses the match finder's data from start to the end, the match finder must have been reset */
+int lz77Parse(struct matchFinder *mf, int start, int parser, int lazyLength, int iterations, struct lz77Tokens *t, struct lz77Stats *stats) {
+
+  if (parser == LZ77_PARSER_OPTIMAL)
+    return _optimal(mf, start, iterations, t, stats);
+
+  /* the dictionary only goes into the chains/trees */
+  matchFinderSkip(mf, start);
+
+  return _parse(mf, parser, lazyLength, t, stats);
+}
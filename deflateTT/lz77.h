@@ -0,0 +1,45 @@
+#ifndef _LZ77_H
+#define _LZ77_H
+
+#include <stdint.h>
+
+/* the parsers */
+#define LZ77_PARSER_GREEDY 0
+#define LZ77_PARSER_LAZY   1
+#define LZ77_PARSER_LAZY2  2
+#define LZ77_PARSER_OPTIMAL 3
+
+/* a match is packed into one u32: the distance symbol, the length's extra bits and the distance's extra bits */
+#define LZ77_MATCH_PACK(distanceSymbol, lengthExtra, distanceExtra) ((uint32_t)(distanceSymbol) | ((uint32_t)(lengthExtra) << 5) | ((uint32_t)(distanceExtra) << 10))
+#define LZ77_MATCH_DISTANCE_SYMBOL(match) ((match) & 0x1F)
+#define LZ77_MATCH_LENGTH_EXTRA(match)    (((match) >> 5) & 0x1F)
+#define LZ77_MATCH_DISTANCE_EXTRA(match)  ((match) >> 10)
+
+/* the parsed data: symbols[] has the literals (0-255) and the length symbols (257-285),
+   and matches[] has a packed match for each length symbol, in the same order */
+struct lz77Tokens {
+  uint16_t *symbols;
+  uint32_t *matches;
+  int symbolsN;
+  int matchesN;
+  /* the most bytes a parse can cover */
+  int size;
+  /* the optimal parser's memory, allocated on its first use. the costs are in bits, and a 256MB DEFc
+     parse can cost more than 2^31 of them */
+  int64_t *costs;
+  unsigned short *lengths;
+  unsigned short *distances;
+};
+
+struct lz77Stats {
+  int matches;
+  int duplicateBytes;
+};
+
+int lz77TokensInit(struct lz77Tokens *t, int dataSize);
+void lz77TokensFree(struct lz77Tokens *t);
+int lz77Parse(struct matchFinder *mf, int start, int parser, int lazyLength, int iterations, struct lz77Tokens *t, struct lz77Stats *stats);
+int lz77LengthSymbol(int length);
+int lz77DistanceSymbol(int distance);
+
+#endif
@@ -5,786 +5,1033 @@
  * Specification version 1.3), only the header is different. I was too lazy
  * to implement them the standard way.
  *
+ * --format=raw, zlib and gzip write the standard way, so that e.g., zlib
+ * and gzip can decompress the output.
+ *
+ * The compression itself is in deflate.c, which is also built into
+ * libdeflateTT (make lib) for programs that compress in memory.
+ *
  * Programmed by Ville Helin <vhelin#iki.fi> in 2007.
  *
  * This code is under GNU General Public Licence (GPL), version 2, June 1991.
  */
 
+/* for pthreads */
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include "defines.h"
+#include "huffman.h"
+#include "match.h"
+#include "lz77.h"
+#include "stats.h"
+#include "block.h"
+#include "bitwriter.h"
+#include "dictionary.h"
+#include "tables.h"
+#include "checksum.h"
+#include "deflate.h"
 #include "main.h"
 
 
-/* the huffman frequencies */
-int freqLiterals[286];
-int freqDistances[30];
-int freqCombined[119];
-
-/* code lengths */
-int codeLengthLiterals[286];
-int codeLengthDistances[30];
-int codeLengthCombined[119];
-int codeLengths[286+30];
-
-/* codes */
-int codeLiterals[286];
-int codeDistances[30];
-int codeCombined[119];
-
-/* the huffman trees */
-struct node *treeLiterals = NULL;
-struct node *treeDistances = NULL;
-struct node *treeCombined = NULL;
-
-/* the priority node queue */
-struct node *priorityQueue = NULL;
-
-/* the number of extra bits in the compressed data */
-const int extraBitsLengths[] = {
-  0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
-  1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
-  4, 4, 4, 4, 5, 5, 5, 5, 0
-};
-const int extraBitsDistances[] = {
-  0, 0, 0, 0, 1, 1, 2, 2, 3, 3,
-  4, 4, 5, 5, 6, 6, 7, 7, 8, 8,
-  9, 9, 10, 10, 11, 11, 12, 12, 13, 13
-};
-
-/* limits for length encoding */
-const int extraBitsLimitsLength[] = {
-  11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
-};
-
-/* limits for distance encoding */
-const int extraBitsLimitsDistance[] = {
-  5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577, 32769
-};
-
-
-static void _write_u32(FILE *f, int data) {
-
-  fprintf(f, "%c%c%c%c", data & 0xFF, (data >> 8) & 0xFF, (data >> 16) & 0xFF, (data >> 24) & 0xFF);
-}
+/* reads until the buffer is full or the input ends, returns the number of bytes read or -1 */
+static int _read_chunk(FILE *f, unsigned char *data, int size) {
 
+  int n, i = 0;
 
-static void _write_u8(FILE *f, int data) {
+  while (i < size) {
+    n = fread(data + i, 1, size - i, f);
+    if (n == 0)
+      break;
+    i += n;
+  }
+
+  if (ferror(f)) {
+    fprintf(stderr, "_read_chunk(): Could not read the input.\n");
+    return -1;
+  }
 
-  fprintf(f, "%c", data & 0xFF);
+  return i;
 }
 
 
-static void _write_bits(FILE *f, int *outBitsN, int *outBits, int code, int codeLength) {
+/* reads a dictionary file, the bytes beyond DICTIONARY_SIZE_MAX from the end can't be reached and are dropped */
+static int _load_dictionary(char *name, unsigned char **data, int *size) {
 
-  int i;
+  long fileSize;
+  FILE *f;
 
-  for (i = 0; i < codeLength; i++) {
-    *outBits = (*outBits << 1) | ((code >> (codeLength - i - 1)) & 1);
-    *outBitsN += 1;
+  f = fopen(name, "rb");
+  if (f == NULL) {
+    fprintf(stderr, "_load_dictionary(): Could not open file \"%s\" for reading.\n", name);
+    return FAILED;
+  }
 
-    if (*outBitsN == 8) {
-      _write_u8(f, *outBits);
-      *outBits = 0;
-      *outBitsN = 0;
-    }
+  fseek(f, 0, SEEK_END);
+  fileSize = ftell(f);
+
+  if (fileSize <= 0) {
+    fprintf(stderr, "_load_dictionary(): Dictionary \"%s\" is empty.\n", name);
+    fclose(f);
+    return FAILED;
   }
+
+  if (fileSize > DICTIONARY_SIZE_MAX) {
+    fseek(f, fileSize - DICTIONARY_SIZE_MAX, SEEK_SET);
+    fileSize = DICTIONARY_SIZE_MAX;
+  }
+  else
+    fseek(f, 0, SEEK_SET);
+
+  *size = (int)fileSize;
+  *data = malloc(*size);
+  if (*data == NULL) {
+    fprintf(stderr, "_load_dictionary(): Out of memory error.\n");
+    fclose(f);
+    return FAILED;
+  }
+
+  if (fread(*data, 1, *size, f) != (size_t)*size) {
+    fprintf(stderr, "_load_dictionary(): Could not read file \"%s\".\n", name);
+    fclose(f);
+    free(*data);
+    return FAILED;
+  }
+
+  fclose(f);
+
+  return SUCCEEDED;
 }
 
 
-/*
-  Extra               Extra               Extra
-  Code Bits Length(s) Code Bits Lengths   Code Bits Length(s)
-  ---- ---- ------     ---- ---- -------   ---- ---- -------
-  257   0     3       267   1   15,16     277   4   67-82
-  258   0     4       268   1   17,18     278   4   83-98
-  259   0     5       269   2   19-22     279   4   99-114
-  260   0     6       270   2   23-26     280   4  115-130
-  261   0     7       271   2   27-30     281   5  131-162
-  262   0     8       272   2   31-34     282   5  163-194
-  263   0     9       273   3   35-42     283   5  195-226
-  264   0    10       274   3   43-50     284   5  227-257
-  265   1  11,12      275   3   51-58     285   0    258
-  266   1  13,14      276   3   59-66
-
-  Extra           Extra               Extra
-  Code Bits Dist  Code Bits   Dist     Code Bits Distance
-  ---- ---- ----  ---- ----  ------    ---- ---- --------
-  0   0    1     10   4     33-48    20    9   1025-1536
-  1   0    2     11   4     49-64    21    9   1537-2048
-  2   0    3     12   5     65-96    22   10   2049-3072
-  3   0    4     13   5     97-128   23   10   3073-4096
-  4   1   5,6    14   6    129-192   24   11   4097-6144
-  5   1   7,8    15   6    193-256   25   11   6145-8192
-  6   2   9-12   16   7    257-384   26   12  8193-12288
-  7   2  13-16   17   7    385-512   27   12 12289-16384
-  8   3  17-24   18   8    513-768   28   13 16385-24576
-  9   3  25-32   19   8   769-1024   29   13 24577-32768
-*/
-
-
-void priorityQueuePush(struct node *node) {
-
-  struct node *queue = priorityQueue;
-
-  node->smaller = NULL;
-  node->larger = NULL;
-
-  if (queue == NULL) {
-    priorityQueue = node;
-    return;
+/* deflateTTLevels[] are in deflate.c */
+extern const struct level deflateTTLevels[];
+
+
+static void *_deflate_job(void *argument) {
+
+  struct chunkJob *job = argument;
+
+  bitWriterReset(&job->writer);
+
+  job->context.matches = 0;
+  job->context.duplicateBytes = 0;
+  job->context.storedBytes = 0;
+  job->context.blocksN = 0;
+  statsClear(&job->context.state->stats);
+  job->blocksN = deflateChunk(&job->context, &job->writer, job->data, job->dictionarySize, job->chunkSize, job->last);
+
+  return NULL;
+}
+
+
+static int _job_init(struct chunkJob *job, int level, int format, int chunkSizeMax) {
+
+  job->buffer = malloc(MATCH_WINDOW_SIZE + chunkSizeMax);
+  if (job->buffer == NULL) {
+    fprintf(stderr, "_job_init(): Out of memory error.\n");
+    return FAILED;
   }
 
-  while (1) {
-    if (node->weight > queue->weight) {
-      if (queue->larger != NULL)
-        queue = queue->larger;
-      else {
-        queue->larger = node;
-        node->smaller = queue;
-        return;
-      }
-    }
-    else {
-      node->smaller = queue->smaller;
-      node->larger = queue;
-      if (queue->smaller != NULL)
-        queue->smaller->larger = node;
-      queue->smaller = node;
+  /* libdeflateTT doesn't print anything, the errors are ours to report */
+  if (deflateContextInit(&job->context, level, format) != DEFLATE_OK || bitWriterInit(&job->writer, NULL) == FAILED) {
+    fprintf(stderr, "_job_init(): Out of memory error.\n");
+    return FAILED;
+  }
+  if (format >= DEFLATE_FORMAT_RAW)
+    bitWriterSetOrder(&job->writer, BIT_WRITER_LSB_FIRST);
+
+  return SUCCEEDED;
+}
 
-      if (queue == priorityQueue)
-        priorityQueue = node;
 
-      return;
-    }
+static void _job_free(struct chunkJob *job) {
+
+  free(job->buffer);
+  deflateContextFree(&job->context);
+  bitWriterFree(&job->writer);
+}
+
+
+/* returns the DEFd size flags of the input, and its size if it has one. pipes don't have one */
+static int _input_size(FILE *f, uint64_t *size) {
+
+  long n = -1;
+
+  if (fseek(f, 0, SEEK_END) == 0) {
+    n = ftell(f);
+    if (fseek(f, 0, SEEK_SET) != 0)
+      n = -1;
   }
+
+  *size = 0;
+  if (n < 0)
+    return DEFD_FLAG_SIZE_UNKNOWN;
+
+  *size = (uint64_t)n;
+  if (*size > 0xFFFFFFFFul)
+    return DEFD_FLAG_SIZE_64;
+
+  return 0;
 }
 
 
-struct node *priorityQueuePop(void) {
+/* maps the input into memory so that it can be compressed without copying it, returns NULL if it can't be
+   mapped, e.g., it's a pipe or it's empty. such an input is read a chunk at a time instead */
+static unsigned char *_map_input(FILE *f, int flags, uint64_t size) {
 
-  struct node *node = priorityQueue;
+  void *mapped;
+
+  if (flags == DEFD_FLAG_SIZE_UNKNOWN || size == 0 || (uint64_t)(size_t)size != size)
+    return NULL;
 
-  if (node == NULL)
+  mapped = mmap(NULL, (size_t)size, PROT_READ, MAP_PRIVATE, fileno(f), 0);
+  if (mapped == MAP_FAILED)
     return NULL;
 
-  priorityQueue = node->larger;
-  if (priorityQueue != NULL)
-    priorityQueue->smaller = NULL;
+  /* the chunks are compressed in order */
+  posix_madvise(mapped, (size_t)size, POSIX_MADV_SEQUENTIAL);
 
-  return node;
+  return mapped;
 }
 
 
-void propagateCodes(struct node *node, int code, int codeLength) {
+/* faults in the pages of a mapped chunk, so that reading the file is done (and timed) here, and not
+   in the middle of compressing it. only --stats needs this, otherwise the threads fault the pages in */
+static void _fault_in(unsigned char *data, int size) {
 
-  if (node->leaf == YES) {
-    node->code = code;
-    node->codeLength = codeLength;
+  volatile unsigned char *page = data;
+  long pageSize;
+  int i;
+
+  if (size <= 0)
     return;
-  }
 
-  if (node->left != NULL)
-    propagateCodes(node->left, (code << 1) | 1, codeLength + 1);
-  if (node->right != NULL)
-    propagateCodes(node->right, (code << 1) | 0, codeLength + 1);
+  pageSize = sysconf(_SC_PAGESIZE);
+  if (pageSize <= 0)
+    pageSize = 4096;
+
+  posix_madvise(data, (size_t)size, POSIX_MADV_WILLNEED);
+
+  /* the reads are volatile, so they aren't optimized away */
+  for (i = 0; i < size; i += (int)pageSize)
+    (void)page[i];
+  (void)page[size - 1];
 }
 
 
-void huffmanGrowTree(int *frequencies, int n, struct node **tree, int *codeLengths, int *codes) {
+static void _unmap_input(unsigned char *mapped, uint64_t size) {
 
-  struct node *nodes, *node1, *node2, *node;
-  int i;
+  if (mapped != NULL)
+    munmap(mapped, (size_t)size);
+}
 
-  /* init the nodes */
-  nodes = malloc(sizeof(struct node) * n);
-  if (nodes == NULL) {
-    fprintf(stderr, "huffmanGrowTree(): Out of memory error [1].\n");
-    return;
-  }
 
-  for (i = 0; i < n; i++) {
-    nodes[i].left = NULL;
-    nodes[i].right = NULL;
-    nodes[i].literal = i;
-    nodes[i].weight = frequencies[i];
-    nodes[i].leaf = YES;
-    nodes[i].code = 0;
-    nodes[i].codeLength = 0;
-  }
+/* compresses the input into w, header included, and adds the results to the totals. the input is read
+   from fIn, unless it's mapped. a mapped input is read ahead of the threads only if --stats prints the
+   time it takes */
+static int _deflate_file(struct bitWriter *w, FILE *fIn, unsigned char *mapped, uint64_t inputSize, int flags, struct chunkJob *jobs, int threads, int format,
+                         int chunkSizeMax, unsigned char *dictionary, int dictionarySize, int print, struct deflateTotals *totals) {
 
-  /* push the nodes into a priority queue */
-  priorityQueue = NULL;
+  pthread_t threadIds[THREADS_MAX];
+  int threadStarted[THREADS_MAX];
+  struct chunkJob *job, *previous;
+  uint64_t readSize;
+  uint32_t adler, crc;
+  double time;
+  int i, n, last, jobsN;
 
-  for (i = 0; i < n; i++) {
-    if (nodes[i].weight > 0)
-      priorityQueuePush(&nodes[i]);
-  }
+  deflateWriteHeader(w, format, flags, inputSize, jobs[0].context.level, dictionary, dictionarySize);
 
-  /* DEBUG */
-  /*
-    {
-    struct node *node = priorityQueue;
+  adler = CHECKSUM_ADLER32_INIT;
+  crc = CHECKSUM_CRC32_INIT;
 
-    while (node != NULL) {
-    fprintf(stderr, "%d ", node->weight);
-    node = node->larger;
-    }
-    }
-  */
+  /********************************************************************************/
+  /* CHUNKS */
+  /********************************************************************************/
 
-  /* create a tree */
-  while (1) {
-    /* pop the two rarest nodes */
-    node1 = priorityQueuePop();
-    node2 = priorityQueuePop();
+  readSize = 0;
+  previous = NULL;
+  last = NO;
+
+  /* the output doesn't depend on the number of threads, as every chunk is compressed on its own,
+     using only the data, and the chunks are written out in order */
+  while (last == NO) {
+    /* read the next batch of chunks */
+    for (jobsN = 0; jobsN < threads && last == NO; jobsN++) {
+      job = &jobs[jobsN];
+
+      if (mapped != NULL) {
+        /* a mapped input is compressed where it is, the 32K before a chunk are its dictionary */
+        job->dictionarySize = (readSize == 0) ? dictionarySize : MATCH_WINDOW_SIZE;
+        job->chunkSize = chunkSizeMax;
+        if (inputSize - readSize < (uint64_t)chunkSizeMax)
+          job->chunkSize = (int)(inputSize - readSize);
+        job->data = mapped + readSize - job->dictionarySize;
+
+        if (print != STATS_PRINT_NONE) {
+          time = statsNow();
+          _fault_in(mapped + readSize, job->chunkSize);
+          totals->stats.phases[STATS_READ] += statsNow() - time;
+        }
 
-    if (node2 == NULL) {
-      /* the tree has been built */
-      *tree = node1;
-      break;
+        /* only the first chunk is copied, behind the preset dictionary */
+        if (readSize == 0 && dictionarySize > 0) {
+          job->data = job->buffer;
+          memcpy(job->data, dictionary, dictionarySize);
+          memcpy(job->data + dictionarySize, mapped, job->chunkSize);
+        }
+
+        readSize += job->chunkSize;
+        last = (readSize == inputSize) ? YES : NO;
+      }
+      else {
+        job->data = job->buffer;
+
+        /* the end of the previous chunk is the dictionary of this one, the previous job can be this one */
+        if (previous != NULL) {
+          memmove(job->data, previous->data + previous->dictionarySize + previous->chunkSize - MATCH_WINDOW_SIZE, MATCH_WINDOW_SIZE);
+          job->dictionarySize = MATCH_WINDOW_SIZE;
+        }
+        else {
+          /* the first chunk starts with the preset dictionary, if there is one */
+          if (dictionarySize > 0)
+            memcpy(job->data, dictionary, dictionarySize);
+          job->dictionarySize = dictionarySize;
+        }
+
+        time = statsNow();
+        job->chunkSize = _read_chunk(fIn, job->data + job->dictionarySize, chunkSizeMax);
+        totals->stats.phases[STATS_READ] += statsNow() - time;
+        if (job->chunkSize < 0)
+          return FAILED;
+
+        readSize += job->chunkSize;
+
+        /* is there more to come? */
+        last = YES;
+        if (job->chunkSize == chunkSizeMax) {
+          n = getc(fIn);
+          if (n != EOF) {
+            ungetc(n, fIn);
+            last = NO;
+          }
+        }
+      }
+
+      if (format == DEFLATE_FORMAT_ZLIB)
+        adler = checksumAdler32(adler, job->data + job->dictionarySize, job->chunkSize);
+      else if (format == DEFLATE_FORMAT_GZIP)
+        crc = checksumCrc32(crc, job->data + job->dictionarySize, job->chunkSize);
+
+      job->last = last;
+      previous = job;
     }
 
-    /* create a parent node */
-    node = malloc(sizeof(struct node));
-    if (node == NULL) {
-      fprintf(stderr, "huffmanGrowTree(): Out of memory error [2].\n");
-      return;
+    /* compress the batch, the first job in this thread */
+    for (i = 1; i < jobsN; i++)
+      threadStarted[i] = (pthread_create(&threadIds[i], NULL, _deflate_job, &jobs[i]) == 0) ? YES : NO;
+
+    _deflate_job(&jobs[0]);
+
+    for (i = 1; i < jobsN; i++) {
+      if (threadStarted[i] == YES)
+        pthread_join(threadIds[i], NULL);
+      else
+        _deflate_job(&jobs[i]);
     }
 
-    node->code = 0;
-    node->codeLength = 0;
-    node->leaf = NO;
-    node->literal = 0xDEADBEEF;
-    node->weight = node1->weight + node2->weight;
-    node->left = node1;
-    node->right = node2;
+    /* write out the results in order */
+    for (i = 0; i < jobsN; i++) {
+      if (jobs[i].blocksN < 0 || jobs[i].writer.error == YES) {
+        fprintf(stderr, "_deflate_file(): Out of memory error.\n");
+        return FAILED;
+      }
+
+      time = statsNow();
+      bitWriterAppend(w, &jobs[i].writer);
+      totals->stats.phases[STATS_WRITE] += statsNow() - time;
 
-    /* push the parent back to the queue */
-    priorityQueuePush(node);
+      statsAdd(&totals->stats, &jobs[i].context.state->stats);
+      totals->blocksN += jobs[i].context.blocksN;
+      totals->storedBytes += jobs[i].context.storedBytes;
+      totals->matches += jobs[i].context.matches;
+      totals->duplicateBytes += jobs[i].context.duplicateBytes;
+    }
   }
 
-  /* calculate the codes and code lengths */
-  propagateCodes(*tree, 0, 0);
-
-  /* collect the codes and code lengths */
-  for (i = 0; i < n; i++) {
-    codes[i] = nodes[i].code;
-    codeLengths[i] = nodes[i].codeLength;
+  if (flags != DEFD_FLAG_SIZE_UNKNOWN && readSize != inputSize) {
+    fprintf(stderr, "_deflate_file(): The input changed its size while we were reading it.\n");
+    return FAILED;
   }
 
-  /* DEBUG */
-  /*
-    for (i = 0; i < n; i++)
-    fprintf(stderr, "%d/%d ", frequencies[i], codeLengths[i]);
-  */
+  deflateWriteTrailer(w, format, format == DEFLATE_FORMAT_ZLIB ? adler : crc, readSize);
+
+  totals->readSize += readSize;
+
+  return SUCCEEDED;
 }
 
 
-/* the number of bits we can have in a code */
-#define HUFFMAN_CODE_MAX_BITS 32
+/* FNV-1a of the member name, the decoders look the members up using the same hash */
+static uint32_t _pack_hash(char *name) {
+
+  uint32_t h = 2166136261u;
+
+  while (*name != 0) {
+    h ^= (unsigned char)*name++;
+    h = (h * 16777619u) & 0xFFFFFFFF;
+  }
+
+  return h;
+}
 
-/* tmp buffers for huffmanRecreateCodes() */
-int tmpCount[HUFFMAN_CODE_MAX_BITS], nextCode[HUFFMAN_CODE_MAX_BITS+1];
 
+static int _compare_members(const void *a, const void *b) {
 
-void huffmanRecreateCodes(int n, int *lengths, int *codes) {
+  const struct packMember *m1 = a, *m2 = b;
 
-  int i, code, bits, length;
+  if (m1->hash != m2->hash)
+    return m1->hash < m2->hash ? -1 : 1;
 
-  /* for more information about this, see RFC-1951 section 3.2.2 */
+  return 0;
+}
 
-  /* step 1: count the lengths */
-  for (i = 0; i < HUFFMAN_CODE_MAX_BITS; i++)
-    tmpCount[i] = 0;
 
-  for (i = 0; i < n; i++)
-    tmpCount[lengths[i]]++;
+/* --pack: compresses the files into one pack, returns the size of the pack or 0. a pack that fails is removed */
+static uint64_t _pack(char *name, char **memberNames, int membersN, struct chunkJob *jobs, int threads, unsigned char *dictionary,
+                      int dictionarySize, int print, struct deflateTotals *totals) {
 
-  /*
-    for (i = 0; i < HUFFMAN_CODE_MAX_BITS; i++)
-    fprintf(stderr, "%d ", tmpCount[i]);
-    fprintf(stderr, "\n");
-  */
+  struct packMember *members;
+  unsigned char *mapped;
+  struct bitWriter writer, member;
+  uint64_t offset, inputSize, packSize;
+  int i, n, flags;
+  FILE *f, *fIn;
 
-  /* step 2: find the numerical value of the smallest code for each code length */
-  code = 0;
-  tmpCount[0] = 0;
-  for (bits = 1; bits <= HUFFMAN_CODE_MAX_BITS; bits++) {
-    code = (code + tmpCount[bits - 1]) << 1;
-    nextCode[bits] = code;
+  f = fopen(name, "wb");
+  if (f == NULL) {
+    fprintf(stderr, "_pack(): Could not open file \"%s\" for writing.\n", name);
+    return 0;
   }
 
-  /* step 3: assign numerical values to all codes, using consecutive
-     values for all codes of the same length with the base
-     values determined at step 2. */
-  for (i = 0; i < n; i++) {
-    length = lengths[i];
-    if (length != 0) {
-      /*
-        fprintf(stderr, "oldCode = %d newCode = %d\n", codes[i], nextCode[length]);
-      */
-      codes[i] = nextCode[length];
-      nextCode[length]++;
-    }
+  /* from here on everything is released at the end, whether we succeed or not */
+  packSize = 0;
+  inputSize = 0;
+  mapped = NULL;
+  fIn = NULL;
+
+  n = bitWriterInit(&writer, f);
+  if (bitWriterInit(&member, NULL) == FAILED)
+    n = FAILED;
+  members = malloc(sizeof(struct packMember) * membersN);
+  if (members == NULL || n == FAILED) {
+    fprintf(stderr, "_pack(): Out of memory error.\n");
+    goto cleanup;
   }
-}
 
+  /* room for the header and the index, they are written last */
+  offset = PACK_HEADER_SIZE + PACK_INDEX_ENTRY_SIZE * (uint64_t)membersN;
+  for (i = 0; i < (int)offset; i += 4)
+    bitWriterWriteU32(&writer, 0);
 
-int main(int argc, char *argv[]) {
+  for (i = 0; i < membersN; i++) {
+    fIn = fopen(memberNames[i], "rb");
+    if (fIn == NULL) {
+      fprintf(stderr, "_pack(): Could not open file \"%s\" for reading.\n", memberNames[i]);
+      goto cleanup;
+    }
 
-  int fileSize, *lz77, lz77Size, j, i, k, m, n, lz77Best, lz77Length, lz77Matches, lz77DuplicateBytes, codeLengthsN, codeLengthMax, codesN;
-  unsigned char *data;
-  FILE *f;
+    flags = _input_size(fIn, &inputSize);
+    if (flags == DEFD_FLAG_SIZE_UNKNOWN) {
+      fprintf(stderr, "_pack(): The size of file \"%s\" is not known, the members can't be pipes.\n", memberNames[i]);
+      goto cleanup;
+    }
+    if (flags != 0) {
+      fprintf(stderr, "_pack(): File \"%s\" must be smaller than 4GB.\n", memberNames[i]);
+      goto cleanup;
+    }
 
-  if (argc != 3) {
-    fprintf(stderr, "deflateTT v1.1 Written by Ville Helin 2007\n");
-    fprintf(stderr, "USAGE: %s <IN RAW> <OUT DEF>\n", argv[0]);
-    return 1;
+    mapped = _map_input(fIn, flags, inputSize);
+
+    bitWriterReset(&member);
+    if (_deflate_file(&member, fIn, mapped, inputSize, flags, jobs, threads, DEFLATE_FORMAT_DEFD, CHUNK_SIZE, dictionary, dictionarySize, print, totals) == FAILED)
+      goto cleanup;
+
+    _unmap_input(mapped, inputSize);
+    mapped = NULL;
+    fclose(fIn);
+    fIn = NULL;
+
+    if (bitWriterFlush(&member) == FAILED) {
+      fprintf(stderr, "_pack(): Out of memory error.\n");
+      goto cleanup;
+    }
+
+    members[i].name = memberNames[i];
+    members[i].hash = _pack_hash(memberNames[i]);
+    members[i].offset = (uint32_t)offset;
+    members[i].packedSize = member.bufferN;
+    members[i].unpackedSize = (uint32_t)inputSize;
+
+    bitWriterAppend(&writer, &member);
+
+    /* the next member is aligned */
+    for (offset += member.bufferN; (offset & (PACK_ALIGNMENT - 1)) != 0; offset++)
+      bitWriterWriteU8(&writer, 0);
+
+    if (offset > 0xFFFFFFFFul) {
+      fprintf(stderr, "_pack(): The pack must be smaller than 4GB.\n");
+      goto cleanup;
+    }
   }
 
-  /********************************************************************************/
-  /* INPUT */
-  /********************************************************************************/
+  /* the index is sorted by the hashes, so the decoders can use binary search */
+  qsort(members, membersN, sizeof(struct packMember), _compare_members);
 
-  /* read the RAW file */
-  f = fopen(argv[1], "rb");
-  if (f == NULL) {
-    fprintf(stderr, "main(): Could not open file \"%s\" for reading.\n", argv[1]);
-    return 1;
+  for (i = 1; i < membersN; i++) {
+    if (members[i - 1].hash == members[i].hash) {
+      fprintf(stderr, "_pack(): Members \"%s\" and \"%s\" have the same name hash, please rename one of them.\n", members[i - 1].name, members[i].name);
+      goto cleanup;
+    }
   }
 
-  /* get the file size */
-  fseek(f, 0, SEEK_END);
-  fileSize = ftell(f);
-  fseek(f, 0, SEEK_SET);
+  /* the writer is empty after the flush, so the header and the index go to the start of the file */
+  if (bitWriterFlush(&writer) == FAILED || fseek(f, 0, SEEK_SET) != 0) {
+    fprintf(stderr, "_pack(): Could not write the index into file \"%s\".\n", name);
+    goto cleanup;
+  }
 
-  data = malloc(fileSize);
-  if (data == NULL) {
-    fprintf(stderr, "main(): Out of memory error [1].\n");
-    fclose(f);
-    return 1;
+  bitWriterWriteU8(&writer, 'D');
+  bitWriterWriteU8(&writer, 'E');
+  bitWriterWriteU8(&writer, 'F');
+  bitWriterWriteU8(&writer, 'p');
+  bitWriterWriteU32(&writer, membersN);
+  bitWriterWriteU32(&writer, PACK_ALIGNMENT);
+  bitWriterWriteU32(&writer, 0);
+
+  for (i = 0; i < membersN; i++) {
+    bitWriterWriteU32(&writer, members[i].hash);
+    bitWriterWriteU32(&writer, members[i].offset);
+    bitWriterWriteU32(&writer, members[i].packedSize);
+    bitWriterWriteU32(&writer, members[i].unpackedSize);
   }
 
-  fread(data, 1, fileSize, f);
-  fclose(f);
+  if (bitWriterFlush(&writer) == FAILED) {
+    fprintf(stderr, "_pack(): Could not write file \"%s\".\n", name);
+    goto cleanup;
+  }
 
-  /********************************************************************************/
-  /* ~LZ77 */
-  /********************************************************************************/
+  packSize = offset;
 
-  /* allocate room for the lz77 compressed data */
-  lz77 = malloc(sizeof(int) * fileSize * 3);
-  if (lz77 == NULL) {
-    fprintf(stderr, "main(): Out of memory error [2].\n");
-    return 1;
+ cleanup:
+  _unmap_input(mapped, inputSize);
+  if (fIn != NULL)
+    fclose(fIn);
+  if (fclose(f) != 0 && packSize > 0) {
+    fprintf(stderr, "_pack(): Could not write file \"%s\".\n", name);
+    packSize = 0;
   }
+  bitWriterFree(&writer);
+  bitWriterFree(&member);
+  free(members);
 
-  /* LZ77 */
-  i = 0;
-  lz77Size = 0;
-  lz77Matches = 0;
-  lz77DuplicateBytes = 0;
-
-  while (i < fileSize) {
-    /* find the longest match */
-    j = i - 0x7FFF + 1;
-    if (j < 0)
-      j = 0;
-
-    lz77Best = -1;
-    lz77Length = -1;
-
-    while (j < i) {
-      k = j;
-      m = i;
-      n = 0;
-      while (m < fileSize && data[k] == data[m] && n < 258) {
-        k++;
-        m++;
-        n++;
-      }
+  /* a partial pack is of no use */
+  if (packSize == 0)
+    remove(name);
+
+  return packSize;
+}
 
-      if (n >= lz77Length) {
-        lz77Best = j;
-        lz77Length = n;
-      }
 
-      j++;
+/* --train: builds a dictionary out of the sample files */
+static int _train(char *name, char **sampleNames, int samplesN, int dictionarySizeMax) {
+
+  unsigned char *samples, *dictionary, *tmp;
+  int *sampleSizes, i, total, size, result;
+  long fileSize;
+  FILE *f;
+
+  /* everything is released at the end, whether we succeed or not */
+  result = FAILED;
+  samples = NULL;
+  sampleSizes = malloc(sizeof(int) * samplesN);
+  dictionary = malloc(dictionarySizeMax);
+  if (sampleSizes == NULL || dictionary == NULL) {
+    fprintf(stderr, "_train(): Out of memory error.\n");
+    goto cleanup;
+  }
+
+  /* read all the samples into one buffer */
+  total = 0;
+  for (i = 0; i < samplesN; i++) {
+    f = fopen(sampleNames[i], "rb");
+    if (f == NULL) {
+      fprintf(stderr, "_train(): Could not open file \"%s\" for reading.\n", sampleNames[i]);
+      goto cleanup;
     }
 
-    if (lz77Length > 2) {
-      /* we found a good match -> store */
-      lz77[lz77Size++] = lz77Length + 254; /* 3 -> 257 */
-      lz77[lz77Size++] = i - lz77Best;
+    fileSize = -1;
+    if (fseek(f, 0, SEEK_END) == 0) {
+      fileSize = ftell(f);
+      if (fseek(f, 0, SEEK_SET) != 0)
+        fileSize = -1;
+    }
 
-      /* count statistics */
-      lz77Matches++;
-      lz77DuplicateBytes += lz77Length;
+    if (fileSize < 0) {
+      fprintf(stderr, "_train(): The size of file \"%s\" is not known, the samples can't be pipes.\n", sampleNames[i]);
+      fclose(f);
+      goto cleanup;
+    }
 
-      /* move to pointer over the copied area */
-      i += lz77Length - 1;
+    if (fileSize > 0x7FFFFFFF - total) {
+      fprintf(stderr, "_train(): The samples don't fit into 2GB.\n");
+      fclose(f);
+      goto cleanup;
     }
-    else {
-      /* just output the data byte */
-      lz77[lz77Size++] = data[i];
+
+    tmp = realloc(samples, total + fileSize + 1);
+    if (tmp == NULL) {
+      fprintf(stderr, "_train(): Out of memory error.\n");
+      fclose(f);
+      goto cleanup;
     }
+    samples = tmp;
+
+    sampleSizes[i] = _read_chunk(f, samples + total, (int)fileSize);
+    fclose(f);
+    if (sampleSizes[i] < 0)
+      goto cleanup;
 
-    i++;
+    total += sampleSizes[i];
   }
 
-  /* output the end marker */
-  lz77[lz77Size++] = 256;
+  size = dictionaryTrain(samples, sampleSizes, samplesN, dictionary, dictionarySizeMax);
+  if (size < 0) {
+    fprintf(stderr, "_train(): Out of memory error.\n");
+    goto cleanup;
+  }
+  if (size == 0) {
+    fprintf(stderr, "_train(): The samples have nothing in common, there is nothing to put into the dictionary.\n");
+    goto cleanup;
+  }
 
-  /* print statistics */
-  fprintf(stderr, "main(): LZ77: %d utilized matches | %d duplicate bytes.\n", lz77Matches, lz77DuplicateBytes);
+  f = fopen(name, "wb");
+  if (f == NULL) {
+    fprintf(stderr, "_train(): Could not open file \"%s\" for writing.\n", name);
+    goto cleanup;
+  }
 
-  /********************************************************************************/
-  /* PREPROCESS LZ77 -> HUFFMAN */
-  /********************************************************************************/
+  if (fwrite(dictionary, 1, size, f) != (size_t)size) {
+    fprintf(stderr, "_train(): Could not write file \"%s\".\n", name);
+    fclose(f);
+    goto cleanup;
+  }
 
-  for (i = 0; i < lz77Size; i++) {
-    /*
-      fprintf(stderr, "main(): %d\n", lz77[i]);
-    */
+  fclose(f);
 
-    /* skip plain data bytes (and the end marker) */
-    if (lz77[i] < 257)
-      continue;
+  fprintf(stderr, "_train(): %d sample(s), %dB -> a dictionary of %dB.\n", samplesN, total, size);
 
-    /* we have a length value -> transform */
-    n = lz77[i] - 254;
+  result = SUCCEEDED;
 
-    /*
-      fprintf(stderr, "  length = %d\n", n);
-    */
+ cleanup:
+  free(samples);
+  free(sampleSizes);
+  free(dictionary);
 
-    if (n > 10) {
-      for (j = 0; j < 20; j++) {
-        if (n < extraBitsLimitsLength[j + 1]) {
-          /* store the extra bits in the upper 16 bits */
-          lz77[i] = (265 + j) | ((n - extraBitsLimitsLength[j]) << 16);
-          break;
-        }
-      }
-      if (j == 20) {
-        if (n == 258)
-          lz77[i] = 285;
-        else
-          fprintf(stderr, "main(): Unsupported length %d in LZ77 preprocess.\n", n);
-      }
-    }
+  return result;
+}
 
-    /* move to distance */
-    i++;
 
-    /* transform the distance */
-    n = lz77[i];
+/* --train-tables: builds a predefined table set out of the lz77 symbols of the sample files, and writes it out as C */
+static int _train_tables(char *name, char **sampleNames, int samplesN, const struct level *l) {
 
-    /*
-      fprintf(stderr, "  distance = %d\n", n);
-    */
+  double freqLiterals[286], freqDistances[30];
+  struct matchFinder mf;
+  struct lz77Tokens t;
+  struct lz77Stats stats;
+  struct tableSet s;
+  struct block b;
+  unsigned char *data;
+  int i, j, size, result;
+  FILE *f;
 
-    if (n == 1)
-      lz77[i] = 0;
-    else if (n == 2)
-      lz77[i] = 1;
-    else if (n == 3)
-      lz77[i] = 2;
-    else if (n == 4)
-      lz77[i] = 3;
-    else {
-      for (j = 0; j < 26; j++) {
-        if (n < extraBitsLimitsDistance[j + 1]) {
-          /* store the extra bits in the upper 16 bits */
-          lz77[i] = (4 + j) | ((n - extraBitsLimitsDistance[j]) << 16);
-          break;
-        }
-      }
-      if (j == 26)
-        fprintf(stderr, "main(): Unsupported distance %d in LZ77 preprocess.\n", n);
-    }
+  /* everything is released at the end, whether we succeed or not. the inits leave the match finder
+     and the tokens freeable even when they fail, so both are always run */
+  result = FAILED;
+  data = malloc(CHUNK_SIZE);
+  i = matchFinderInit(&mf, l->finder, l->chainMax, l->niceLength);
+  j = lz77TokensInit(&t, CHUNK_SIZE);
+  if (data == NULL || i == FAILED || j == FAILED) {
+    fprintf(stderr, "_train_tables(): Out of memory error.\n");
+    goto cleanup;
   }
 
-  /********************************************************************************/
-  /* HUFFMAN */
-  /********************************************************************************/
-
-  /* zero the frequencies */
   for (i = 0; i < 286; i++)
     freqLiterals[i] = 0;
   for (i = 0; i < 30; i++)
     freqDistances[i] = 0;
 
-  /* calculate the frequencies */
-  i = 0;
-  while (i < lz77Size) {
-    /* plain data bytes, and the end marker */
-    n = lz77[i++] & 0xFFFF;
-
-    if (n < 257) {
-      freqLiterals[n]++;
+  for (i = 0; i < samplesN; i++) {
+    f = fopen(sampleNames[i], "rb");
+    if (f == NULL) {
+      fprintf(stderr, "_train_tables(): Could not open file \"%s\" for reading.\n", sampleNames[i]);
+      goto cleanup;
     }
-    else {
-      /* length and distance */
-      freqLiterals[n]++;
-      n = lz77[i++] & 0xFFFF;
-      freqDistances[n]++;
+
+    /* the sets are meant for small files, so the first chunk is plenty */
+    size = _read_chunk(f, data, CHUNK_SIZE);
+    fclose(f);
+    if (size < 0)
+      goto cleanup;
+
+    matchFinderReset(&mf, data, size);
+    if (lz77Parse(&mf, 0, l->parser, l->lazyLength, l->iterations, &t, &stats) < 0) {
+      fprintf(stderr, "_train_tables(): Out of memory error.\n");
+      goto cleanup;
     }
+
+    b.start = 0;
+    b.end = t.symbolsN;
+    b.matchStart = 0;
+    b.matchEnd = t.matchesN;
+    blockFrequencies(&b, &t);
+
+    /* every sample weighs the same, however big it is */
+    for (j = 0; j < 286; j++)
+      freqLiterals[j] += (double)b.freqLiterals[j] / (t.symbolsN + 1);
+    for (j = 0; j < 30 && t.matchesN > 0; j++)
+      freqDistances[j] += (double)b.freqDistances[j] / t.matchesN;
   }
 
-  /* DEBUG */
-  /*
-    for (i = 0; i < 286; i++)
-    fprintf(stderr, "main(): Literal %.3d: %d occurrences.\n", i, freqLiterals[i]);
-    for (i = 0; i < 30; i++)
-    fprintf(stderr, "main(): Distance %.2d: %d occurrences.\n", i, freqDistances[i]);
-  */
+  tableSetBuild(freqLiterals, freqDistances, &s);
 
-  /* create the trees */
-  huffmanGrowTree(freqLiterals, 286, &treeLiterals, codeLengthLiterals, codeLiterals);
-  huffmanGrowTree(freqDistances, 30, &treeDistances, codeLengthDistances, codeDistances);
+  f = fopen(name, "wb");
+  if (f == NULL) {
+    fprintf(stderr, "_train_tables(): Could not open file \"%s\" for writing.\n", name);
+    goto cleanup;
+  }
 
-  /* rewrite the codes, so that the decoder can create them as well using the same code */
-  huffmanRecreateCodes(286, codeLengthLiterals, codeLiterals);
-  huffmanRecreateCodes(30, codeLengthDistances, codeDistances);
+  /* fclose() flushes the last of the output, so it can fail to write too */
+  if (tableSetWrite(f, &s, name) == FAILED) {
+    fprintf(stderr, "_train_tables(): Could not write file \"%s\".\n", name);
+    fclose(f);
+    goto cleanup;
+  }
+  if (fclose(f) != 0) {
+    fprintf(stderr, "_train_tables(): Could not write file \"%s\".\n", name);
+    goto cleanup;
+  }
 
-  /********************************************************************************/
-  /* COMPRESS CODE LENGTHS */
-  /********************************************************************************/
+  fprintf(stderr, "_train_tables(): %d sample(s) -> a table set in \"%s\".\n", samplesN, name);
 
-  /* merge the code lengths */
-  j = 0;
-  for (i = 0; i < 286; i++)
-    codeLengths[j++] = codeLengthLiterals[i];
-  for (i = 0; i < 30; i++)
-    codeLengths[j++] = codeLengthDistances[i];
+  result = SUCCEEDED;
 
-  /* find the longest code */
-  codeLengthMax = 0;
-  for (i = 0; i < 286+30; i++) {
-    if (codeLengthMax < codeLengths[i])
-      codeLengthMax = codeLengths[i];
-  }
-  codesN = codeLengthMax + 4;
+ cleanup:
+  free(data);
+  matchFinderFree(&mf);
+  lz77TokensFree(&t);
 
-  /* RLE compress the code lengths */
-  i = 0;
-  j = 0;
-  while (i < 286 + 30) {
-    m = codeLengths[i];
+  return result;
+}
 
-    if (m > 115) {
-      fprintf(stderr, "main(): Got a code length of %d bits (> 115)!\n", m);
-      return 1;
-    }
 
-    if (m != 0) {
-      /* output nonzeros as they are */
-      codeLengths[j++] = m;
-
-      /* ... but does the symbol repeat? */
-      k = 0;
-      while (i + k < 286+30) {
-        if (codeLengths[i + k] != m)
-          break;
-        if (k == 7)
-          break;
-        k++;
-      }
+/* --stats: the phases are summed over the threads, total is the wall time */
+static void _print_stats(int print, struct deflateTotals *totals, uint64_t outputSize, double total) {
+
+  static const char *names[STATS_PHASES_N] = { "read", "preprocess", "lz77", "huffman", "rle", "emit", "write" };
+  struct stats *s = &totals->stats;
+  int i;
 
-      i++;
-      k--;
+  if (print == STATS_PRINT_JSON) {
+    fprintf(stderr, "{\"inputSize\": %.0f, \"outputSize\": %.0f, \"matches\": %.0f, \"duplicateBytes\": %.0f, \"blocks\": %d, \"storedBytes\": %.0f, ",
+            (double)totals->readSize, (double)outputSize, (double)totals->matches, (double)totals->duplicateBytes, totals->blocksN, (double)totals->storedBytes);
+    fprintf(stderr, "\"phases\": {");
+    for (i = 0; i < STATS_PHASES_N; i++)
+      fprintf(stderr, "%s\"%s\": %.6f", i > 0 ? ", " : "", names[i], s->phases[i]);
+    fprintf(stderr, "}, \"total\": %.6f, \"treesBuilt\": %.0f, ", total, (double)s->treesBuilt);
+#ifdef STATS
+    fprintf(stderr, "\"searches\": %.0f, \"probes\": %.0f, \"chainDepth\": %.3f}\n", (double)s->searches, (double)s->probes,
+            s->searches > 0 ? (double)s->probes / (double)s->searches : 0.0);
+#else
+    fprintf(stderr, "\"searches\": null, \"probes\": null, \"chainDepth\": null}\n");
+#endif
+    return;
+  }
 
-      if (k < 3)
-        continue;
+  fprintf(stderr, "main(): Phases:");
+  for (i = 0; i < STATS_PHASES_N; i++)
+    fprintf(stderr, " %s %.3fs |", names[i], s->phases[i]);
+  fprintf(stderr, " total %.3fs.\n", total);
+#ifdef STATS
+  fprintf(stderr, "main(): Match finder: %.0f searches | %.0f probes | %.2f average chain depth | %.0f tree(s) built.\n", (double)s->searches,
+          (double)s->probes, s->searches > 0 ? (double)s->probes / (double)s->searches : 0.0, (double)s->treesBuilt);
+#else
+  fprintf(stderr, "main(): Match finder: %.0f tree(s) built, use make STATS=1 to count the searches and the probes.\n", (double)s->treesBuilt);
+#endif
+}
 
-      /*
-        fprintf(stderr, "%d repeats %d\n", m, k);
-      */
 
-      codeLengths[j++] = (codeLengthMax + 1) | ((k - 3) << 16);
-      i += k;
-    }
-    else {
-      /* RLE compress zeros */
-      k = 1;
-      i++;
-      while (i < 286+30 && k < 138) {
-        if (codeLengths[i] != 0)
-          break;
-        k++;
-        i++;
-      }
+int main(int argc, char *argv[]) {
 
-      /* got k zeros */
-      if (k < 3) {
-        while (k > 0) {
-          codeLengths[j++] = 0;
-          k--;
-        }
+  int i, n, level, format, argsN, chunkSizeMax, flags, threads, train, trainTables, pack, dictionarySize, dictionarySizeMax, print;
+  uint64_t inputSize, outputSize;
+  double start, time;
+  struct deflateTotals totals;
+  struct chunkJob *jobs;
+  struct bitWriter writer;
+  unsigned char *dictionary, *mapped;
+  char *dictionaryName;
+  FILE *fIn, *fOut;
+
+  /* parse the options */
+  level = DEFLATE_LEVEL_DEFAULT;
+  format = DEFLATE_FORMAT_DEFD;
+  threads = 1;
+  train = NO;
+  trainTables = NO;
+  pack = NO;
+  print = STATS_PRINT_NONE;
+  dictionaryName = NULL;
+  dictionarySizeMax = DICTIONARY_SIZE_MAX;
+  argsN = 1;
+  while (argsN < argc && argv[argsN][0] == '-' && argv[argsN][1] != 0) {
+    if (argv[argsN][1] >= '1' && argv[argsN][1] <= '9' && argv[argsN][2] == 0)
+      level = argv[argsN][1] - '0';
+    else if (strcmp(argv[argsN], "--ultra") == 0)
+      level = DEFLATE_LEVEL_ULTRA;
+    else if (strcmp(argv[argsN], "--format=defc") == 0)
+      format = DEFLATE_FORMAT_DEFC;
+    else if (strcmp(argv[argsN], "--format=defd") == 0)
+      format = DEFLATE_FORMAT_DEFD;
+    else if (strcmp(argv[argsN], "--format=raw") == 0)
+      format = DEFLATE_FORMAT_RAW;
+    else if (strcmp(argv[argsN], "--format=zlib") == 0)
+      format = DEFLATE_FORMAT_ZLIB;
+    else if (strcmp(argv[argsN], "--format=gzip") == 0)
+      format = DEFLATE_FORMAT_GZIP;
+    else if (strcmp(argv[argsN], "--threads") == 0 && argsN + 1 < argc) {
+      threads = atoi(argv[++argsN]);
+      if (threads < 1 || threads > THREADS_MAX) {
+        fprintf(stderr, "main(): The number of threads must be 1 ... %d.\n", THREADS_MAX);
+        return 1;
       }
-      else if (k < 11)
-        codeLengths[j++] = (codeLengthMax + 2) | ((k -  3) << 16);
-      else
-        codeLengths[j++] = (codeLengthMax + 3) | ((k - 11) << 16);
     }
+    else if (strcmp(argv[argsN], "--dictionary") == 0 && argsN + 1 < argc)
+      dictionaryName = argv[++argsN];
+    else if (strcmp(argv[argsN], "--dictionary-size") == 0 && argsN + 1 < argc) {
+      dictionarySizeMax = atoi(argv[++argsN]);
+      if (dictionarySizeMax < DICTIONARY_SIZE_MIN || dictionarySizeMax > DICTIONARY_SIZE_MAX) {
+        fprintf(stderr, "main(): The size of the dictionary must be %d ... %d.\n", DICTIONARY_SIZE_MIN, DICTIONARY_SIZE_MAX);
+        return 1;
+      }
+    }
+    else if (strcmp(argv[argsN], "--train") == 0)
+      train = YES;
+    else if (strcmp(argv[argsN], "--train-tables") == 0)
+      trainTables = YES;
+    else if (strcmp(argv[argsN], "--pack") == 0)
+      pack = YES;
+    else if (strcmp(argv[argsN], "--stats") == 0)
+      print = STATS_PRINT_TEXT;
+    else if (strcmp(argv[argsN], "--stats=json") == 0)
+      print = STATS_PRINT_JSON;
+    else
+      break;
+    argsN++;
   }
 
-  /* now we have k items in the code length array */
-  codeLengthsN = j;
-
-  /* calculate the frequencies */
-  for (i = 0; i < codesN; i++)
-    freqCombined[i] = 0;
-
-  /* calculate the frequencies */
-  i = 0;
-  while (i < codeLengthsN) {
-    /* plain data bytes, and the end marker */
-    freqCombined[codeLengths[i++] & 0xFFFF]++;
+  if (train == YES && argc - argsN >= 2)
+    return (_train(argv[argsN], &argv[argsN + 1], argc - argsN - 1, dictionarySizeMax) == SUCCEEDED) ? 0 : 1;
+
+  deflateSetup();
+
+  if (trainTables == YES && argc - argsN >= 2)
+    return (_train_tables(argv[argsN], &argv[argsN + 1], argc - argsN - 1, &deflateTTLevels[level]) == SUCCEEDED) ? 0 : 1;
+
+  if (train == YES || trainTables == YES || (pack == NO && argc - argsN != 2) || (pack == YES && argc - argsN < 2)) {
+    fprintf(stderr, "deflateTT v1.3 Written by Ville Helin 2007\n");
+    fprintf(stderr, "USAGE: %s [OPTIONS] <IN RAW> <OUT DEF>\n", argv[0]);
+    fprintf(stderr, "       %s [OPTIONS] --pack <OUT PACK> <IN RAW> ...\n", argv[0]);
+    fprintf(stderr, "       %s --train [--dictionary-size N] <OUT DICTIONARY> <SAMPLE> ...\n", argv[0]);
+    fprintf(stderr, "       %s --train-tables [-1 ... -9] <OUT C> <SAMPLE> ...\n", argv[0]);
+    fprintf(stderr, "Use - as the file name to read from stdin or to write to stdout.\n");
+    fprintf(stderr, "OPTIONS:\n");
+    fprintf(stderr, "-1 ... -9  Compression level, from the fastest to the best (default: -%d)\n", DEFLATE_LEVEL_DEFAULT);
+    fprintf(stderr, "--ultra    Optimal parsing, very slow but gives the smallest output\n");
+    fprintf(stderr, "--format=defd  Multiple Huffman blocks (default)\n");
+    fprintf(stderr, "--format=defc  One Huffman block, for the decoders older than v1.3\n");
+    fprintf(stderr, "--format=raw|zlib|gzip  Standard deflate (RFC-1951), in a zlib (RFC-1950) or a gzip (RFC-1952) wrapper\n");
+    fprintf(stderr, "--threads N    Compress N chunks at a time, the output doesn't change\n");
+    fprintf(stderr, "--dictionary FILE    Use a preset dictionary, inflateTT needs the same one\n");
+    fprintf(stderr, "--train              Build a dictionary out of sample files\n");
+    fprintf(stderr, "--dictionary-size N  The largest dictionary --train builds (default: %d)\n", DICTIONARY_SIZE_MAX);
+    fprintf(stderr, "--pack               Compress the files into one pack, named as they are given\n");
+    fprintf(stderr, "--train-tables       Build a predefined table set out of sample files, as C\n");
+    fprintf(stderr, "--stats[=json]       Print the time spent in each phase, and the counters\n");
+    return 1;
   }
 
-  /* create the trees */
-  huffmanGrowTree(freqCombined, codesN, &treeCombined, codeLengthCombined, codeCombined);
+  argv += argsN - 1;
 
-  /* rewrite the codes, so that the decoder can create them as well using the same code */
-  huffmanRecreateCodes(codesN, codeLengthCombined, codeCombined);
+  /* the dictionary, if any, is put into the window before the first chunk */
+  dictionary = NULL;
+  dictionarySize = 0;
+  if (dictionaryName != NULL) {
+    if (format == DEFLATE_FORMAT_DEFC || format == DEFLATE_FORMAT_GZIP) {
+      fprintf(stderr, "main(): --format=defc and --format=gzip don't support dictionaries.\n");
+      return 1;
+    }
+    if (_load_dictionary(dictionaryName, &dictionary, &dictionarySize) == FAILED)
+      return 1;
+  }
 
   /********************************************************************************/
-  /* OUTPUT (DEF) */
+  /* INPUT */
   /********************************************************************************/
 
-  /* write the DEF file */
-  f = fopen(argv[2], "wb");
-  if (f == NULL) {
-    fprintf(stderr, "main(): Could not open file \"%s\" for writing.\n", argv[2]);
-    return 1;
+  start = statsNow();
+  fIn = NULL;
+  inputSize = 0;
+  flags = 0;
+
+  if (pack == YES) {
+    /* the pack is written in two passes */
+    if (format != DEFLATE_FORMAT_DEFD || strcmp(argv[1], "-") == 0) {
+      fprintf(stderr, "main(): --pack needs --format=defd, and can't write to stdout.\n");
+      return 1;
+    }
+    chunkSizeMax = CHUNK_SIZE;
   }
+  else {
+    if (strcmp(argv[1], "-") == 0)
+      fIn = stdin;
+    else {
+      fIn = fopen(argv[1], "rb");
+      if (fIn == NULL) {
+        fprintf(stderr, "main(): Could not open file \"%s\" for reading.\n", argv[1]);
+        return 1;
+      }
+    }
 
-  /* header */
-  _write_u8(f, 'D');
-  _write_u8(f, 'E');
-  _write_u8(f, 'F');
-  _write_u8(f, 'c');
+    flags = _input_size(fIn, &inputSize);
 
-  /* unpacked size */
-  _write_u32(f, fileSize);
+    /* DEFc has only one block, so all the data must be in memory at once */
+    if (format == DEFLATE_FORMAT_DEFC) {
+      if (flags != 0 || inputSize > CHUNK_SIZE_MAX_DEFC) {
+        fprintf(stderr, "main(): --format=defc needs a file smaller than %dMB, and can't read from a pipe.\n", CHUNK_SIZE_MAX_DEFC >> 20);
+        return 1;
+      }
+      chunkSizeMax = (int)inputSize;
+    }
+    else
+      chunkSizeMax = CHUNK_SIZE;
+  }
 
-  j = 0;
-  m = 0;
+  /* DEFc has only one chunk */
+  if (format == DEFLATE_FORMAT_DEFC)
+    threads = 1;
 
-  /* the number of code lengths */
-  _write_u8(f, codesN);
+  /* each thread has a job of its own */
+  jobs = malloc(sizeof(struct chunkJob) * threads);
+  if (jobs == NULL) {
+    fprintf(stderr, "main(): Out of memory error.\n");
+    return 1;
+  }
 
-  /* find the longest code */
-  n = 0;
-  for (i = 0; i < codesN; i++) {
-    if (n < codeLengthCombined[i])
-      n = codeLengthCombined[i];
+  for (i = 0; i < threads; i++) {
+    if (_job_init(&jobs[i], level, format, chunkSizeMax) == FAILED)
+      return 1;
   }
 
-  /* calculate the number of bits we need in order to write out the code length bits */
-  if (n < 4)
-    k = 2;
-  else if (n < 8)
-    k = 3;
-  else if (n < 16)
-    k = 4;
-  else if (n < 32)
-    k = 5;
-  else if (n < 64)
-    k = 6;
-  else
-    k = 7;
-
-  /* the number of bits per code length */
-  _write_bits(f, &j, &m, k, 3);
-
-  /* combined code lengths */
-  for (i = 0; i < codesN; i++) {
-    if (codeLengthCombined[i] > 115)
-      fprintf(stderr, "main(): Combined code length entry %d > 115!\n", codeLengthCombined[i]);
-    _write_bits(f, &j, &m, codeLengthCombined[i], k);
-    /*
-      fprintf(stderr, "main(): codeLengthCombined[%d] = %d\n", i, codeLengthCombined[i]);
-    */
-  }
-
-  /* compress combined code lengths */
-  i = 0;
-  while (i < codeLengthsN) {
-    n = codeLengths[i] & 0xFFFF;
-
-    _write_bits(f, &j, &m, codeCombined[n], codeLengthCombined[n]);
-
-    /*
-      fprintf(stderr, "i = %.3d: got %d\n", i, n);
-    */
-
-    /* extra bits? */
-    if (n > codeLengthMax) {
-      if (n == codeLengthMax + 1)
-        _write_bits(f, &j, &m, codeLengths[i] >> 16, 2);
-      else if (n == codeLengthMax + 2)
-        _write_bits(f, &j, &m, codeLengths[i] >> 16, 3);
-      else if (n == codeLengthMax + 3)
-        _write_bits(f, &j, &m, codeLengths[i] >> 16, 7);
-      else
-        fprintf(stderr, "main(): Internal error, combined code %d is not supported!\n", n);
+  totals.readSize = 0;
+  totals.matches = 0;
+  totals.duplicateBytes = 0;
+  totals.blocksN = 0;
+  totals.storedBytes = 0;
+  statsClear(&totals.stats);
 
-      /*
-        fprintf(stderr, "main(): n = %d\n", codeLengths[i] >> 16);
-      */
-    }
+  /********************************************************************************/
+  /* OUTPUT (DEF) */
+  /********************************************************************************/
 
-    i++;
+  if (pack == YES) {
+    outputSize = _pack(argv[1], &argv[2], argc - argsN - 1, jobs, threads, dictionary, dictionarySize, print, &totals);
+    n = (outputSize > 0) ? SUCCEEDED : FAILED;
   }
+  else {
+    if (strcmp(argv[2], "-") == 0)
+      fOut = stdout;
+    else {
+      fOut = fopen(argv[2], "wb");
+      if (fOut == NULL) {
+        fprintf(stderr, "main(): Could not open file \"%s\" for writing.\n", argv[2]);
+        return 1;
+      }
+    }
 
-  /* compress payload */
-  i = 0;
-  while (i < lz77Size) {
-    n = lz77[i] & 0xFFFF;
+    if (bitWriterInit(&writer, fOut) == FAILED) {
+      fprintf(stderr, "main(): Out of memory error.\n");
+      return 1;
+    }
+    if (format >= DEFLATE_FORMAT_RAW)
+      bitWriterSetOrder(&writer, BIT_WRITER_LSB_FIRST);
 
-    _write_bits(f, &j, &m, codeLiterals[n], codeLengthLiterals[n]);
+    mapped = _map_input(fIn, flags, inputSize);
 
-    if (n > 256) {
-      /* length extra bits */
-      k = extraBitsLengths[n - 257];
-      if (k > 0) {
-        n = lz77[i] >> 16;
-        _write_bits(f, &j, &m, n, k);
-      }
-      i++;
+    n = _deflate_file(&writer, fIn, mapped, inputSize, flags, jobs, threads, format, chunkSizeMax, dictionary, dictionarySize, print, &totals);
 
-      /* distance */
-      n = lz77[i] & 0xFFFF;
-      _write_bits(f, &j, &m, codeDistances[n], codeLengthDistances[n]);
+    _unmap_input(mapped, inputSize);
+    if (fIn != stdin)
+      fclose(fIn);
 
-      /* distance extra bits */
-      k = extraBitsDistances[n];
-      if (k > 0) {
-        n = lz77[i] >> 16;
-        _write_bits(f, &j, &m, n, k);
-      }
-      i++;
+    /* write out the last, remaining bits */
+    time = statsNow();
+    if (n == SUCCEEDED) {
+      n = bitWriterFlush(&writer);
+      if (n == FAILED)
+        fprintf(stderr, "main(): Could not write file \"%s\".\n", argv[2]);
     }
+    totals.stats.phases[STATS_WRITE] += statsNow() - time;
+    outputSize = writer.written;
+    bitWriterFree(&writer);
+
+    if (fOut != stdout)
+      fclose(fOut);
     else
-      i++;
+      fflush(fOut);
   }
 
-  /* write out the last, remaining bits */
-  if (j != 0)
-    _write_u8(f, m << (8 - j));
+  for (i = 0; i < threads; i++)
+    _job_free(&jobs[i]);
+  free(jobs);
+  free(dictionary);
 
-  i = ftell(f);
+  if (n == FAILED)
+    return 1;
 
-  fclose(f);
+  time = statsNow() - start;
+
+  if (print == STATS_PRINT_JSON) {
+    _print_stats(print, &totals, outputSize, time);
+    return 0;
+  }
+
+  /* print statistics */
+  fprintf(stderr, "main(): LZ77: %.0f utilized matches | %.0f duplicate bytes.\n", (double)totals.matches, (double)totals.duplicateBytes);
+  fprintf(stderr, "main(): %d block(s), %.0f byte(s) stored as they are.\n", totals.blocksN, (double)totals.storedBytes);
+  fprintf(stderr, "main(): Original size = %.0fB, deflated size = %.0fB -> Got rid of %.2f%%.\n", (double)totals.readSize, (double)outputSize,
+          100 - ((double)outputSize*100.0 / (double)totals.readSize));
 
-  fprintf(stderr, "main(): Original size = %dB, deflated size = %dB -> Got rid of %.2f%%.\n", fileSize, i, 100 - (i*100.0f / fileSize));
+  if (print == STATS_PRINT_TEXT)
+    _print_stats(print, &totals, outputSize, time);
 
   return 0;
 }
@@ -2,16 +2,116 @@
 #ifndef _MAIN_H
 #define _MAIN_H
 
-struct node {
-  struct node *left;
-  struct node *right;
-  struct node *smaller;
-  struct node *larger;
-  int literal;
-  int weight;
-  int leaf;
-  int code;
-  int codeLength;
+/* the input is compressed in chunks this big, the end of each chunk is the dictionary of the next one */
+#define CHUNK_SIZE (1 << 20)
+
+/* DEFc files are compressed in one go */
+#define CHUNK_SIZE_MAX_DEFC (256 << 20)
+
+/* the zlib header: deflate with a 32K window, the level (0-3) in the top two bits of the flags, and a preset dictionary flag */
+#define ZLIB_METHOD_DEFLATE_32K 0x78
+#define ZLIB_LEVEL_FASTEST      0
+#define ZLIB_LEVEL_FAST         1
+#define ZLIB_LEVEL_DEFAULT      2
+#define ZLIB_LEVEL_MAX          3
+#define ZLIB_FLAG_DICTIONARY    0x20
+
+/* the gzip header: deflate, the extra flags for the best and the fastest levels, and an unknown OS */
+#define GZIP_METHOD_DEFLATE 8
+#define GZIP_LEVEL_MAX      2
+#define GZIP_LEVEL_FASTEST  4
+#define GZIP_OS_UNKNOWN     255
+
+/* the flags in the DEFd header. the size is a u32 unless one of these is set */
+#define DEFD_FLAG_SIZE_64      1
+#define DEFD_FLAG_SIZE_UNKNOWN 2
+
+/* the file was compressed using a preset dictionary, its id (Adler-32) follows the size */
+#define DEFD_FLAG_DICTIONARY   4
+
+/* --threads N */
+#define THREADS_MAX 256
+
+/* --stats and --stats=json */
+#define STATS_PRINT_NONE 0
+#define STATS_PRINT_TEXT 1
+#define STATS_PRINT_JSON 2
+
+/* --pack: a 16 byte header ("DEFp", the number of members, the alignment, zero), and an index
+   of the members sorted by the hashes of their names. the members are aligned so that a mapped
+   pack can be inflated in place */
+#define PACK_HEADER_SIZE      16
+#define PACK_INDEX_ENTRY_SIZE 16
+#define PACK_ALIGNMENT        16
+
+struct level {
+  int finder;
+  int chainMax;
+  int niceLength;
+  int parser;
+  int lazyLength;
+  int iterations;
+};
+
+/* the memory of a DeflateContext (see deflate.h), it's kept between the calls */
+struct deflateState {
+  const struct level *level;
+
+  struct matchFinder matchFinder;
+  struct lz77Tokens tokens;
+  struct blockList blocks;
+
+  /* deflate() collects its output here */
+  struct bitWriter writer;
+
+  /* the preset dictionary, and room for it and the first chunk */
+  unsigned char *dictionary;
+  int dictionarySize;
+  unsigned char *window;
+
+  /* the phase timings and the counters of --stats */
+  struct stats stats;
+};
+
+/* a chunk to be compressed by a thread, the output is collected into the job's own writer */
+struct chunkJob {
+  /* the dictionary, followed by the chunk. it's either in the job's own buffer, or in the mapped input */
+  unsigned char *data;
+  unsigned char *buffer;
+  int dictionarySize;
+  int chunkSize;
+  int last;
+
+  struct DeflateContext context;
+  struct bitWriter writer;
+
+  /* the number of blocks, or -1 */
+  int blocksN;
+};
+
+/* the results of all the files we compressed */
+struct deflateTotals {
+  uint64_t readSize;
+  uint64_t matches;
+  uint64_t duplicateBytes;
+  uint64_t storedBytes;
+  int blocksN;
+  struct stats stats;
 };
 
+/* an entry of the pack index */
+struct packMember {
+  uint32_t hash;
+  uint32_t offset;
+  uint32_t packedSize;
+  uint32_t unpackedSize;
+  char *name;
+};
+
+/* deflateTT itself compresses files a chunk at a time, in many threads. these aren't a part of libdeflateTT's API */
+void deflateSetup(void);
+int deflateChunk(struct DeflateContext *context, struct bitWriter *w, unsigned char *data, int dictionarySize, int chunkSize, int last);
+void deflateWriteHeader(struct bitWriter *w, int format, int flags, uint64_t inputSize, int level, unsigned char *dictionary, int dictionarySize);
+void deflateWriteTrailer(struct bitWriter *w, int format, uint32_t checksum, uint64_t inputSize);
+
 #endif
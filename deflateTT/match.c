@@ -0,0 +1,403 @@
+
+/*
+ * deflateTT's LZ77 match finder. Every position is hashed by its first three
+ * bytes, and the positions sharing a hash value are linked into a chain that
+ * runs from the newest to the oldest, so instead of comparing against all the
+ * previous 32K positions we only visit the ones that can actually match.
+ *
+ * The binary tree finder keeps the positions sharing a hash value sorted by
+ * the strings that start at them. Looking up a position walks down the tree
+ * and re-roots it at the new position, so every match that gets longer on the
+ * way is found in about log time. This is what the best levels use.
+ *
+ * Both finders extend the matches using the same kernel, which compares 32
+ * (AVX2), 16 (SSE2) or 8 (64-bit XOR) bytes at a time and finds the first
+ * difference by counting the trailing zeros. The best kernel the CPU has is
+ * picked at run time. Define MATCH_SCALAR to compare one byte at a time,
+ * e.g., when building for the DS or a big endian machine.
+ *
+ * This code is under GNU General Public Licence (GPL), version 2, June 1991.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "defines.h"
+#include "match.h"
+#include "stats.h"
+
+/* the wide kernels need GCC's (or clang's) builtins, and a little endian CPU */
+#if !defined(MATCH_SCALAR) && defined(__GNUC__) && defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define MATCH_WORDS
+#include <stdint.h>
+#if defined(__x86_64__) || defined(__i386__)
+#define MATCH_X86
+#include <immintrin.h>
+#endif
+#endif
+
+
+static int _hash(unsigned char *data) {
+
+  unsigned int h;
+
+  h = (data[0] << 16) | (data[1] << 8) | data[2];
+
+  return (int)(((h * 2654435761u) & 0xFFFFFFFF) >> (32 - MATCH_HASH_BITS));
+}
+
+
+static int _match_length_bytes(unsigned char *a, unsigned char *b, int limit) {
+
+  int n = 0;
+
+  while (n < limit && a[n] == b[n])
+    n++;
+
+  return n;
+}
+
+
+#ifdef MATCH_WORDS
+
+static int _match_length_words(unsigned char *a, unsigned char *b, int limit) {
+
+  uint64_t x, y;
+  int n = 0;
+
+  while (n + 8 <= limit) {
+    memcpy(&x, a + n, 8);
+    memcpy(&y, b + n, 8);
+    x ^= y;
+    if (x != 0)
+      return n + (__builtin_ctzll(x) >> 3);
+    n += 8;
+  }
+
+  while (n < limit && a[n] == b[n])
+    n++;
+
+  return n;
+}
+
+#endif
+
+
+#ifdef MATCH_X86
+
+__attribute__((target("sse2"))) static int _match_length_sse2(unsigned char *a, unsigned char *b, int limit) {
+
+  unsigned int mask;
+  int n = 0;
+
+  while (n + 16 <= limit) {
+    mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(a + n)), _mm_loadu_si128((__m128i *)(b + n)))) ^ 0xFFFF;
+    if (mask != 0)
+      return n + __builtin_ctz(mask);
+    n += 16;
+  }
+
+  return n + _match_length_words(a + n, b + n, limit - n);
+}
+
+
+__attribute__((target("avx2"))) static int _match_length_avx2(unsigned char *a, unsigned char *b, int limit) {
+
+  unsigned int mask;
+  int n = 0;
+
+  while (n + 32 <= limit) {
+    mask = ~(unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i *)(a + n)), _mm256_loadu_si256((__m256i *)(b + n))));
+    if (mask != 0)
+      return n + __builtin_ctz(mask);
+    n += 32;
+  }
+
+  return n + _match_length_sse2(a + n, b + n, limit - n);
+}
+
+#endif
+
+
+/* how many bytes a and b have in common, limit at most. set by matchFinderSetup() */
+static int (*_match_length)(unsigned char *a, unsigned char *b, int limit) = _match_length_bytes;
+
+
+/* picks the kernel, once before any match finder is used, see deflateSetup() */
+void matchFinderSetup(void) {
+
+#ifdef MATCH_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    _match_length = _match_length_avx2;
+  else if (__builtin_cpu_supports("sse2"))
+    _match_length = _match_length_sse2;
+  else
+    _match_length = _match_length_words;
+#elif defined(MATCH_WORDS)
+  _match_length = _match_length_words;
+#else
+  _match_length = _match_length_bytes;
+#endif
+}
+
+
+static void _insert(struct matchFinder *mf, int position) {
+
+  int h;
+
+  /* we need three bytes to compute the hash */
+  if (position + MATCH_LENGTH_MIN > mf->dataSize)
+    return;
+
+  h = _hash(mf->data + position);
+  mf->chain[position & MATCH_WINDOW_MASK] = mf->head[h];
+  mf->head[h] = position;
+}
+
+
+static int _hash_chain_find(struct matchFinder *mf, struct match *matches) {
+
+  unsigned char *current;
+  int position, candidate, limit, length, chain, best, n;
+
+  position = mf->position++;
+
+  if (position + MATCH_LENGTH_MIN > mf->dataSize)
+    return 0;
+
+  limit = mf->dataSize - position;
+  if (limit > MATCH_LENGTH_MAX)
+    limit = MATCH_LENGTH_MAX;
+
+  current = mf->data + position;
+  candidate = mf->head[_hash(current)];
+  _insert(mf, position);
+  STATS_COUNT(mf->searches, 1);
+
+  n = 0;
+  best = MATCH_LENGTH_MIN - 1;
+  chain = mf->chainMax;
+  while (candidate >= 0 && position - candidate <= MATCH_DISTANCE_MAX && chain > 0) {
+    STATS_COUNT(mf->probes, 1);
+
+    /* the candidate must beat the best match found so far, so check that byte first */
+    if (mf->data[candidate + best] == current[best]) {
+      length = _match_length(mf->data + candidate, current, limit);
+
+      /* prefer the closest of equally long matches */
+      if (length > best) {
+        best = length;
+        matches[n].length = length;
+        matches[n].distance = position - candidate;
+        n++;
+
+        if (length >= mf->niceLength || length == limit)
+          break;
+      }
+    }
+
+    candidate = mf->chain[candidate & MATCH_WINDOW_MASK];
+    chain--;
+  }
+
+  return n;
+}
+
+
+/* inserts the current position into its tree, and if matches != NULL, collects the matches found on the way */
+static int _binary_tree_find(struct matchFinder *mf, struct match *matches) {
+
+  unsigned char *current, *previous;
+  int position, candidate, limit, lengthMax, length, lengthSmaller, lengthLarger, cut, best, h, n;
+  int *smaller, *larger, *pair;
+
+  position = mf->position++;
+
+  if (position + MATCH_LENGTH_MIN > mf->dataSize)
+    return 0;
+
+  lengthMax = mf->dataSize - position;
+  if (lengthMax > MATCH_LENGTH_MAX)
+    lengthMax = MATCH_LENGTH_MAX;
+
+  /* the tree is sorted by the first "limit" bytes only */
+  limit = lengthMax;
+  if (limit > mf->niceLength)
+    limit = mf->niceLength;
+
+  current = mf->data + position;
+  h = _hash(current);
+  candidate = mf->head[h];
+  mf->head[h] = position;
+
+  /* the new position becomes the root, and the old tree is split under it */
+  smaller = &mf->tree[(position & MATCH_WINDOW_MASK) << 1];
+  larger = smaller + 1;
+  lengthSmaller = 0;
+  lengthLarger = 0;
+
+  n = 0;
+  best = MATCH_LENGTH_MIN - 1;
+  cut = mf->chainMax;
+  STATS_COUNT(mf->searches, 1);
+  while (1) {
+    if (candidate < 0 || position - candidate > MATCH_DISTANCE_MAX || cut == 0) {
+      *smaller = -1;
+      *larger = -1;
+      break;
+    }
+
+    cut--;
+    STATS_COUNT(mf->probes, 1);
+    pair = &mf->tree[(candidate & MATCH_WINDOW_MASK) << 1];
+    previous = mf->data + candidate;
+
+    /* both subtrees we came through already share this many bytes with us */
+    length = lengthSmaller;
+    if (length > lengthLarger)
+      length = lengthLarger;
+
+    if (previous[length] == current[length]) {
+      length += _match_length(previous + length, current + length, limit - length);
+
+      if (length > best) {
+        best = length;
+        if (matches != NULL) {
+          matches[n].length = length;
+          matches[n].distance = position - candidate;
+          n++;
+        }
+
+        if (length == limit) {
+          /* the candidate is as good as ours, so we take its children and drop it */
+          *smaller = pair[0];
+          *larger = pair[1];
+          break;
+        }
+      }
+    }
+
+    if (previous[length] < current[length]) {
+      *smaller = candidate;
+      smaller = &pair[1];
+      candidate = *smaller;
+      lengthSmaller = length;
+    }
+    else {
+      *larger = candidate;
+      larger = &pair[0];
+      candidate = *larger;
+      lengthLarger = length;
+    }
+  }
+
+  /* the nice length cut the search, but the match itself can be longer */
+  if (n > 0 && best == limit && limit < lengthMax) {
+    previous = current - matches[n - 1].distance;
+    matches[n - 1].length += _match_length(previous + limit, current + limit, lengthMax - limit);
+  }
+
+  return n;
+}
+
+
+int matchFinderInit(struct matchFinder *mf, int type, int chainMax, int niceLength) {
+
+  mf->type = type;
+  mf->data = NULL;
+  mf->dataSize = 0;
+  mf->position = 0;
+  mf->chainMax = chainMax;
+  mf->niceLength = niceLength;
+  mf->chain = NULL;
+  mf->tree = NULL;
+  mf->searches = 0;
+  mf->probes = 0;
+
+  mf->head = malloc(sizeof(int) * MATCH_HASH_SIZE);
+  if (type == MATCH_FINDER_BINARY_TREE)
+    mf->tree = malloc(sizeof(int) * MATCH_WINDOW_SIZE * 2);
+  else
+    mf->chain = malloc(sizeof(int) * MATCH_WINDOW_SIZE);
+
+  if (mf->head == NULL || (mf->chain == NULL && mf->tree == NULL)) {
+    matchFinderFree(mf);
+    return FAILED;
+  }
+
+  return SUCCEEDED;
+}
+
+
+void matchFinderFree(struct matchFinder *mf) {
+
+  free(mf->head);
+  free(mf->chain);
+  free(mf->tree);
+
+  mf->head = NULL;
+  mf->chain = NULL;
+  mf->tree = NULL;
+}
+
+
+void matchFinderReset(struct matchFinder *mf, unsigned char *data, int dataSize) {
+
+  int i;
+
+  mf->data = data;
+  mf->dataSize = dataSize;
+  mf->position = 0;
+
+  for (i = 0; i < MATCH_HASH_SIZE; i++)
+    mf->head[i] = -1;
+}
+
+
+/* finds all the matches for the current position, each longer than the previous one, and moves past it */
+int matchFinderFindAll(struct matchFinder *mf, struct match *matches) {
+
+  if (mf->type == MATCH_FINDER_BINARY_TREE)
+    return _binary_tree_find(mf, matches);
+
+  return _hash_chain_find(mf, matches);
+}
+
+
+/* finds the longest match for the current position, and moves past it */
+int matchFinderFind(struct matchFinder *mf, struct match *match) {
+
+  struct match matches[MATCH_CANDIDATES_MAX];
+  int n;
+
+  n = matchFinderFindAll(mf, matches);
+  if (n == 0) {
+    match->length = 0;
+    match->distance = 0;
+    return 0;
+  }
+
+  *match = matches[n - 1];
+
+  return match->length;
+}
+
+
+/* moves past n positions without searching them, but keeps them in the chains/trees */
+void matchFinderSkip(struct matchFinder *mf, int n) {
+
+  if (mf->type == MATCH_FINDER_BINARY_TREE) {
+    while (n > 0) {
+      _binary_tree_find(mf, NULL);
+      n--;
+    }
+    return;
+  }
+
+  while (n > 0) {
+    _insert(mf, mf->position++);
+    n--;
+  }
+}
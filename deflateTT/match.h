@@ -0,0 +1,61 @@
+
+#ifndef _MATCH_H
+#define _MATCH_H
+
+#include <stdint.h>
+
+/* the sliding window, and the longest distance we can reach inside it */
+#define MATCH_WINDOW_SIZE  0x8000
+#define MATCH_WINDOW_MASK  0x7FFF
+#define MATCH_DISTANCE_MAX 0x7FFF
+
+/* the shortest and the longest match deflate can code */
+#define MATCH_LENGTH_MIN 3
+#define MATCH_LENGTH_MAX 258
+
+/* a position can have at most this many matches, each longer than the previous one */
+#define MATCH_CANDIDATES_MAX (MATCH_LENGTH_MAX - MATCH_LENGTH_MIN + 1)
+
+/* the hash table indexes the three bytes starting at each position */
+#define MATCH_HASH_BITS 15
+#define MATCH_HASH_SIZE (1 << MATCH_HASH_BITS)
+
+/* the match finders */
+#define MATCH_FINDER_HASH_CHAIN  0
+#define MATCH_FINDER_BINARY_TREE 1
+
+struct match {
+  int length;
+  int distance;
+};
+
+struct matchFinder {
+  int type;
+  unsigned char *data;
+  int dataSize;
+  /* the next position to be searched/inserted */
+  int position;
+  /* give up after visiting this many candidates */
+  int chainMax;
+  /* stop searching when we find a match at least this long */
+  int niceLength;
+  /* the newest position for each hash value */
+  int *head;
+  /* the previous position with the same hash, indexed by position & MATCH_WINDOW_MASK */
+  int *chain;
+  /* the smaller and the larger child of each position, for the binary tree finder */
+  int *tree;
+  /* the positions searched and the candidates visited, counted only when built using make STATS=1 */
+  uint64_t searches;
+  uint64_t probes;
+};
+
+void matchFinderSetup(void);
+int matchFinderInit(struct matchFinder *mf, int type, int chainMax, int niceLength);
+void matchFinderFree(struct matchFinder *mf);
+void matchFinderReset(struct matchFinder *mf, unsigned char *data, int dataSize);
+int matchFinderFind(struct matchFinder *mf, struct match *match);
+int matchFinderFindAll(struct matchFinder *mf, struct match *matches);
+void matchFinderSkip(struct matchFinder *mf, int n);
+
+#endif
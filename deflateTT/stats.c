@@ -0,0 +1,57 @@
+
+/*
+ * deflateTT's --stats. Each phase is timed where it starts and ends, which
+ * happens once per run or block, so the timing is always on. The counters
+ * that sit in the hot loops (e.g., each candidate the match finder visits)
+ * use STATS_COUNT(), which is empty unless deflateTT is built using
+ * make STATS=1.
+ *
+ * This code is under GNU General Public Licence (GPL), version 2, June 1991.
+ */
+
+/* for clock_gettime() */
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "defines.h"
+#include "stats.h"
+
+
+/* the time in seconds, from some fixed point */
+double statsNow(void) {
+
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+
+  return t.tv_sec + t.tv_nsec / 1000000000.0;
+}
+
+
+void statsClear(struct stats *s) {
+
+  int i;
+
+  for (i = 0; i < STATS_PHASES_N; i++)
+    s->phases[i] = 0;
+
+  s->searches = 0;
+  s->probes = 0;
+  s->treesBuilt = 0;
+}
+
+
+void statsAdd(struct stats *s, struct stats *from) {
+
+  int i;
+
+  for (i = 0; i < STATS_PHASES_N; i++)
+    s->phases[i] += from->phases[i];
+
+  s->searches += from->searches;
+  s->probes += from->probes;
+  s->treesBuilt += from->treesBuilt;
+}
@@ -0,0 +1,41 @@
+
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stdint.h>
+
+/* the phases --stats times. preprocess is the entropy scan that decides which regions are stored,
+   huffman builds the trees and splits the blocks, and rle compresses the code lengths of the trees */
+#define STATS_READ       0
+#define STATS_PREPROCESS 1
+#define STATS_LZ77       2
+#define STATS_HUFFMAN    3
+#define STATS_RLE        4
+#define STATS_EMIT       5
+#define STATS_WRITE      6
+#define STATS_PHASES_N   7
+
+/* the counters in the hot loops are built in only using make STATS=1, otherwise they compile to nothing */
+#ifdef STATS
+#define STATS_COUNT(counter, n) ((counter) += (n))
+#else
+#define STATS_COUNT(counter, n)
+#endif
+
+struct stats {
+  /* seconds spent in each phase, summed over the threads */
+  double phases[STATS_PHASES_N];
+
+  /* the positions the match finder searched, and the candidates it visited */
+  uint64_t searches;
+  uint64_t probes;
+
+  /* the trees built, the block splitter tries many */
+  uint64_t treesBuilt;
+};
+
+double statsNow(void);
+void statsClear(struct stats *s);
+void statsAdd(struct stats *s, struct stats *from);
+
+#endif
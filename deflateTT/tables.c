@@ -0,0 +1,244 @@
+
+/*
+ * deflateTT's predefined table sets. A small file spends a big part of its
+ * bits on the code lengths of its trees, so a block can instead name one of
+ * the table sets here, and the decoder uses its prebuilt tables as they are.
+ *
+ * Set 0 holds the fixed codes of RFC-1951. The others were trained using
+ * deflateTT --train-tables on corpora of small files: "text" on English
+ * texts and source code, "binary" on executables and libraries. Every
+ * symbol has a code in every set, so any block can use any of them.
+ *
+ * This code is under GNU General Public Licence (GPL), version 2, June 1991.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "defines.h"
+#include "huffman.h"
+#include "tables.h"
+
+
+const struct tableSet deflateTTTableSets[TABLE_SETS_N] = {
+  /* fixed, RFC-1951 section 3.2.6. 286 and 287 are never used, but they have codes */
+  {
+    /* the number of literal/length codes of each length */
+    {
+      0, 0, 0, 0, 0, 0, 0, 24, 152, 112, 0, 0, 0, 0, 0, 0
+    },
+    /* the literals/lengths in code order */
+    {
+      256, 257, 258, 259, 260, 261, 262, 263, 264, 265, 266, 267, 268, 269, 270, 271,
+      272, 273, 274, 275, 276, 277, 278, 279, 0, 1, 2, 3, 4, 5, 6, 7,
+      8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23,
+      24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39,
+      40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 52, 53, 54, 55,
+      56, 57, 58, 59, 60, 61, 62, 63, 64, 65, 66, 67, 68, 69, 70, 71,
+      72, 73, 74, 75, 76, 77, 78, 79, 80, 81, 82, 83, 84, 85, 86, 87,
+      88, 89, 90, 91, 92, 93, 94, 95, 96, 97, 98, 99, 100, 101, 102, 103,
+      104, 105, 106, 107, 108, 109, 110, 111, 112, 113, 114, 115, 116, 117, 118, 119,
+      120, 121, 122, 123, 124, 125, 126, 127, 128, 129, 130, 131, 132, 133, 134, 135,
+      136, 137, 138, 139, 140, 141, 142, 143, 280, 281, 282, 283, 284, 285, 286, 287,
+      144, 145, 146, 147, 148, 149, 150, 151, 152, 153, 154, 155, 156, 157, 158, 159,
+      160, 161, 162, 163, 164, 165, 166, 167, 168, 169, 170, 171, 172, 173, 174, 175,
+      176, 177, 178, 179, 180, 181, 182, 183, 184, 185, 186, 187, 188, 189, 190, 191,
+      192, 193, 194, 195, 196, 197, 198, 199, 200, 201, 202, 203, 204, 205, 206, 207,
+      208, 209, 210, 211, 212, 213, 214, 215, 216, 217, 218, 219, 220, 221, 222, 223,
+      224, 225, 226, 227, 228, 229, 230, 231, 232, 233, 234, 235, 236, 237, 238, 239,
+      240, 241, 242, 243, 244, 245, 246, 247, 248, 249, 250, 251, 252, 253, 254, 255
+    },
+    /* the number of distance codes of each length */
+    {
+      0, 0, 0, 0, 0, 30, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+    },
+    /* the distances in code order */
+    {
+      0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+      16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29
+    }
+  },
+  /* text */
+  {
+    /* the number of literal/length codes of each length */
+    {
+      0, 0, 0, 0, 2, 10, 14, 24, 23, 21, 13, 12, 6, 5, 0, 156
+    },
+    /* the literals/lengths in code order */
+    {
+      32, 257, 97, 101, 105, 111, 114, 115, 116, 258, 259, 260, 10, 46, 99, 100,
+      108, 109, 110, 112, 117, 261, 262, 263, 265, 269, 44, 47, 65, 67, 69, 73,
+      76, 78, 79, 82, 83, 84, 95, 98, 102, 103, 104, 119, 121, 264, 266, 267,
+      268, 270, 34, 39, 40, 41, 42, 45, 48, 49, 50, 58, 66, 68, 70, 77,
+      80, 85, 107, 118, 120, 256, 271, 272, 273, 35, 51, 52, 54, 56, 59, 60,
+      61, 62, 71, 72, 86, 87, 89, 91, 92, 93, 124, 274, 275, 277, 43, 53,
+      55, 57, 63, 64, 75, 106, 113, 122, 123, 125, 276, 33, 37, 38, 74, 88,
+      94, 96, 126, 278, 279, 281, 285, 36, 81, 90, 280, 282, 283, 9, 169, 194,
+      195, 284, 0, 1, 2, 3, 4, 5, 6, 7, 8, 11, 12, 13, 14, 15,
+      16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31,
+      127, 128, 129, 130, 131, 132, 133, 134, 135, 136, 137, 138, 139, 140, 141, 142,
+      143, 144, 145, 146, 147, 148, 149, 150, 151, 152, 153, 154, 155, 156, 157, 158,
+      159, 160, 161, 162, 163, 164, 165, 166, 167, 168, 170, 171, 172, 173, 174, 175,
+      176, 177, 178, 179, 180, 181, 182, 183, 184, 185, 186, 187, 188, 189, 190, 191,
+      192, 193, 196, 197, 198, 199, 200, 201, 202, 203, 204, 205, 206, 207, 208, 209,
+      210, 211, 212, 213, 214, 215, 216, 217, 218, 219, 220, 221, 222, 223, 224, 225,
+      226, 227, 228, 229, 230, 231, 232, 233, 234, 235, 236, 237, 238, 239, 240, 241,
+      242, 243, 244, 245, 246, 247, 248, 249, 250, 251, 252, 253, 254, 255
+    },
+    /* the number of distance codes of each length */
+    {
+      0, 0, 0, 0, 11, 6, 6, 3, 1, 1, 2, 0, 0, 0, 0, 0
+    },
+    /* the distances in code order */
+    {
+      10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 8, 9, 21, 22, 23,
+      24, 0, 5, 6, 7, 25, 26, 4, 27, 28, 29, 3, 1, 2
+    }
+  },
+  /* binary */
+  {
+    /* the number of literal/length codes of each length */
+    {
+      0, 0, 0, 1, 1, 3, 6, 22, 47, 88, 90, 17, 3, 4, 4, 0
+    },
+    /* the literals/lengths in code order */
+    {
+      257, 258, 259, 260, 261, 0, 72, 232, 262, 265, 267, 1, 2, 15, 32, 65,
+      76, 97, 101, 114, 115, 116, 117, 131, 137, 139, 141, 233, 255, 263, 264, 266,
+      270, 3, 4, 5, 6, 8, 10, 14, 16, 24, 36, 40, 45, 46, 48, 49,
+      56, 57, 61, 64, 68, 69, 73, 77, 80, 84, 95, 98, 99, 100, 102, 104,
+      105, 108, 109, 110, 111, 112, 120, 128, 132, 133, 144, 192, 235, 248, 269, 285,
+      7, 9, 11, 12, 13, 17, 18, 20, 21, 26, 28, 29, 31, 34, 37, 41,
+      44, 47, 50, 51, 52, 53, 54, 58, 59, 60, 63, 66, 67, 70, 71, 74,
+      78, 79, 82, 83, 85, 86, 88, 91, 92, 93, 96, 103, 107, 118, 119, 121,
+      124, 129, 134, 136, 140, 152, 160, 168, 176, 182, 184, 186, 190, 193, 194, 195,
+      196, 197, 198, 199, 200, 201, 208, 210, 216, 224, 230, 236, 237, 239, 240, 246,
+      247, 249, 250, 251, 252, 253, 254, 268, 19, 22, 23, 25, 27, 30, 33, 35,
+      38, 39, 42, 43, 55, 62, 75, 81, 87, 89, 90, 94, 106, 113, 122, 123,
+      125, 126, 127, 130, 135, 138, 142, 143, 145, 146, 148, 149, 150, 151, 153, 154,
+      156, 162, 164, 166, 170, 172, 175, 178, 180, 183, 185, 187, 188, 189, 191, 202,
+      203, 204, 205, 206, 207, 209, 211, 212, 213, 214, 215, 217, 218, 219, 220, 221,
+      222, 223, 225, 226, 227, 228, 229, 231, 234, 238, 241, 242, 243, 244, 245, 271,
+      272, 273, 147, 155, 157, 158, 159, 161, 163, 165, 167, 169, 171, 173, 174, 177,
+      179, 181, 274, 275, 276, 277, 256, 278, 280, 281, 279, 282, 283, 284
+    },
+    /* the number of distance codes of each length */
+    {
+      0, 0, 0, 0, 8, 13, 5, 1, 1, 2, 0, 0, 0, 0, 0, 0
+    },
+    /* the distances in code order */
+    {
+      5, 7, 8, 10, 11, 12, 14, 16, 9, 13, 15, 17, 18, 19, 20, 21,
+      22, 23, 24, 25, 26, 0, 3, 6, 27, 28, 29, 4, 1, 2
+    }
+  }
+};
+
+/* the code lengths and the codes of the table sets, for the encoder */
+struct deflateTTTableCodes deflateTTTableCodes[TABLE_SETS_N];
+
+
+static void _code_lengths(const unsigned short *counts, const unsigned short *symbols, int *codeLengths) {
+
+  int i, j, n;
+
+  n = 0;
+  for (i = 1; i <= HUFFMAN_CODE_MAX_BITS; i++) {
+    for (j = 0; j < counts[i]; j++)
+      codeLengths[symbols[n++]] = i;
+  }
+}
+
+
+/* gives the symbols of the table sets their code lengths and codes */
+void tablesInit(void) {
+
+  int i;
+
+  for (i = 0; i < TABLE_SETS_N; i++) {
+    _code_lengths(deflateTTTableSets[i].literalCounts, deflateTTTableSets[i].literals, deflateTTTableCodes[i].codeLengthLiterals);
+    _code_lengths(deflateTTTableSets[i].distanceCounts, deflateTTTableSets[i].distances, deflateTTTableCodes[i].codeLengthDistances);
+    huffmanCodes(288, deflateTTTableCodes[i].codeLengthLiterals, deflateTTTableCodes[i].codeLiterals);
+    huffmanCodes(30, deflateTTTableCodes[i].codeLengthDistances, deflateTTTableCodes[i].codeDistances);
+  }
+}
+
+
+/* counts the codes of each length, and lists the symbols in the order of their codes */
+static void _canonical(int *codeLengths, int n, unsigned short *counts, unsigned short *symbols) {
+
+  int i, j, k;
+
+  for (i = 0; i <= HUFFMAN_CODE_MAX_BITS; i++)
+    counts[i] = 0;
+  for (i = 0; i < n; i++)
+    counts[codeLengths[i]]++;
+
+  k = 0;
+  for (i = 1; i <= HUFFMAN_CODE_MAX_BITS; i++) {
+    for (j = 0; j < n; j++) {
+      if (codeLengths[j] == i)
+        symbols[k++] = j;
+    }
+  }
+}
+
+
+/* builds a table set out of the frequencies, every symbol gets a code even if it was never seen */
+void tableSetBuild(double *freqLiterals, double *freqDistances, struct tableSet *s) {
+
+  int weights[286], codeLengths[286], i;
+  double total;
+
+  total = 0;
+  for (i = 0; i < 286; i++)
+    total += freqLiterals[i];
+  for (i = 0; i < 286; i++)
+    weights[i] = 1 + (int)(freqLiterals[i] / (total > 0 ? total : 1) * (1 << 24));
+
+  huffmanCodeLengths(weights, 286, HUFFMAN_CODE_MAX_BITS, codeLengths);
+  _canonical(codeLengths, 286, s->literalCounts, s->literals);
+
+  total = 0;
+  for (i = 0; i < 30; i++)
+    total += freqDistances[i];
+  for (i = 0; i < 30; i++)
+    weights[i] = 1 + (int)(freqDistances[i] / (total > 0 ? total : 1) * (1 << 24));
+
+  huffmanCodeLengths(weights, 30, HUFFMAN_CODE_MAX_BITS, codeLengths);
+  _canonical(codeLengths, 30, s->distanceCounts, s->distances);
+}
+
+
+static void _write_array(FILE *f, char *comment, const unsigned short *values, int n, int last) {
+
+  int i;
+
+  fprintf(f, "    /* %s */\n    {\n", comment);
+  for (i = 0; i < n; i++) {
+    if ((i & 15) == 0)
+      fprintf(f, "      ");
+    fprintf(f, "%d", values[i]);
+    if (i == n - 1)
+      fprintf(f, "\n");
+    else if ((i & 15) == 15)
+      fprintf(f, ",\n");
+    else
+      fprintf(f, ", ");
+  }
+  fprintf(f, "    }%s\n", last == YES ? "" : ",");
+}
+
+
+/* writes the table set as a C initializer, to be pasted into deflateTTTableSets[] here and into tableSets[] of the decoders */
+int tableSetWrite(FILE *f, struct tableSet *s, char *name) {
+
+  fprintf(f, "  /* %s */\n  {\n", name);
+  _write_array(f, "the number of literal/length codes of each length", s->literalCounts, HUFFMAN_CODE_MAX_BITS + 1, NO);
+  _write_array(f, "the literals/lengths in code order", s->literals, 286, NO);
+  _write_array(f, "the number of distance codes of each length", s->distanceCounts, HUFFMAN_CODE_MAX_BITS + 1, NO);
+  _write_array(f, "the distances in code order", s->distances, 30, YES);
+  fprintf(f, "  }\n");
+
+  return ferror(f) ? FAILED : SUCCEEDED;
+}
@@ -0,0 +1,39 @@
+
+#ifndef _TABLES_H
+#define _TABLES_H
+
+/* a block of type 1 names one of the predefined table sets in this many bits, instead of coding its trees */
+#define TABLE_SET_BITS 3
+
+/* the predefined table sets */
+#define TABLE_SET_FIXED  0
+#define TABLE_SET_TEXT   1
+#define TABLE_SET_BINARY 2
+#define TABLE_SETS_N     3
+
+/* a table set is stored the way the decoders use it: the number of codes of each length,
+   and the symbols in the order of their codes. the decoders have copies of the same tables.
+   the fixed codes of RFC-1951 have 288 literals/lengths, the rest have 286 */
+struct tableSet {
+  unsigned short literalCounts[HUFFMAN_CODE_MAX_BITS + 1];
+  unsigned short literals[288];
+  unsigned short distanceCounts[HUFFMAN_CODE_MAX_BITS + 1];
+  unsigned short distances[30];
+};
+
+/* the code lengths and the codes of a table set, see tablesInit() */
+struct deflateTTTableCodes {
+  int codeLengthLiterals[288];
+  int codeLengthDistances[30];
+  int codeLiterals[288];
+  int codeDistances[30];
+};
+
+extern const struct tableSet deflateTTTableSets[TABLE_SETS_N];
+extern struct deflateTTTableCodes deflateTTTableCodes[TABLE_SETS_N];
+
+void tablesInit(void);
+void tableSetBuild(double *freqLiterals, double *freqDistances, struct tableSet *s);
+int tableSetWrite(FILE *f, struct tableSet *s, char *name);
+
+#endif
@@ -0,0 +1,149 @@
+
+/*
+ * The bit reader of inflateTT, inflateTT-MP and inflateTT-DS. The bits are
+ * read the most significant bit first, so the next bit is the highest bit of
+ * a 64-bit buffer. The buffer is refilled using one 8-byte load (gcc turns
+ * the shifts below into a single, possibly unaligned, load), so a decoder
+ * can refill once and then peek at and skip any number of bits up to 56
+ * without checking the input on each bit.
+ *
+ * When the end of the input is known, the last bytes are read one at a time
+ * and everything after the end reads as zeros, so nothing past the end is
+ * touched. When it isn't known (end is NULL), nothing is loaded ahead:
+ * bitReaderNeed() loads a byte at a time as the bits are read, and a
+ * decoder that peeks at a code loads more only while the code doesn't fit
+ * into the bits there are. That's slower, but like reading the input one
+ * bit at a time, it never reads past the last code.
+ *
+ * This code is under GNU Lesser General Public Licence (LGPL), version 2.1,
+ * February 1999.
+ */
+
+#ifndef _BITREADER_H
+#define _BITREADER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct bitReader {
+  /* the bits not yet read, the next one is the highest bit. the bits below the bitsN valid ones are
+     either zeros or the input that follows them */
+  uint64_t bits;
+  int bitsN;
+
+  /* the next byte to go into the buffer, and the end of the input (or NULL) */
+  unsigned char *next;
+  unsigned char *end;
+
+  /* where the input started, and the number of zero bytes read past its end */
+  unsigned char *data;
+  int overrun;
+};
+
+/* a refill leaves at least this many bits into the buffer */
+#define BIT_READER_REFILL_BITS 56
+
+/* the next n (0 ... 32) bits, the buffer must have them */
+#define BIT_READER_PEEK(r, n) ((unsigned int)(((r)->bits >> 32) >> (32 - (n))))
+
+/* moves past n bits in the buffer */
+#define BIT_READER_SKIP(r, n) ((r)->bits <<= (n), (r)->bitsN -= (n))
+
+/* the number of bits read since bitReaderInit() */
+#define BIT_READER_POSITION(r) ((((r)->next - (r)->data) + (r)->overrun) * 8 - (r)->bitsN)
+
+/* true if the bits read so far go past the end of the input, into the zeros read after it */
+#define BIT_READER_PAST_END(r) ((r)->overrun * 8 > (r)->bitsN)
+
+
+static void bitReaderInit(struct bitReader *r, unsigned char *data, unsigned char *end) {
+
+  r->bits = 0;
+  r->bitsN = 0;
+  r->next = data;
+  r->end = end;
+  r->data = data;
+  r->overrun = 0;
+}
+
+
+/* fills the buffer up to at least BIT_READER_REFILL_BITS bits. if the end isn't known this does nothing */
+static void bitReaderRefill(struct bitReader *r) {
+
+  unsigned char *p = r->next;
+
+  if (r->end == NULL)
+    return;
+
+  if (r->end - p >= 8) {
+    /* the bits already in the buffer are the same as the ones loaded under them, so they can be or'ed */
+    r->bits |= (((uint64_t)p[0] << 56) | ((uint64_t)p[1] << 48) | ((uint64_t)p[2] << 40) | ((uint64_t)p[3] << 32) |
+                ((uint64_t)p[4] << 24) | ((uint64_t)p[5] << 16) | ((uint64_t)p[6] << 8) | (uint64_t)p[7]) >> r->bitsN;
+    r->next += (63 - r->bitsN) >> 3;
+    r->bitsN |= 56;
+    return;
+  }
+
+  /* near the end, one byte at a time */
+  while (r->bitsN <= 56) {
+    if (r->next < r->end)
+      r->bits |= (uint64_t)*r->next++ << (56 - r->bitsN);
+    else
+      r->overrun++;
+    r->bitsN += 8;
+  }
+}
+
+
+/* makes sure the buffer has n (0 ... 32) bits. if the end isn't known, only the bytes they are in are loaded */
+static void bitReaderNeed(struct bitReader *r, int n) {
+
+  if (r->bitsN >= n)
+    return;
+
+  if (r->end != NULL) {
+    bitReaderRefill(r);
+    return;
+  }
+
+  do {
+    r->bits |= (uint64_t)*r->next++ << (56 - r->bitsN);
+    r->bitsN += 8;
+  } while (r->bitsN < n);
+}
+
+
+/* reads n (0 ... 32) bits */
+static unsigned int bitReaderRead(struct bitReader *r, int n) {
+
+  unsigned int bits;
+
+  bitReaderNeed(r, n);
+
+  bits = BIT_READER_PEEK(r, n);
+  BIT_READER_SKIP(r, n);
+
+  return bits;
+}
+
+
+/* skips to the next byte boundary, and gives the whole bytes in the buffer back to the input. returns
+   the next byte, where e.g. a stored block starts. the reader goes on from r->next */
+static unsigned char *bitReaderAlign(struct bitReader *r) {
+
+  int bytes = r->bitsN >> 3;
+
+  if (bytes > r->overrun) {
+    r->next -= bytes - r->overrun;
+    r->overrun = 0;
+  }
+  else
+    r->overrun -= bytes;
+
+  r->bits = 0;
+  r->bitsN = 0;
+
+  return r->next;
+}
+
+#endif
@@ -17,6 +17,7 @@
 */
 
 #include "inflate.h"
+#include "bitreader.h"
 
 
 /* the number of bits we can have in a code */
@@ -70,6 +71,134 @@ const s32 baseValueDistances[] = {
 };
 
 
+/* a block of type 1 names a predefined table set in this many bits */
+#define TABLE_SET_BITS 3
+#define TABLE_SETS_N   3
+
+/* a predefined table set: the number of codes of each length, and the symbols in the order of their codes */
+struct tableSet {
+  u16 literalCounts[16];
+  u16 literals[288];
+  u16 distanceCounts[16];
+  u16 distances[30];
+};
+
+/* the predefined table sets, the same ones deflateTT has in tables.c. 0 is the fixed codes of RFC-1951 */
+const struct tableSet tableSets[TABLE_SETS_N] = {
+  /* fixed, RFC-1951 section 3.2.6. 286 and 287 are never used, but they have codes */
+  {
+    /* the number of literal/length codes of each length */
+    {
+      0, 0, 0, 0, 0, 0, 0, 24, 152, 112, 0, 0, 0, 0, 0, 0
+    },
+    /* the literals/lengths in code order */
+    {
+      256, 257, 258, 259, 260, 261, 262, 263, 264, 265, 266, 267, 268, 269, 270, 271,
+      272, 273, 274, 275, 276, 277, 278, 279, 0, 1, 2, 3, 4, 5, 6, 7,
+      8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23,
+      24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39,
+      40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 52, 53, 54, 55,
+      56, 57, 58, 59, 60, 61, 62, 63, 64, 65, 66, 67, 68, 69, 70, 71,
+      72, 73, 74, 75, 76, 77, 78, 79, 80, 81, 82, 83, 84, 85, 86, 87,
+      88, 89, 90, 91, 92, 93, 94, 95, 96, 97, 98, 99, 100, 101, 102, 103,
+      104, 105, 106, 107, 108, 109, 110, 111, 112, 113, 114, 115, 116, 117, 118, 119,
+      120, 121, 122, 123, 124, 125, 126, 127, 128, 129, 130, 131, 132, 133, 134, 135,
+      136, 137, 138, 139, 140, 141, 142, 143, 280, 281, 282, 283, 284, 285, 286, 287,
+      144, 145, 146, 147, 148, 149, 150, 151, 152, 153, 154, 155, 156, 157, 158, 159,
+      160, 161, 162, 163, 164, 165, 166, 167, 168, 169, 170, 171, 172, 173, 174, 175,
+      176, 177, 178, 179, 180, 181, 182, 183, 184, 185, 186, 187, 188, 189, 190, 191,
+      192, 193, 194, 195, 196, 197, 198, 199, 200, 201, 202, 203, 204, 205, 206, 207,
+      208, 209, 210, 211, 212, 213, 214, 215, 216, 217, 218, 219, 220, 221, 222, 223,
+      224, 225, 226, 227, 228, 229, 230, 231, 232, 233, 234, 235, 236, 237, 238, 239,
+      240, 241, 242, 243, 244, 245, 246, 247, 248, 249, 250, 251, 252, 253, 254, 255
+    },
+    /* the number of distance codes of each length */
+    {
+      0, 0, 0, 0, 0, 30, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+    },
+    /* the distances in code order */
+    {
+      0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+      16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29
+    }
+  },
+  /* text */
+  {
+    /* the number of literal/length codes of each length */
+    {
+      0, 0, 0, 0, 2, 10, 14, 24, 23, 21, 13, 12, 6, 5, 0, 156
+    },
+    /* the literals/lengths in code order */
+    {
+      32, 257, 97, 101, 105, 111, 114, 115, 116, 258, 259, 260, 10, 46, 99, 100,
+      108, 109, 110, 112, 117, 261, 262, 263, 265, 269, 44, 47, 65, 67, 69, 73,
+      76, 78, 79, 82, 83, 84, 95, 98, 102, 103, 104, 119, 121, 264, 266, 267,
+      268, 270, 34, 39, 40, 41, 42, 45, 48, 49, 50, 58, 66, 68, 70, 77,
+      80, 85, 107, 118, 120, 256, 271, 272, 273, 35, 51, 52, 54, 56, 59, 60,
+      61, 62, 71, 72, 86, 87, 89, 91, 92, 93, 124, 274, 275, 277, 43, 53,
+      55, 57, 63, 64, 75, 106, 113, 122, 123, 125, 276, 33, 37, 38, 74, 88,
+      94, 96, 126, 278, 279, 281, 285, 36, 81, 90, 280, 282, 283, 9, 169, 194,
+      195, 284, 0, 1, 2, 3, 4, 5, 6, 7, 8, 11, 12, 13, 14, 15,
+      16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31,
+      127, 128, 129, 130, 131, 132, 133, 134, 135, 136, 137, 138, 139, 140, 141, 142,
+      143, 144, 145, 146, 147, 148, 149, 150, 151, 152, 153, 154, 155, 156, 157, 158,
+      159, 160, 161, 162, 163, 164, 165, 166, 167, 168, 170, 171, 172, 173, 174, 175,
+      176, 177, 178, 179, 180, 181, 182, 183, 184, 185, 186, 187, 188, 189, 190, 191,
+      192, 193, 196, 197, 198, 199, 200, 201, 202, 203, 204, 205, 206, 207, 208, 209,
+      210, 211, 212, 213, 214, 215, 216, 217, 218, 219, 220, 221, 222, 223, 224, 225,
+      226, 227, 228, 229, 230, 231, 232, 233, 234, 235, 236, 237, 238, 239, 240, 241,
+      242, 243, 244, 245, 246, 247, 248, 249, 250, 251, 252, 253, 254, 255
+    },
+    /* the number of distance codes of each length */
+    {
+      0, 0, 0, 0, 11, 6, 6, 3, 1, 1, 2, 0, 0, 0, 0, 0
+    },
+    /* the distances in code order */
+    {
+      10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 8, 9, 21, 22, 23,
+      24, 0, 5, 6, 7, 25, 26, 4, 27, 28, 29, 3, 1, 2
+    }
+  },
+  /* binary */
+  {
+    /* the number of literal/length codes of each length */
+    {
+      0, 0, 0, 1, 1, 3, 6, 22, 47, 88, 90, 17, 3, 4, 4, 0
+    },
+    /* the literals/lengths in code order */
+    {
+      257, 258, 259, 260, 261, 0, 72, 232, 262, 265, 267, 1, 2, 15, 32, 65,
+      76, 97, 101, 114, 115, 116, 117, 131, 137, 139, 141, 233, 255, 263, 264, 266,
+      270, 3, 4, 5, 6, 8, 10, 14, 16, 24, 36, 40, 45, 46, 48, 49,
+      56, 57, 61, 64, 68, 69, 73, 77, 80, 84, 95, 98, 99, 100, 102, 104,
+      105, 108, 109, 110, 111, 112, 120, 128, 132, 133, 144, 192, 235, 248, 269, 285,
+      7, 9, 11, 12, 13, 17, 18, 20, 21, 26, 28, 29, 31, 34, 37, 41,
+      44, 47, 50, 51, 52, 53, 54, 58, 59, 60, 63, 66, 67, 70, 71, 74,
+      78, 79, 82, 83, 85, 86, 88, 91, 92, 93, 96, 103, 107, 118, 119, 121,
+      124, 129, 134, 136, 140, 152, 160, 168, 176, 182, 184, 186, 190, 193, 194, 195,
+      196, 197, 198, 199, 200, 201, 208, 210, 216, 224, 230, 236, 237, 239, 240, 246,
+      247, 249, 250, 251, 252, 253, 254, 268, 19, 22, 23, 25, 27, 30, 33, 35,
+      38, 39, 42, 43, 55, 62, 75, 81, 87, 89, 90, 94, 106, 113, 122, 123,
+      125, 126, 127, 130, 135, 138, 142, 143, 145, 146, 148, 149, 150, 151, 153, 154,
+      156, 162, 164, 166, 170, 172, 175, 178, 180, 183, 185, 187, 188, 189, 191, 202,
+      203, 204, 205, 206, 207, 209, 211, 212, 213, 214, 215, 217, 218, 219, 220, 221,
+      222, 223, 225, 226, 227, 228, 229, 231, 234, 238, 241, 242, 243, 244, 245, 271,
+      272, 273, 147, 155, 157, 158, 159, 161, 163, 165, 167, 169, 171, 173, 174, 177,
+      179, 181, 274, 275, 276, 277, 256, 278, 280, 281, 279, 282, 283, 284
+    },
+    /* the number of distance codes of each length */
+    {
+      0, 0, 0, 0, 8, 13, 5, 1, 1, 2, 0, 0, 0, 0, 0, 0
+    },
+    /* the distances in code order */
+    {
+      5, 7, 8, 10, 11, 12, 14, 16, 9, 13, 15, 17, 18, 19, 20, 21,
+      22, 23, 24, 25, 26, 0, 3, 6, 27, 28, 29, 4, 1, 2
+    }
+  }
+};
+
+
 static void huffmanConstructTree(struct node **root, s32 *codes, s32 *codeLengths, s32 n) {
 
   struct node *node;
@@ -170,310 +299,325 @@ void huffmanRecreateCodes(s32 n, s32 *lengths, s32 *codes) {
 }
 
 
-void inflate(u8 *data, vu16 *output) {
+/* decodes a symbol using a predefined table set, returns -1 if the code is not in the set. the codes
+   are canonical, so the codes of each length follow the codes of the previous length */
+static s32 _decode_symbol(struct bitReader *r, const u16 *counts, const u16 *symbols) {
 
-  s32 i, j, k, m, n, length, b, e, distance, inflatedSize, outOne, codesN, bPrevious;
-  struct node *node;
+  s32 code, first, index, length, bits;
 
-  outOne = 0;
-
-  /********************************************************************************/
-  /* HUFFMAN */
-  /********************************************************************************/
-
-  /* skip "DEFc" */
-  i = 4;
-
-  /* parse inflated size */
-  inflatedSize = data[i] | (data[i+1] << 8) | (data[i+2] << 16) | (data[i+3] << 24);
-  i += 4;
-
-  /*
-    fprintf(stderr, "MAIN: Inflated size = %d\n", inflatedSize);
-  */
-
-  /* read the number of code lengths */
-  codesN = data[i++];
+  /* the end of the input isn't known, so a byte is loaded only when the code goes on into it */
+  bits = BIT_READER_PEEK(r, 15);
+  code = 0;
+  first = 0;
+  index = 0;
+  for (length = 1; length < 16; length++) {
+    if (length > r->bitsN) {
+      bitReaderNeed(r, length);
+      bits = BIT_READER_PEEK(r, 15);
+    }
 
-  /* read bits per code length */
-  k = 7;
+    code |= (bits >> (15 - length)) & 1;
 
-  m = 0;
-  for (n = 0; n < 3; n++) {
-    /* parse one bit */
-    b = (data[i] >> k) & 1;
-    k--;
+    if (code - first < counts[length]) {
+      BIT_READER_SKIP(r, length);
+      return symbols[index + code - first];
+    }
 
-    m = (m << 1) | b;
+    index += counts[length];
+    first = (first + counts[length]) << 1;
+    code <<= 1;
   }
 
-  /*
-    fprintf(stderr, "main(): Number of items = %d. Bits per item = %d.\n", codesN, m);
-  */
+  return -1;
+}
 
-  /* read the combined code lengths */
-  for (j = 0; j < codesN; j++) {
-    codeLengthCombined[j] = 0;
 
-    for (n = 0; n < m; n++) {
-      /* parse one bit */
-      if (k == -1) {
-        k = 7;
-        i++;
-      }
+/* walks the tree down to a leaf, one bit at a time. a byte is loaded when the bits run out */
+static s32 _decode_tree(struct bitReader *r, struct node *node) {
 
-      b = (data[i] >> k) & 1;
-      k--;
+  while (node->literal < 0) {
+    bitReaderNeed(r, 1);
 
-      codeLengthCombined[j] = (codeLengthCombined[j] << 1) | b;
-    }
+    if (BIT_READER_PEEK(r, 1) != 0)
+      node = node->right;
+    else
+      node = node->left;
 
-    /*
-      fprintf(stderr, "main(): codeLengthCombined[%d] = %d\n", j, codeLengthCombined[j]);
-    */
+    BIT_READER_SKIP(r, 1);
   }
 
-  /* create the codes from code lengths */
-  huffmanRecreateCodes(codesN, codeLengthCombined, codeCombined);
-
-  /* free all huffman tree nodes */
-  treeNodesFreeCurrent = 0;
-
-  /* build the huffman tree */
-  huffmanConstructTree(&treeCombined, codeCombined, codeLengthCombined, codesN);
-
-  /* inflate */
-  j = 0;
-  bPrevious = 0;
-  while (j < 286 + 30) {
-    node = treeCombined;
+  return node->literal;
+}
 
-    while (node->literal < 0) {
-      /* parse one bit */
-      if (k == -1) {
-        k = 7;
-        i++;
-      }
 
-      if ((data[i] >> k) & 1)
-        node = node->right;
-      else
-        node = node->left;
+void inflate(u8 *data, vu16 *output) {
 
-      k--;
-    }
+  s32 i, j, m, n, o, length, b, e, distance, outOne, codesN, bPrevious, last, flags;
+  const struct tableSet *table;
+  struct bitReader r;
+  u8 *stored;
 
-    b = node->literal;
+  outOne = 0;
 
-    /*
-      fprintf(stderr, "i = %.3d: got %d\n", j, b);
-    */
+  /********************************************************************************/
+  /* HUFFMAN */
+  /********************************************************************************/
 
-    if (b <= codesN - 4)
-      n = 1;
-    else if (b == codesN - 4 + 1)
-      n = 2;
-    else if (b == codesN - 4 + 2)
-      n = 3;
-    else
-      n = 7;
+  /* skip "DEFc"/"DEFd" */
+  i = 4;
 
-    /* pump more bits? */
-    if (n > 1) {
-      if (n == 2 || n == 3)
-        m = 3;
-      else
-        m = 11;
+  /* DEFd has flags for the size: 1 - it's a u64, 2 - there is no size */
+  flags = 0;
+  if (data[3] == 'd')
+    flags = data[i++];
+
+  /* preset dictionaries (flag 4) are supported by inflateTT-MP only */
+  if ((flags & 4) == 4)
+    return;
+
+  /* skip the inflated size, the output is written until the last block ends */
+  if (flags != 2)
+    i += 4;
+  if (flags == 1)
+    i += 4;
+
+  /* the size of the data isn't known, so the reader loads the bytes only as the codes need them */
+  bitReaderInit(&r, data + i, NULL);
+  o = 0;
+  last = 1;
+
+  /* DEFc files have one block, DEFd files have a sequence of them */
+  do {
+    table = NULL;
+
+    if (data[3] == 'd') {
+      /* is this the last block? */
+      last = bitReaderRead(&r, 1);
+
+      /* block type */
+      b = bitReaderRead(&r, 2);
+
+      /* a stored block is byte aligned, and its bytes are copied as they are, two at a time */
+      if (b == 0) {
+        stored = bitReaderAlign(&r);
+
+        length = stored[0] | (stored[1] << 8);
+        stored += 4;
+
+        /* complete the halfword we are in */
+        if (outOne == 1 && length > 0) {
+          output[o >> 1] = (*stored++ << 8) | output[o >> 1];
+          outOne = 0;
+          o++;
+          length--;
+        }
 
-      e = 0;
+        for (; length > 1; length -= 2) {
+          output[o >> 1] = stored[0] | (stored[1] << 8);
+          stored += 2;
+          o += 2;
+        }
 
-      while (n > 0) {
-        /* parse one bit */
-        if (k == -1) {
-          k = 7;
-          i++;
+        if (length > 0) {
+          output[o >> 1] = *stored++;
+          outOne = 1;
+          o++;
         }
 
-        e = (e << 1) | ((data[i] >> k) & 1);
+        r.next = stored;
+        continue;
+      }
 
-        k--;
-        n--;
+      /* a predefined table set instead of the trees */
+      if (b == 1) {
+        b = bitReaderRead(&r, TABLE_SET_BITS);
+        if (b >= TABLE_SETS_N)
+          return;
+        table = &tableSets[b];
       }
+      else if (b != 2)
+        return;
+    }
+
+    /* a predefined table set is ready to be used as it is, otherwise read the trees */
+    if (table == NULL) {
+      /* read the number of code lengths */
+      codesN = bitReaderRead(&r, 8);
+
+      /* read bits per code length */
+      m = bitReaderRead(&r, 3);
 
       /*
-        fprintf(stderr, "e = %d\n", e);
+        fprintf(stderr, "main(): Number of items = %d. Bits per item = %d.\n", codesN, m);
       */
 
-      n = e + m;
+      /* read the combined code lengths */
+      for (j = 0; j < codesN; j++) {
+        codeLengthCombined[j] = bitReaderRead(&r, m);
 
-      if (b == codesN - 4 + 1) {
-        b = bPrevious;
         /*
-          fprintf(stderr, "%d repeats %d\n", b, n);
+          fprintf(stderr, "main(): codeLengthCombined[%d] = %d\n", j, codeLengthCombined[j]);
         */
       }
-      else
-        b = 0;
-    }
 
-    while (n > 0) {
-      if (j < 286)
-        codeLengthLiterals[j] = b;
-      else
-        codeLengthDistances[j - 286] = b;
-      j++;
-      n--;
-    }
+      /* create the codes from code lengths */
+      huffmanRecreateCodes(codesN, codeLengthCombined, codeCombined);
 
-    bPrevious = b;
-  }
+      /* free all huffman tree nodes */
+      treeNodesFreeCurrent = 0;
 
-  /* create the codes from code lengths */
-  huffmanRecreateCodes(286, codeLengthLiterals, codeLiterals);
-  huffmanRecreateCodes(30, codeLengthDistances, codeDistances);
+      /* build the huffman tree */
+      huffmanConstructTree(&treeCombined, codeCombined, codeLengthCombined, codesN);
 
-  /* free all huffman tree nodes */
-  treeNodesFreeCurrent = 0;
+      /* inflate */
+      j = 0;
+      bPrevious = 0;
+      while (j < 286 + 30) {
+        b = _decode_tree(&r, treeCombined);
 
-  /* build the huffman trees */
-  huffmanConstructTree(&treeLiterals, codeLiterals, codeLengthLiterals, 286);
-  huffmanConstructTree(&treeDistances, codeDistances, codeLengthDistances, 30);
+        /*
+          fprintf(stderr, "i = %.3d: got %d\n", j, b);
+        */
 
-  /********************************************************************************/
-  /* INFLATE */
-  /********************************************************************************/
+        if (b <= codesN - 4)
+          n = 1;
+        else if (b == codesN - 4 + 1)
+          n = 2;
+        else if (b == codesN - 4 + 2)
+          n = 3;
+        else
+          n = 7;
+
+        /* pump more bits? */
+        if (n > 1) {
+          if (n == 2 || n == 3)
+            m = 3;
+          else
+            m = 11;
+
+          e = bitReaderRead(&r, n);
+
+          /*
+            fprintf(stderr, "e = %d\n", e);
+          */
+
+          n = e + m;
+
+          if (b == codesN - 4 + 1) {
+            b = bPrevious;
+            /*
+              fprintf(stderr, "%d repeats %d\n", b, n);
+            */
+          }
+          else
+            b = 0;
+        }
 
-  /* inflate */
-  j = 0;
-  while (1) {
-    node = treeLiterals;
+        while (n > 0) {
+          if (j < 286)
+            codeLengthLiterals[j] = b;
+          else
+            codeLengthDistances[j - 286] = b;
+          j++;
+          n--;
+        }
 
-    while (node->literal < 0) {
-      /* parse one bit */
-      if (k == -1) {
-        k = 7;
-        i++;
+        bPrevious = b;
       }
 
-      if ((data[i] >> k) & 1)
-        node = node->right;
-      else
-        node = node->left;
+      /* create the codes from code lengths */
+      huffmanRecreateCodes(286, codeLengthLiterals, codeLiterals);
+      huffmanRecreateCodes(30, codeLengthDistances, codeDistances);
 
-      k--;
+      /* free all huffman tree nodes */
+      treeNodesFreeCurrent = 0;
+
+      /* build the huffman trees */
+      huffmanConstructTree(&treeLiterals, codeLiterals, codeLengthLiterals, 286);
+      huffmanConstructTree(&treeDistances, codeDistances, codeLengthDistances, 30);
     }
 
-    b = node->literal;
+    /********************************************************************************/
+    /* INFLATE */
+    /********************************************************************************/
 
-    /* a loose literal? */
-    if (b < 256) {
-      if (outOne == 0) {
-        output[j >> 1] = b;
-        outOne++;
-      }
-      else {
-        output[j >> 1] = (b << 8) | output[j >> 1];
-        outOne = 0;
+    /* inflate */
+    while (1) {
+      if (table != NULL) {
+        b = _decode_symbol(&r, table->literalCounts, table->literals);
+        if (b < 0 || b > 285)
+          return;
       }
-      j++;
-
-      continue;
-    }
+      else
+        b = _decode_tree(&r, treeLiterals);
 
-    /* end of archive? */
-    if (b == 256)
-      break;
+      /* a loose literal? */
+      if (b < 256) {
+        if (outOne == 0) {
+          output[o >> 1] = b;
+          outOne++;
+        }
+        else {
+          output[o >> 1] = (b << 8) | output[o >> 1];
+          outOne = 0;
+        }
+        o++;
 
-    /* ... so it is a [length, distance] tuple... */
-    b -= 257;
+        continue;
+      }
 
-    /* get length */
-    length = baseValueLengths[b];
+      /* end of block? */
+      if (b == 256)
+        break;
 
-    /* parse the extra bits */
-    b = extraBitsLengths[b];
-    if (b > 0) {
-      e = 0;
-      while (b > 0) {
-        if (k == -1) {
-          k = 7;
-          i++;
-        }
+      /* ... so it is a [length, distance] tuple... */
+      b -= 257;
 
-        e = (e << 1) | ((data[i] >> k) & 1);
-        k--;
-        b--;
-      }
+      /* get length */
+      length = baseValueLengths[b];
 
       /* add the extra bits */
-      length += e;
-    }
-
-    /* parse distance */
-    node = treeDistances;
+      length += bitReaderRead(&r, extraBitsLengths[b]);
 
-    while (node->literal < 0) {
-      /* parse one bit */
-      if (k == -1) {
-        k = 7;
-        i++;
+      /* parse distance */
+      if (table != NULL) {
+        b = _decode_symbol(&r, table->distanceCounts, table->distances);
+        if (b < 0)
+          return;
       }
-
-      if ((data[i] >> k) & 1)
-        node = node->right;
       else
-        node = node->left;
-
-      k--;
-    }
-
-    b = node->literal;
-
-    /* get length */
-    distance = baseValueDistances[b];
-
-    /* parse the extra bits */
-    b = extraBitsDistances[b];
-    if (b > 0) {
-      e = 0;
-      while (b > 0) {
-        if (k == -1) {
-          k = 7;
-          i++;
-        }
+        b = _decode_tree(&r, treeDistances);
 
-        e = (e << 1) | ((data[i] >> k) & 1);
-        k--;
-        b--;
-      }
+      /* get length */
+      distance = baseValueDistances[b];
 
       /* add the extra bits */
-      distance += e;
-    }
-
-    /* de-lz77 */
-    n = j - distance;
-    while (length > 0) {
-      if ((n & 1) == 0)
-        b = output[n >> 1] & 0xFF;
-      else
-        b = output[n >> 1] >> 8;
-
-      if (outOne == 0) {
-        output[j >> 1] = b;
-        outOne++;
-      }
-      else {
-        output[j >> 1] = (b << 8) | output[j >> 1];
-        outOne = 0;
+      distance += bitReaderRead(&r, extraBitsDistances[b]);
+
+      /* de-lz77 */
+      n = o - distance;
+      while (length > 0) {
+        if ((n & 1) == 0)
+          b = output[n >> 1] & 0xFF;
+        else
+          b = output[n >> 1] >> 8;
+
+        if (outOne == 0) {
+          output[o >> 1] = b;
+          outOne++;
+        }
+        else {
+          output[o >> 1] = (b << 8) | output[o >> 1];
+          outOne = 0;
+        }
+        o++;
+        n++;
+        length--;
       }
-      j++;
-      n++;
-      length--;
     }
-  }
+  } while (last == 0);
 
   /*
-    fprintf(stderr, "MAIN: Orginal size = %d, uncompressed size = %d.\n", inflatedSize, j);
+    fprintf(stderr, "MAIN: Uncompressed size = %d.\n", o);
   */
 }
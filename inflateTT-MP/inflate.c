@@ -13,8 +13,10 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "inflate.h"
+#include "bitreader.h"
 
 
 /* the number of extra bits in the compressed data */
@@ -42,61 +44,185 @@ static const int baseValueDistances[] = {
 };
 
 
-static void huffmanConstructTree(struct InflateNode **root, int *codes, int *codeLengths, int n, struct InflateContext *context) {
-
-  struct InflateNode *node;
-  int i, j, code;
-
-  /* init the root node */
-  *root = &context->treeNodesFree[context->treeNodesFreeCurrent++];
-  (*root)->left = NULL;
-  (*root)->right = NULL;
-  (*root)->literal = -1;
-
-  /* add the leaves to the tree */
-  for (i = 0; i < n; i++) {
-    /* skip dead leaves */
-    if (codeLengths[i] == 0)
-      continue;
+/* a decoding table entry: the value in the top 16 bits, the type in bits 12-15, the number of extra bits
+   in bits 8-11, and the number of bits the code takes in the low 8 bits. the value is a literal (or a code
+   length), the base of a length or a distance, or where a subtable starts. a subtable entry has the number
+   of bits the subtable is indexed by instead */
+#define ENTRY_LITERAL  0
+#define ENTRY_BASE     1
+#define ENTRY_END      2
+#define ENTRY_SUBTABLE 3
+#define ENTRY_SLOW     4
+#define ENTRY_INVALID  5
+
+#define ENTRY(value, type, extraBits, bits) (((unsigned int)(value) << 16) | ((type) << 12) | ((extraBits) << 8) | (bits))
+#define ENTRY_VALUE(entry)      ((int)((entry) >> 16))
+#define ENTRY_TYPE(entry)       (((entry) >> 12) & 15)
+#define ENTRY_EXTRA_BITS(entry) (((entry) >> 8) & 15)
+#define ENTRY_BITS(entry)       ((entry) & 0xFF)
+
+/* the alphabets the tables are built for */
+#define ALPHABET_LITERALS  0
+#define ALPHABET_DISTANCES 1
+#define ALPHABET_COMBINED  2
+
+/* the longest code the tables decode. deflateTT v1.2 could make longer ones, the rest of such a code is
+   decoded bit by bit (ENTRY_SLOW) */
+#define TABLE_CODE_MAX_BITS 15
+
+/* a block of type 1 names a predefined table set in this many bits */
+#define TABLE_SET_BITS 3
+#define TABLE_SETS_N   3
+
+/* a predefined table set is decoded straight from its counts until it has decoded this many symbols in
+   one call, and only then are its tables built. a small file doesn't pay for building the tables */
+#define TABLE_SET_BUILD_SYMBOLS 2048
+
+/* the match copy can write this many bytes past the end of a match, see _copy_match() */
+#define MATCH_COPY_SLACK 16
+
+/* the decoding loop checks nothing while the output has room for the longest match and its slack, and
+   the input has this many bytes left. a symbol takes 80 bits at most (with the 31-bit codes deflateTT
+   v1.2 could make), and a refill loads 8 bytes */
+#define FAST_OUTPUT_BYTES (258 + MATCH_COPY_SLACK)
+#define FAST_INPUT_BYTES  32
+
+/* the states of a stream, inflateStreamFeed() goes on from where the previous call stopped */
+#define STREAM_HEADER        0
+#define STREAM_BLOCK         1
+#define STREAM_TABLE_SET     2
+#define STREAM_STORED_LENGTH 3
+#define STREAM_STORED        4
+#define STREAM_TREES         5
+#define STREAM_COMBINED      6
+#define STREAM_LENGTHS       7
+#define STREAM_LITERALS      8
+#define STREAM_DISTANCE      9
+#define STREAM_COPY          10
+#define STREAM_END           11
+
+/* a predefined table set: the number of codes of each length, and the symbols in the order of their codes */
+struct InflateTableSet {
+  unsigned short literalCounts[16];
+  unsigned short literals[288];
+  unsigned short distanceCounts[16];
+  unsigned short distances[30];
+};
 
-    /* walk to the leaf's position */
-    node = *root;
-    code = codes[i];
-    for (j = codeLengths[i] - 1; j >= 0; j--) {
-      if (((code >> j) & 1) == 0) {
-        /* left */
-        if (node->left != NULL)
-          node = node->left;
-        else {
-          node->left = &context->treeNodesFree[context->treeNodesFreeCurrent++];
-          node = node->left;
-          node->left = NULL;
-          node->right = NULL;
-          node->literal = -1;
-        }
-      }
-      else {
-        /* right */
-        if (node->right != NULL)
-          node = node->right;
-        else {
-          node->right = &context->treeNodesFree[context->treeNodesFreeCurrent++];
-          node = node->right;
-          node->left = NULL;
-          node->right = NULL;
-          node->literal = -1;
-        }
-      }
+/* the predefined table sets, the same ones deflateTT has in tables.c. 0 is the fixed codes of RFC-1951 */
+static const struct InflateTableSet tableSets[TABLE_SETS_N] = {
+  /* fixed, RFC-1951 section 3.2.6. 286 and 287 are never used, but they have codes */
+  {
+    /* the number of literal/length codes of each length */
+    {
+      0, 0, 0, 0, 0, 0, 0, 24, 152, 112, 0, 0, 0, 0, 0, 0
+    },
+    /* the literals/lengths in code order */
+    {
+      256, 257, 258, 259, 260, 261, 262, 263, 264, 265, 266, 267, 268, 269, 270, 271,
+      272, 273, 274, 275, 276, 277, 278, 279, 0, 1, 2, 3, 4, 5, 6, 7,
+      8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23,
+      24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39,
+      40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 52, 53, 54, 55,
+      56, 57, 58, 59, 60, 61, 62, 63, 64, 65, 66, 67, 68, 69, 70, 71,
+      72, 73, 74, 75, 76, 77, 78, 79, 80, 81, 82, 83, 84, 85, 86, 87,
+      88, 89, 90, 91, 92, 93, 94, 95, 96, 97, 98, 99, 100, 101, 102, 103,
+      104, 105, 106, 107, 108, 109, 110, 111, 112, 113, 114, 115, 116, 117, 118, 119,
+      120, 121, 122, 123, 124, 125, 126, 127, 128, 129, 130, 131, 132, 133, 134, 135,
+      136, 137, 138, 139, 140, 141, 142, 143, 280, 281, 282, 283, 284, 285, 286, 287,
+      144, 145, 146, 147, 148, 149, 150, 151, 152, 153, 154, 155, 156, 157, 158, 159,
+      160, 161, 162, 163, 164, 165, 166, 167, 168, 169, 170, 171, 172, 173, 174, 175,
+      176, 177, 178, 179, 180, 181, 182, 183, 184, 185, 186, 187, 188, 189, 190, 191,
+      192, 193, 194, 195, 196, 197, 198, 199, 200, 201, 202, 203, 204, 205, 206, 207,
+      208, 209, 210, 211, 212, 213, 214, 215, 216, 217, 218, 219, 220, 221, 222, 223,
+      224, 225, 226, 227, 228, 229, 230, 231, 232, 233, 234, 235, 236, 237, 238, 239,
+      240, 241, 242, 243, 244, 245, 246, 247, 248, 249, 250, 251, 252, 253, 254, 255
+    },
+    /* the number of distance codes of each length */
+    {
+      0, 0, 0, 0, 0, 30, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+    },
+    /* the distances in code order */
+    {
+      0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+      16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29
+    }
+  },
+  /* text */
+  {
+    /* the number of literal/length codes of each length */
+    {
+      0, 0, 0, 0, 2, 10, 14, 24, 23, 21, 13, 12, 6, 5, 0, 156
+    },
+    /* the literals/lengths in code order */
+    {
+      32, 257, 97, 101, 105, 111, 114, 115, 116, 258, 259, 260, 10, 46, 99, 100,
+      108, 109, 110, 112, 117, 261, 262, 263, 265, 269, 44, 47, 65, 67, 69, 73,
+      76, 78, 79, 82, 83, 84, 95, 98, 102, 103, 104, 119, 121, 264, 266, 267,
+      268, 270, 34, 39, 40, 41, 42, 45, 48, 49, 50, 58, 66, 68, 70, 77,
+      80, 85, 107, 118, 120, 256, 271, 272, 273, 35, 51, 52, 54, 56, 59, 60,
+      61, 62, 71, 72, 86, 87, 89, 91, 92, 93, 124, 274, 275, 277, 43, 53,
+      55, 57, 63, 64, 75, 106, 113, 122, 123, 125, 276, 33, 37, 38, 74, 88,
+      94, 96, 126, 278, 279, 281, 285, 36, 81, 90, 280, 282, 283, 9, 169, 194,
+      195, 284, 0, 1, 2, 3, 4, 5, 6, 7, 8, 11, 12, 13, 14, 15,
+      16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31,
+      127, 128, 129, 130, 131, 132, 133, 134, 135, 136, 137, 138, 139, 140, 141, 142,
+      143, 144, 145, 146, 147, 148, 149, 150, 151, 152, 153, 154, 155, 156, 157, 158,
+      159, 160, 161, 162, 163, 164, 165, 166, 167, 168, 170, 171, 172, 173, 174, 175,
+      176, 177, 178, 179, 180, 181, 182, 183, 184, 185, 186, 187, 188, 189, 190, 191,
+      192, 193, 196, 197, 198, 199, 200, 201, 202, 203, 204, 205, 206, 207, 208, 209,
+      210, 211, 212, 213, 214, 215, 216, 217, 218, 219, 220, 221, 222, 223, 224, 225,
+      226, 227, 228, 229, 230, 231, 232, 233, 234, 235, 236, 237, 238, 239, 240, 241,
+      242, 243, 244, 245, 246, 247, 248, 249, 250, 251, 252, 253, 254, 255
+    },
+    /* the number of distance codes of each length */
+    {
+      0, 0, 0, 0, 11, 6, 6, 3, 1, 1, 2, 0, 0, 0, 0, 0
+    },
+    /* the distances in code order */
+    {
+      10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 8, 9, 21, 22, 23,
+      24, 0, 5, 6, 7, 25, 26, 4, 27, 28, 29, 3, 1, 2
+    }
+  },
+  /* binary */
+  {
+    /* the number of literal/length codes of each length */
+    {
+      0, 0, 0, 1, 1, 3, 6, 22, 47, 88, 90, 17, 3, 4, 4, 0
+    },
+    /* the literals/lengths in code order */
+    {
+      257, 258, 259, 260, 261, 0, 72, 232, 262, 265, 267, 1, 2, 15, 32, 65,
+      76, 97, 101, 114, 115, 116, 117, 131, 137, 139, 141, 233, 255, 263, 264, 266,
+      270, 3, 4, 5, 6, 8, 10, 14, 16, 24, 36, 40, 45, 46, 48, 49,
+      56, 57, 61, 64, 68, 69, 73, 77, 80, 84, 95, 98, 99, 100, 102, 104,
+      105, 108, 109, 110, 111, 112, 120, 128, 132, 133, 144, 192, 235, 248, 269, 285,
+      7, 9, 11, 12, 13, 17, 18, 20, 21, 26, 28, 29, 31, 34, 37, 41,
+      44, 47, 50, 51, 52, 53, 54, 58, 59, 60, 63, 66, 67, 70, 71, 74,
+      78, 79, 82, 83, 85, 86, 88, 91, 92, 93, 96, 103, 107, 118, 119, 121,
+      124, 129, 134, 136, 140, 152, 160, 168, 176, 182, 184, 186, 190, 193, 194, 195,
+      196, 197, 198, 199, 200, 201, 208, 210, 216, 224, 230, 236, 237, 239, 240, 246,
+      247, 249, 250, 251, 252, 253, 254, 268, 19, 22, 23, 25, 27, 30, 33, 35,
+      38, 39, 42, 43, 55, 62, 75, 81, 87, 89, 90, 94, 106, 113, 122, 123,
+      125, 126, 127, 130, 135, 138, 142, 143, 145, 146, 148, 149, 150, 151, 153, 154,
+      156, 162, 164, 166, 170, 172, 175, 178, 180, 183, 185, 187, 188, 189, 191, 202,
+      203, 204, 205, 206, 207, 209, 211, 212, 213, 214, 215, 217, 218, 219, 220, 221,
+      222, 223, 225, 226, 227, 228, 229, 231, 234, 238, 241, 242, 243, 244, 245, 271,
+      272, 273, 147, 155, 157, 158, 159, 161, 163, 165, 167, 169, 171, 173, 174, 177,
+      179, 181, 274, 275, 276, 277, 256, 278, 280, 281, 279, 282, 283, 284
+    },
+    /* the number of distance codes of each length */
+    {
+      0, 0, 0, 0, 8, 13, 5, 1, 1, 2, 0, 0, 0, 0, 0, 0
+    },
+    /* the distances in code order */
+    {
+      5, 7, 8, 10, 11, 12, 14, 16, 9, 13, 15, 17, 18, 19, 20, 21,
+      22, 23, 24, 25, 26, 0, 3, 6, 27, 28, 29, 4, 1, 2
     }
-
-    /* turn this node into a leaf */
-    node->literal = i;
   }
-
-  /*
-    fprintf(stderr, "HUFFMANCONSTRUCTTREE: Used %d nodes.\n", context->treeNodesFreeCurrent);
-  */
-}
+};
 
 
 static void huffmanRecreateCodes(int n, int *lengths, int *codes, struct InflateContext *context) {
@@ -142,301 +268,1473 @@ static void huffmanRecreateCodes(int n, int *lengths, int *codes, struct Inflate
 }
 
 
-int inflate(unsigned char *data, unsigned char *output, struct InflateContext *context) {
+/* the table entry of a symbol, whose code takes the given number of bits */
+static unsigned int _make_entry(int symbol, int alphabet, int bits) {
+
+  if (alphabet == ALPHABET_COMBINED)
+    return ENTRY(symbol, ENTRY_LITERAL, 0, bits);
+
+  if (alphabet == ALPHABET_DISTANCES)
+    return ENTRY(baseValueDistances[symbol], ENTRY_BASE, extraBitsDistances[symbol], bits);
+
+  if (symbol < 256)
+    return ENTRY(symbol, ENTRY_LITERAL, 0, bits);
+  if (symbol == 256)
+    return ENTRY(0, ENTRY_END, 0, bits);
+  if (symbol < 286)
+    return ENTRY(baseValueLengths[symbol - 257], ENTRY_BASE, extraBitsLengths[symbol - 257], bits);
+
+  /* 286 and 287 have codes in the fixed table set, but they are never used */
+  return ENTRY(0, ENTRY_INVALID, 0, 0);
+}
+
+
+/* builds the codes and the decoding table out of the code lengths. the codes are canonical and read
+   the most significant bit first, so the primary table is indexed by the next bits as they are, and a
+   code shorter than that fills all the entries that start with it. the codes longer than the primary
+   table get a subtable for each prefix, as big as the longest code under it needs.
+   returns INFLATE_OVERSUBSCRIBED if the codes don't fit into the code space */
+static int _build_table(unsigned int *table, int size, int bitsMax, int *tableBits, int *lengths, int *codes, int n, int alphabet,
+                        struct InflateContext *context) {
+
+  unsigned char subtableBits[1 << INFLATE_TABLE_LITERALS_BITS];
+  unsigned int entry;
+  int counts[HUFFMAN_CODE_MAX_BITS];
+  int i, j, bits, length, lengthMax, count, left, prefix, first, start, next;
+
+  for (length = 0; length < HUFFMAN_CODE_MAX_BITS; length++)
+    counts[length] = 0;
+
+  lengthMax = 0;
+  for (i = 0; i < n; i++) {
+    if (lengths[i] < 0 || lengths[i] >= HUFFMAN_CODE_MAX_BITS)
+      return INFLATE_CORRUPTED;
+    counts[lengths[i]]++;
+    if (lengthMax < lengths[i])
+      lengthMax = lengths[i];
+  }
+
+  /* the code lengths must not over-subscribe the code space, but it can be left incomplete */
+  left = 1;
+  for (length = 1; length <= lengthMax && left <= n; length++) {
+    left = (left << 1) - counts[length];
+    if (left < 0)
+      return INFLATE_OVERSUBSCRIBED;
+  }
+
+  huffmanRecreateCodes(n, lengths, codes, context);
+
+  bits = (lengthMax < bitsMax) ? lengthMax : bitsMax;
+  if (bits == 0)
+    bits = 1;
+  *tableBits = bits;
+
+  for (i = 0; i < (1 << bits); i++) {
+    table[i] = ENTRY(0, ENTRY_INVALID, 0, 0);
+    subtableBits[i] = 0;
+  }
+
+  /* the short codes go straight into the primary table, the long ones tell how big their subtables are */
+  for (i = 0; i < n; i++) {
+    length = lengths[i];
+    if (length == 0)
+      continue;
+
+    if (length <= bits) {
+      entry = _make_entry(i, alphabet, length);
+      first = codes[i] << (bits - length);
+      for (j = 0; j < (1 << (bits - length)); j++)
+        table[first + j] = entry;
+      continue;
+    }
+
+    prefix = codes[i] >> (length - bits);
+    if (length > TABLE_CODE_MAX_BITS)
+      length = TABLE_CODE_MAX_BITS;
+    if (subtableBits[prefix] < length - bits)
+      subtableBits[prefix] = length - bits;
+  }
+
+  /* the subtables follow the primary table */
+  next = 1 << bits;
+  for (i = 0; i < (1 << bits); i++) {
+    if (subtableBits[i] == 0)
+      continue;
+
+    if (next + (1 << subtableBits[i]) > size)
+      return INFLATE_CORRUPTED;
+
+    table[i] = ENTRY(next, ENTRY_SUBTABLE, 0, subtableBits[i]);
+    for (j = 0; j < (1 << subtableBits[i]); j++)
+      table[next + j] = ENTRY(0, ENTRY_INVALID, 0, 0);
+    next += 1 << subtableBits[i];
+  }
+
+  for (i = 0; i < n; i++) {
+    length = lengths[i];
+    if (length <= bits)
+      continue;
+
+    prefix = codes[i] >> (length - bits);
+    start = ENTRY_VALUE(table[prefix]);
+    j = ENTRY_BITS(table[prefix]);
+
+    if (length <= TABLE_CODE_MAX_BITS) {
+      /* the subtable is indexed by the bits after the prefix */
+      entry = _make_entry(i, alphabet, length - bits);
+      first = start + ((codes[i] & ((1 << (length - bits)) - 1)) << (j - (length - bits)));
+      for (count = 0; count < (1 << (j - (length - bits))); count++)
+        table[first + count] = entry;
+    }
+    else {
+      /* the entry keeps the first TABLE_CODE_MAX_BITS bits, the rest of the code is read bit by bit */
+      first = codes[i] >> (length - TABLE_CODE_MAX_BITS);
+      table[start + (first & ((1 << j) - 1))] = ENTRY(first, ENTRY_SLOW, 0, j);
+    }
+  }
+
+  return INFLATE_OK;
+}
+
+
+/* looks up the entry of the next code using the bits there are, the missing ones read as zeros. a byte is
+   loaded until the entry fits into the bits, so only the bytes of the code are read */
+static unsigned int _lookup_lazy(struct bitReader *r, const unsigned int *table, int bits) {
+
+  unsigned int entry;
+  int n;
+
+  while (1) {
+    entry = table[BIT_READER_PEEK(r, bits)];
+
+    /* a subtable needs all of its prefix, and a code that isn't there may still be a longer one */
+    n = ENTRY_BITS(entry);
+    if (ENTRY_TYPE(entry) == ENTRY_SUBTABLE || ENTRY_TYPE(entry) == ENTRY_INVALID)
+      n = bits;
+
+    if (n <= r->bitsN)
+      return entry;
+
+    bitReaderNeed(r, r->bitsN + 1);
+  }
+}
+
+
+/* _decode() when the end of the input isn't known, and the bit buffer isn't filled ahead */
+static unsigned int _decode_lazy(struct bitReader *r, const unsigned int *table, int bits) {
+
+  unsigned int entry;
+
+  entry = _lookup_lazy(r, table, bits);
+  if (ENTRY_TYPE(entry) == ENTRY_SUBTABLE) {
+    BIT_READER_SKIP(r, bits);
+    entry = _lookup_lazy(r, table + ENTRY_VALUE(entry), ENTRY_BITS(entry));
+  }
+
+  BIT_READER_SKIP(r, ENTRY_BITS(entry));
+
+  return entry;
+}
+
+
+/* decodes the next code using the table, and moves past it. returns its entry. the bit buffer must have
+   TABLE_CODE_MAX_BITS bits, unless the end of the input isn't known */
+static unsigned int _decode(struct bitReader *r, const unsigned int *table, int bits) {
+
+  unsigned int entry;
+
+  if (r->bitsN < TABLE_CODE_MAX_BITS)
+    return _decode_lazy(r, table, bits);
+
+  entry = table[BIT_READER_PEEK(r, bits)];
+  if (ENTRY_TYPE(entry) == ENTRY_SUBTABLE) {
+    BIT_READER_SKIP(r, bits);
+    entry = table[ENTRY_VALUE(entry) + BIT_READER_PEEK(r, ENTRY_BITS(entry))];
+  }
+
+  BIT_READER_SKIP(r, ENTRY_BITS(entry));
+
+  return entry;
+}
+
+
+/* decodes the rest of a code longer than TABLE_CODE_MAX_BITS, one bit at a time */
+static unsigned int _decode_slow(struct bitReader *r, unsigned int entry, int *lengths, int *codes, int n, int alphabet) {
+
+  int code, length, j;
+
+  code = ENTRY_VALUE(entry);
+  for (length = TABLE_CODE_MAX_BITS + 1; length < HUFFMAN_CODE_MAX_BITS; length++) {
+    code = (code << 1) | bitReaderRead(r, 1);
+    for (j = 0; j < n; j++) {
+      if (lengths[j] == length && codes[j] == code)
+        return _make_entry(j, alphabet, 0);
+    }
+  }
+
+  return ENTRY(0, ENTRY_INVALID, 0, 0);
+}
+
+
+/* decodes a symbol of a predefined table set straight from the counts, and returns its table entry. the
+   codes are canonical, so the codes of each length follow the codes of the previous length. the bit
+   buffer must have 15 bits, unless the end of the input isn't known */
+static unsigned int _decode_from_counts(struct bitReader *r, const unsigned short *counts, const unsigned short *symbols, int alphabet) {
+
+  unsigned int bits;
+  int code, first, index, length;
+
+  bits = BIT_READER_PEEK(r, 15);
+  code = 0;
+  first = 0;
+  index = 0;
+  for (length = 1; length < 16; length++) {
+    if (length > r->bitsN) {
+      bitReaderNeed(r, length);
+      bits = BIT_READER_PEEK(r, 15);
+    }
+
+    code |= (bits >> (15 - length)) & 1;
+
+    if (code - first < counts[length]) {
+      BIT_READER_SKIP(r, length);
+      return _make_entry(symbols[index + code - first], alphabet, 0);
+    }
+
+    index += counts[length];
+    first = (first + counts[length]) << 1;
+    code <<= 1;
+  }
+
+  return ENTRY(0, ENTRY_INVALID, 0, 0);
+}
+
+
+/* expands the counts of a predefined table set into code lengths */
+static void _table_set_lengths(const unsigned short *counts, const unsigned short *symbols, int *lengths, int n) {
+
+  int i, length, index;
+
+  for (i = 0; i < n; i++)
+    lengths[i] = 0;
+
+  index = 0;
+  for (length = 1; length < 16; length++) {
+    for (i = 0; i < counts[length]; i++)
+      lengths[symbols[index++]] = length;
+  }
+}
+
+
+/* builds the tables of a predefined table set, unless they are still there from the previous block */
+static int _build_table_set(int set, struct InflateContext *context) {
+
+  const struct InflateTableSet *t = &tableSets[set];
+
+  if (context->tableSet == set)
+    return INFLATE_OK;
+
+  _table_set_lengths(t->literalCounts, t->literals, context->codeLengthLiterals, 288);
+  _table_set_lengths(t->distanceCounts, t->distances, context->codeLengthDistances, 30);
+
+  if (_build_table(context->tableLiterals, INFLATE_TABLE_LITERALS_SIZE, INFLATE_TABLE_LITERALS_BITS, &context->tableLiteralsBits,
+                   context->codeLengthLiterals, context->codeLiterals, 288, ALPHABET_LITERALS, context) != INFLATE_OK ||
+      _build_table(context->tableDistances, INFLATE_TABLE_DISTANCES_SIZE, INFLATE_TABLE_DISTANCES_BITS, &context->tableDistancesBits,
+                   context->codeLengthDistances, context->codeDistances, 30, ALPHABET_DISTANCES, context) != INFLATE_OK)
+    return INFLATE_CORRUPTED;
+
+  context->tableSet = set;
+
+  return INFLATE_OK;
+}
+
+
+/* the dictionary must stay in memory as long as it's used, only the last 32K of it can be reached */
+void inflateDictionaryInit(struct InflateDictionary *dictionary, unsigned char *data, int size) {
+
+  unsigned int a = 1, b = 0;
+  int i;
+
+  if (size > 0x8000) {
+    data += size - 0x8000;
+    size = 0x8000;
+  }
+
+  /* Adler-32 */
+  for (i = 0; i < size; i++) {
+    a = (a + data[i]) % 65521;
+    b = (b + a) % 65521;
+  }
+
+  dictionary->data = data;
+  dictionary->size = size;
+  dictionary->id = ((b << 16) | a) & 0xFFFFFFFF;
+}
+
+
+/* copies a match of length bytes from distance bytes back, without checking the end of the output. the
+   matches 16 and 8 bytes back, or further, are copied 16 and 8 bytes at a time, a run of one byte is a
+   memset(), and the pattern of a shorter distance is first repeated one byte at a time until it's at
+   least 8 bytes long. writes up to MATCH_COPY_SLACK - 1 bytes of garbage past the match */
+static void _copy_match(unsigned char *output, int distance, int length) {
+
+  unsigned char *source = output - distance, *end = output + length;
+  int i, step;
+
+  if (distance >= 16) {
+    do {
+      memcpy(output, source, 16);
+      output += 16;
+      source += 16;
+    } while (output < end);
+    return;
+  }
+
+  if (distance == 1) {
+    memset(output, *source, length);
+    return;
+  }
+
+  if (distance < 8) {
+    step = distance;
+    while (step < 8)
+      step += distance;
+
+    for (i = 0; i < step; i++)
+      output[i] = source[i];
+
+    /* the output repeats itself every step bytes from here on */
+    source = output;
+    output += step;
+  }
+
+  while (output < end) {
+    memcpy(output, source, 8);
+    output += 8;
+    source += 8;
+  }
+}
 
-  int i, j, k, m, n, length, b, e, distance, inflatedSize, codesN, bPrevious;
-  struct InflateNode *node;
 
-  /* reset the context */
-  context->treeLiterals = NULL;
-  context->treeDistances = NULL;
-  context->treeCombined = NULL;
+/* dataSize and outputSize are -1 if they aren't known, then nothing is checked against them, and the input
+   is read a byte at a time so that nothing past it is read. the number of bytes inflated goes to *outputN,
+   if it isn't NULL */
+static int _inflate(unsigned char *data, int dataSize, unsigned char *output, int outputSize, int *outputN,
+                    struct InflateDictionary *dictionary, struct InflateContext *context) {
+
+  int i, j, m, n, o, length, b, e, distance, inflatedSize, codesN, bPrevious, last, flags, tableSet, fromCounts, setSymbols;
+  int outputLimit, outputFast, careful;
+  unsigned int id, entry;
+  const struct InflateTableSet *set;
+  struct bitReader r;
+  unsigned char *stored, *end;
+
+  /* the tables of a predefined table set are kept between the blocks, but not between the calls */
+  context->tableSet = -1;
 
   /********************************************************************************/
   /* HUFFMAN */
   /********************************************************************************/
 
+  end = (dataSize >= 0) ? data + dataSize : NULL;
+
   /* check header */
-  if (data[0] != 'D' || data[1] != 'E' || data[2] != 'F' || data[3] != 'c')
+  if (end != NULL && dataSize < 5)
+    return INFLATE_TRUNCATED;
+  if (data[0] != 'D' || data[1] != 'E' || data[2] != 'F' || (data[3] != 'c' && data[3] != 'd'))
     return INFLATE_WRONG_HEADER;
 
   i = 4;
 
-  /* parse inflated size */
-  inflatedSize = data[i] | (data[i+1] << 8) | (data[i+2] << 16) | (data[i+3] << 24);
-  i += 4;
+  /* DEFd has flags: 1 - the size is a u64, 2 - there is no size, 4 - a preset dictionary was used */
+  flags = 0;
+  if (data[3] == 'd')
+    flags = data[i++];
 
-  /*
-    fprintf(stderr, "inflate(): Inflated size = %d\n", inflatedSize);
-  */
+  if ((flags & 3) == 3 || flags > 7)
+    return INFLATE_UNSUPPORTED;
 
-  /* read the number of code lengths */
-  codesN = data[i++];
+  if (end != NULL && dataSize < i + ((flags & 2) == 0 ? 4 : 0) + ((flags & 1) == 1 ? 4 : 0) + ((flags & 4) == 4 ? 4 : 0))
+    return INFLATE_TRUNCATED;
 
-  /* read bits per code length */
-  k = 7;
+  /* parse inflated size. the caller knows it anyway, but it tells where the match copy must slow down,
+     unless it doesn't fit into an int */
+  inflatedSize = -1;
+  if ((flags & 2) == 0) {
+    inflatedSize = (data[i+3] < 0x80) ? (data[i] | (data[i+1] << 8) | (data[i+2] << 16) | (data[i+3] << 24)) : -1;
+    i += 4;
+  }
+  if ((flags & 1) == 1) {
+    if (data[i] != 0 || data[i+1] != 0 || data[i+2] != 0 || data[i+3] != 0)
+      inflatedSize = -1;
+    i += 4;
+  }
 
-  m = 0;
-  for (n = 0; n < 3; n++) {
-    /* parse one bit */
-    b = (data[i] >> k) & 1;
-    k--;
+  /* the dictionary must be the one the file was compressed with */
+  if ((flags & 4) == 4) {
+    id = data[i] | (data[i+1] << 8) | (data[i+2] << 16) | ((unsigned int)data[i+3] << 24);
+    i += 4;
 
-    m = (m << 1) | b;
+    if (dictionary == NULL || dictionary->id != id)
+      return INFLATE_WRONG_DICTIONARY;
   }
 
   /*
-    fprintf(stderr, "inflate(): Number of items = %d. Bits per item = %d.\n", codesN, m);
+    fprintf(stderr, "inflate(): Inflated size = %d\n", inflatedSize);
   */
 
-  /* read the combined code lengths */
-  for (j = 0; j < codesN; j++) {
-    context->codeLengthCombined[j] = 0;
+  /* the decoding loop checks nothing while o <= outputFast and the input has FAST_INPUT_BYTES left. when
+     the output size isn't given, the header tells where the match copy must slow down */
+  outputLimit = (outputSize >= 0) ? outputSize : 0x7FFFFFFF;
+  if (outputSize >= 0)
+    outputFast = outputSize - FAST_OUTPUT_BYTES;
+  else if (inflatedSize >= 0)
+    outputFast = inflatedSize - FAST_OUTPUT_BYTES;
+  else
+    outputFast = -1;
+
+  bitReaderInit(&r, data + i, end);
+  o = 0;
+  last = 1;
+  setSymbols = 0;
+
+  /* DEFc files have one block, DEFd files have a sequence of them */
+  do {
+    tableSet = -1;
+
+    if (data[3] == 'd') {
+      /* is this the last block? */
+      last = bitReaderRead(&r, 1);
+
+      /* block type */
+      b = bitReaderRead(&r, 2);
+
+      /* a stored block is byte aligned, and its bytes are copied as they are */
+      if (b == 0) {
+        stored = bitReaderAlign(&r);
+        if (end != NULL && end - stored < 4)
+          return INFLATE_TRUNCATED;
+
+        length = stored[0] | (stored[1] << 8);
+        if ((stored[2] | (stored[3] << 8)) != (~length & 0xFFFF))
+          return INFLATE_CORRUPTED;
+        if (end != NULL && end - stored - 4 < length)
+          return INFLATE_TRUNCATED;
+        if (length > outputLimit - o)
+          return INFLATE_OVERFLOW;
+
+        memcpy(output + o, stored + 4, length);
+        o += length;
+        r.next += 4 + length;
+        continue;
+      }
 
-    for (n = 0; n < m; n++) {
-      /* parse one bit */
-      if (k == -1) {
-        k = 7;
-        i++;
+      /* a predefined table set instead of the trees */
+      if (b == 1) {
+        tableSet = bitReaderRead(&r, TABLE_SET_BITS);
+        if (tableSet >= TABLE_SETS_N)
+          return INFLATE_UNSUPPORTED;
       }
+      else if (b != 2)
+        return INFLATE_UNSUPPORTED;
+    }
 
-      b = (data[i] >> k) & 1;
-      k--;
+    /* a predefined table set is ready to be used as it is, otherwise read the trees */
+    if (tableSet < 0) {
+      /* read the number of code lengths */
+      codesN = bitReaderRead(&r, 8);
 
-      context->codeLengthCombined[j] = (context->codeLengthCombined[j] << 1) | b;
-    }
+      /* read bits per code length */
+      m = bitReaderRead(&r, 3);
 
-    /*
-      fprintf(stderr, "inflate(): context->codeLengthCombined[%d] = %d\n", j, context->codeLengthCombined[j]);
-    */
-  }
+      /*
+        fprintf(stderr, "inflate(): Number of items = %d. Bits per item = %d.\n", codesN, m);
+      */
 
-  /* create the codes from code lengths */
-  huffmanRecreateCodes(codesN, context->codeLengthCombined, context->codeCombined, context);
+      /* read the combined code lengths */
+      if (codesN > 119)
+        return INFLATE_CORRUPTED;
+      for (j = 0; j < codesN; j++)
+        context->codeLengthCombined[j] = bitReaderRead(&r, m);
+
+      /* build the table of the code length codes */
+      b = _build_table(context->tableCombined, INFLATE_TABLE_COMBINED_SIZE, INFLATE_TABLE_COMBINED_BITS, &context->tableCombinedBits,
+                       context->codeLengthCombined, context->codeCombined, codesN, ALPHABET_COMBINED, context);
+      if (b != INFLATE_OK)
+        return b;
+
+      /* inflate */
+      j = 0;
+      bPrevious = 0;
+      while (j < 286 + 30) {
+        bitReaderRefill(&r);
+        entry = _decode(&r, context->tableCombined, context->tableCombinedBits);
+        if (ENTRY_TYPE(entry) == ENTRY_SLOW)
+          entry = _decode_slow(&r, entry, context->codeLengthCombined, context->codeCombined, codesN, ALPHABET_COMBINED);
+        if (ENTRY_TYPE(entry) != ENTRY_LITERAL)
+          return INFLATE_CORRUPTED;
+
+        b = ENTRY_VALUE(entry);
 
-  /* free all huffman tree nodes */
-  context->treeNodesFreeCurrent = 0;
+        /*
+          fprintf(stderr, "i = %.3d: got %d\n", j, b);
+        */
 
-  /* build the huffman tree */
-  huffmanConstructTree(&context->treeCombined, context->codeCombined, context->codeLengthCombined, codesN, context);
+        if (b <= codesN - 4)
+          n = 1;
+        else if (b == codesN - 4 + 1)
+          n = 2;
+        else if (b == codesN - 4 + 2)
+          n = 3;
+        else
+          n = 7;
+
+        /* pump more bits? */
+        if (n > 1) {
+          if (n == 2 || n == 3)
+            m = 3;
+          else
+            m = 11;
+
+          e = bitReaderRead(&r, n);
+
+          /*
+            fprintf(stderr, "e = %d\n", e);
+          */
+
+          n = e + m;
+
+          if (b == codesN - 4 + 1) {
+            b = bPrevious;
+            /*
+              fprintf(stderr, "%d repeats %d\n", b, n);
+            */
+          }
+          else
+            b = 0;
+        }
 
-  /* inflate */
-  j = 0;
-  bPrevious = 0;
-  while (j < 286 + 30) {
-    node = context->treeCombined;
+        /* a repeat can't run past the last code length */
+        if (j + n > 286 + 30)
+          return INFLATE_CORRUPTED;
+
+        while (n > 0) {
+          if (j < 286)
+            context->codeLengthLiterals[j] = b;
+          else
+            context->codeLengthDistances[j - 286] = b;
+          j++;
+          n--;
+        }
 
-    while (node->literal < 0) {
-      /* parse one bit */
-      if (k == -1) {
-        k = 7;
-        i++;
+        bPrevious = b;
       }
 
-      if ((data[i] >> k) & 1)
-        node = node->right;
-      else
-        node = node->left;
-
-      k--;
+      /* the trees must not have been cut short */
+      if (BIT_READER_PAST_END(&r))
+        return INFLATE_TRUNCATED;
+
+      /* build the tables, they replace the ones of the predefined table set */
+      context->tableSet = -1;
+      b = _build_table(context->tableLiterals, INFLATE_TABLE_LITERALS_SIZE, INFLATE_TABLE_LITERALS_BITS, &context->tableLiteralsBits,
+                       context->codeLengthLiterals, context->codeLiterals, 286, ALPHABET_LITERALS, context);
+      if (b == INFLATE_OK)
+        b = _build_table(context->tableDistances, INFLATE_TABLE_DISTANCES_SIZE, INFLATE_TABLE_DISTANCES_BITS, &context->tableDistancesBits,
+                         context->codeLengthDistances, context->codeDistances, 30, ALPHABET_DISTANCES, context);
+      if (b != INFLATE_OK)
+        return b;
     }
 
-    b = node->literal;
+    /* unless its tables are already there, a predefined table set starts decoding straight from its counts */
+    fromCounts = (tableSet >= 0 && context->tableSet != tableSet) ? 1 : 0;
+    set = (tableSet >= 0) ? &tableSets[tableSet] : NULL;
 
-    /*
-      fprintf(stderr, "i = %.3d: got %d\n", j, b);
-    */
+    /* inflate */
+    while (1) {
+      /* a refill has the bits of a whole [length, distance] tuple, unless its codes are decoded slowly */
+      bitReaderRefill(&r);
 
-    if (b <= codesN - 4)
-      n = 1;
-    else if (b == codesN - 4 + 1)
-      n = 2;
-    else if (b == codesN - 4 + 2)
-      n = 3;
-    else
-      n = 7;
+      /* near the end of the output or the input, every symbol is checked */
+      careful = (o > outputFast || (end != NULL && end - r.next < FAST_INPUT_BYTES)) ? 1 : 0;
+      if (careful == 1 && BIT_READER_PAST_END(&r))
+        return INFLATE_TRUNCATED;
 
-    /* pump more bits? */
-    if (n > 1) {
-      if (n == 2 || n == 3)
-        m = 3;
-      else
-        m = 11;
+      if (fromCounts == 1 && setSymbols < TABLE_SET_BUILD_SYMBOLS) {
+        entry = _decode_from_counts(&r, set->literalCounts, set->literals, ALPHABET_LITERALS);
+        setSymbols++;
+      }
+      else {
+        if (fromCounts == 1) {
+          /* the set is used enough to pay for its tables */
+          b = _build_table_set(tableSet, context);
+          if (b != INFLATE_OK)
+            return b;
+          fromCounts = 0;
+        }
 
-      e = 0;
+        entry = _decode(&r, context->tableLiterals, context->tableLiteralsBits);
+        if (ENTRY_TYPE(entry) == ENTRY_SLOW)
+          entry = _decode_slow(&r, entry, context->codeLengthLiterals, context->codeLiterals, 286, ALPHABET_LITERALS);
+      }
 
-      while (n > 0) {
-        /* parse one bit */
-        if (k == -1) {
-          k = 7;
-          i++;
-        }
+      /*
+        fprintf(stderr, "inflate(): %d\n", ENTRY_VALUE(entry));
+      */
+
+      /* a loose literal? */
+      if (ENTRY_TYPE(entry) == ENTRY_LITERAL) {
+        if (careful == 1 && o >= outputLimit)
+          return BIT_READER_PAST_END(&r) ? INFLATE_TRUNCATED : INFLATE_OVERFLOW;
+        output[o++] = ENTRY_VALUE(entry);
+        continue;
+      }
+
+      /* end of block? */
+      if (ENTRY_TYPE(entry) == ENTRY_END)
+        break;
 
-        e = (e << 1) | ((data[i] >> k) & 1);
+      if (ENTRY_TYPE(entry) != ENTRY_BASE)
+        return INFLATE_CORRUPTED;
 
-        k--;
-        n--;
+      /* ... so it is a [length, distance] tuple. the entry has the base length and the number of extra bits */
+      length = ENTRY_VALUE(entry) + bitReaderRead(&r, ENTRY_EXTRA_BITS(entry));
+
+      /*
+        fprintf(stderr, "  length = %d\n", length);
+      */
+
+      /* parse distance */
+      if (r.bitsN < TABLE_CODE_MAX_BITS)
+        bitReaderRefill(&r);
+
+      if (fromCounts == 1)
+        entry = _decode_from_counts(&r, set->distanceCounts, set->distances, ALPHABET_DISTANCES);
+      else {
+        entry = _decode(&r, context->tableDistances, context->tableDistancesBits);
+        if (ENTRY_TYPE(entry) == ENTRY_SLOW)
+          entry = _decode_slow(&r, entry, context->codeLengthDistances, context->codeDistances, 30, ALPHABET_DISTANCES);
       }
+      if (ENTRY_TYPE(entry) != ENTRY_BASE)
+        return INFLATE_CORRUPTED;
+
+      distance = ENTRY_VALUE(entry) + bitReaderRead(&r, ENTRY_EXTRA_BITS(entry));
 
       /*
-        fprintf(stderr, "e = %d\n", e);
+        fprintf(stderr, "  distance = %d\n", distance);
       */
 
-      n = e + m;
+      /* de-lz77 */
+      if (careful == 1 && length > outputLimit - o)
+        return BIT_READER_PAST_END(&r) ? INFLATE_TRUNCATED : INFLATE_OVERFLOW;
 
-      if (b == codesN - 4 + 1) {
-        b = bPrevious;
-        /*
-          fprintf(stderr, "%d repeats %d\n", b, n);
-        */
+      n = o - distance;
+
+      /* does the match start in the dictionary? */
+      if (n < 0) {
+        if (dictionary == NULL || -n > dictionary->size)
+          return INFLATE_BAD_DISTANCE;
+
+        m = dictionary->size + n;
+        while (n < 0 && length > 0) {
+          output[o++] = dictionary->data[m++];
+          n++;
+          length--;
+        }
+
+        /* the match may end in the dictionary as well */
+        if (length == 0)
+          continue;
       }
-      else
-        b = 0;
-    }
 
-    while (n > 0) {
-      if (j < 286)
-        context->codeLengthLiterals[j] = b;
-      else
-        context->codeLengthDistances[j - 286] = b;
-      j++;
-      n--;
+      /* the last matches, and all of them if the size isn't known, are copied without writing past them */
+      if (careful == 0)
+        _copy_match(output + o, distance, length);
+      else if (distance >= length)
+        memcpy(output + o, output + n, length);
+      else {
+        for (b = 0; b < length; b++)
+          output[o + b] = output[n + b];
+      }
+      o += length;
     }
 
-    bPrevious = b;
+    /* the block must have ended before the input did */
+    if (BIT_READER_PAST_END(&r))
+      return INFLATE_TRUNCATED;
+  } while (last == 0);
+
+  /*
+    fprintf(stderr, "inflate(): Orginal size = %d, uncompressed size = %d.\n", inflatedSize, o);
+  */
+
+  if (outputN != NULL)
+    *outputN = o;
+
+  return INFLATE_OK;
+}
+
+
+int inflate(unsigned char *data, unsigned char *output, struct InflateContext *context) {
+
+  return _inflate(data, -1, output, -1, NULL, NULL, context);
+}
+
+
+/* the file can start with matches that reach back into the dictionary, which the caller has set up using inflateDictionaryInit() */
+int inflateWithDictionary(unsigned char *data, unsigned char *output, struct InflateDictionary *dictionary, struct InflateContext *context) {
+
+  return _inflate(data, -1, output, -1, NULL, dictionary, context);
+}
+
+
+/* the bounds-checked inflate, for data that can't be trusted. nothing is read outside data[0 ... dataSize-1]
+   or written outside output[0 ... outputSize-1], and the bytes inflated go to *inflatedSize. dictionary
+   can be NULL. knowing where the input ends, it refills the bit buffer 8 bytes at a time, which makes it
+   faster than inflate(). every symbol is checked only in the last FAST_OUTPUT_BYTES of the output and
+   FAST_INPUT_BYTES of the input */
+int inflateSafe(unsigned char *data, int dataSize, unsigned char *output, int outputSize, int *inflatedSize,
+                struct InflateDictionary *dictionary, struct InflateContext *context) {
+
+  if (inflatedSize != NULL)
+    *inflatedSize = 0;
+
+  if (dataSize < 0)
+    return INFLATE_TRUNCATED;
+  if (outputSize < 0)
+    return INFLATE_OVERFLOW;
+
+  return _inflate(data, dataSize, output, outputSize, inflatedSize, dictionary, context);
+}
+
+
+static unsigned int _read_u32(unsigned char *data) {
+
+  return (data[0] | (data[1] << 8) | (data[2] << 16) | ((unsigned int)data[3] << 24)) & 0xFFFFFFFF;
+}
+
+
+/* finds the member in the pack, returns its entry in the index or NULL. the index is sorted by the FNV-1a
+   hashes of the member names, so this is a binary search */
+static unsigned char *_pack_entry(unsigned char *pack, const char *name) {
+
+  unsigned int hash, h;
+  int first, last, middle;
+  unsigned char *entry;
+
+  if (pack[0] != 'D' || pack[1] != 'E' || pack[2] != 'F' || pack[3] != 'p')
+    return NULL;
+
+  hash = 2166136261u;
+  while (*name != 0) {
+    hash ^= (unsigned char)*name++;
+    hash = (hash * 16777619u) & 0xFFFFFFFF;
   }
 
-  /* create the codes from code lengths */
-  huffmanRecreateCodes(286, context->codeLengthLiterals, context->codeLiterals, context);
-  huffmanRecreateCodes(30, context->codeLengthDistances, context->codeDistances, context);
+  first = 0;
+  last = (int)_read_u32(pack + 4) - 1;
+  while (first <= last) {
+    middle = (first + last) >> 1;
+    entry = pack + 16 + middle*16;
+    h = _read_u32(entry);
 
-  /* free all huffman tree nodes */
-  context->treeNodesFreeCurrent = 0;
+    if (h == hash)
+      return entry;
 
-  /* build the huffman trees */
-  huffmanConstructTree(&context->treeLiterals, context->codeLiterals, context->codeLengthLiterals, 286, context);
-  huffmanConstructTree(&context->treeDistances, context->codeDistances, context->codeLengthDistances, 30, context);
+    if (h < hash)
+      first = middle + 1;
+    else
+      last = middle - 1;
+  }
+
+  return NULL;
+}
+
+
+/* finds the member in the pack, returns a pointer to its compressed data in the pack or NULL */
+unsigned char *inflatePackFind(unsigned char *pack, const char *name, int *inflatedSize) {
+
+  unsigned char *entry = _pack_entry(pack, name);
+
+  if (entry == NULL)
+    return NULL;
+
+  if (inflatedSize != NULL)
+    *inflatedSize = (int)_read_u32(entry + 12);
+
+  return pack + _read_u32(entry + 4);
+}
+
+
+/* inflates a member straight from the pack, e.g., a mapped one, without copying it. dictionary can be NULL.
+   the index tells where the member ends, so this doesn't read past it */
+int inflatePackMember(unsigned char *pack, const char *name, unsigned char *output, struct InflateDictionary *dictionary, struct InflateContext *context) {
+
+  unsigned char *entry;
+
+  if (pack[0] != 'D' || pack[1] != 'E' || pack[2] != 'F' || pack[3] != 'p')
+    return INFLATE_WRONG_HEADER;
+
+  entry = _pack_entry(pack, name);
+  if (entry == NULL)
+    return INFLATE_NOT_FOUND;
+
+  return _inflate(pack + _read_u32(entry + 4), (int)_read_u32(entry + 8), output, -1, NULL, dictionary, context);
+}
 
-  /* inflate */
-  j = 0;
-  while (1) {
-    node = context->treeLiterals;
 
-    while (node->literal < 0) {
-      /* parse one bit */
-      if (k == -1) {
-        k = 7;
-        i++;
+/********************************************************************************/
+/* STREAMING */
+/********************************************************************************/
+
+/* the dictionary can be NULL. it's copied into the window, so it doesn't have to stay in memory */
+void inflateStreamInit(struct InflateStream *stream, struct InflateDictionary *dictionary) {
+
+  stream->context.tableSet = -1;
+  stream->windowNext = 0;
+  stream->windowN = 0;
+  stream->dictionary = 0;
+  stream->dictionaryId = 0;
+  stream->bits = 0;
+  stream->bitsN = 0;
+  stream->state = STREAM_HEADER;
+  stream->error = INFLATE_OK;
+  stream->headerN = 0;
+  stream->last = 0;
+
+  if (dictionary != NULL) {
+    memcpy(stream->window, dictionary->data, dictionary->size);
+    stream->windowNext = dictionary->size & (INFLATE_WINDOW_SIZE - 1);
+    stream->windowN = dictionary->size;
+    stream->dictionary = 1;
+    stream->dictionaryId = dictionary->id;
+  }
+}
+
+
+/* moves as much of the input into the bit buffer as fits, but nothing past its end. the bytes at the end
+   of the previous input can have filled the buffer past what bitReaderRefill() expects */
+static void _stream_fill(struct bitReader *r) {
+
+  if (r->bitsN > BIT_READER_REFILL_BITS)
+    return;
+
+  if (r->end - r->next >= 8) {
+    bitReaderRefill(r);
+    return;
+  }
+
+  while (r->bitsN <= 56 && r->next < r->end) {
+    r->bits |= (uint64_t)*r->next++ << (56 - r->bitsN);
+    r->bitsN += 8;
+  }
+}
+
+
+/* decodes the next code like _decode() and _decode_slow() do, but without moving past it, and using only
+   the bits in the buffer. returns the number of bits the code takes, or 0 if the buffer doesn't have all
+   of them yet */
+static int _stream_peek(struct bitReader *r, const unsigned int *table, int bits, int *lengths, int *codes, int n, int alphabet,
+                        unsigned int *entry) {
+
+  unsigned int e;
+  int base, length, code, j;
+
+  e = table[BIT_READER_PEEK(r, bits)];
+  base = 0;
+  length = bits;
+  if (ENTRY_TYPE(e) == ENTRY_SUBTABLE) {
+    base = bits;
+    length = bits + ENTRY_BITS(e);
+    e = table[ENTRY_VALUE(e) + (unsigned int)(((r->bits << bits) >> 32) >> (32 - ENTRY_BITS(e)))];
+  }
+
+  /* an invalid code is known as soon as the bits it was looked up with are there */
+  if (ENTRY_TYPE(e) == ENTRY_INVALID) {
+    *entry = e;
+    return (length <= r->bitsN) ? length : 0;
+  }
+
+  if (ENTRY_TYPE(e) == ENTRY_SLOW) {
+    code = ENTRY_VALUE(e);
+    for (length = TABLE_CODE_MAX_BITS + 1; length < HUFFMAN_CODE_MAX_BITS; length++) {
+      if (length > r->bitsN)
+        return 0;
+
+      code = (code << 1) | (int)((r->bits >> (64 - length)) & 1);
+      for (j = 0; j < n; j++) {
+        if (lengths[j] == length && codes[j] == code) {
+          *entry = _make_entry(j, alphabet, 0);
+          return length;
+        }
       }
+    }
 
-      if ((data[i] >> k) & 1)
-        node = node->right;
-      else
-        node = node->left;
+    *entry = ENTRY(0, ENTRY_INVALID, 0, 0);
+    return HUFFMAN_CODE_MAX_BITS - 1;
+  }
+
+  length = base + ENTRY_BITS(e);
+  if (length > r->bitsN)
+    return 0;
+
+  *entry = e;
+
+  return length;
+}
 
-      k--;
+
+/* keeps the last INFLATE_WINDOW_SIZE bytes of the output in the window */
+static void _stream_window(struct InflateStream *stream, unsigned char *output, int n) {
+
+  int count;
+
+  if (n >= INFLATE_WINDOW_SIZE) {
+    memcpy(stream->window, output + n - INFLATE_WINDOW_SIZE, INFLATE_WINDOW_SIZE);
+    stream->windowNext = 0;
+    stream->windowN = INFLATE_WINDOW_SIZE;
+    return;
+  }
+
+  count = INFLATE_WINDOW_SIZE - stream->windowNext;
+  if (count > n)
+    count = n;
+  memcpy(stream->window + stream->windowNext, output, count);
+  memcpy(stream->window, output + count, n - count);
+
+  stream->windowNext = (stream->windowNext + n) & (INFLATE_WINDOW_SIZE - 1);
+  stream->windowN += n;
+  if (stream->windowN > INFLATE_WINDOW_SIZE)
+    stream->windowN = INFLATE_WINDOW_SIZE;
+}
+
+
+/* copies a match of the stream, the part of it in the window first. the window is behind the output of
+   this call. the output must have room for the match, and MATCH_COPY_SLACK more if fast is 1 */
+static void _stream_copy(struct InflateStream *stream, unsigned char *output, int o, int distance, int length, int fast) {
+
+  int i, n, m;
+
+  n = o - distance;
+  if (n < 0) {
+    m = (stream->windowNext + n) & (INFLATE_WINDOW_SIZE - 1);
+    while (n < 0 && length > 0) {
+      output[o++] = stream->window[m];
+      m = (m + 1) & (INFLATE_WINDOW_SIZE - 1);
+      n++;
+      length--;
     }
 
-    b = node->literal;
+    /* the match may end in the window as well */
+    if (length == 0)
+      return;
+  }
 
-    /*
-      fprintf(stderr, "inflate(): %d\n", b);
-    */
+  if (fast == 1)
+    _copy_match(output + o, distance, length);
+  else if (distance >= length)
+    memcpy(output + o, output + n, length);
+  else {
+    for (i = 0; i < length; i++)
+      output[o + i] = output[n + i];
+  }
+}
+
+
+/* decodes the literals and the matches of a block the way _inflate() does, while the input has
+   FAST_INPUT_BYTES and the output FAST_OUTPUT_BYTES left. then a tuple can't run out of either, and
+   nothing has to be checked */
+static int _stream_fast(struct InflateStream *stream, struct bitReader *r, unsigned char *output, int outputSize, int *outputN) {
+
+  struct InflateContext *context = &stream->context;
+  unsigned int entry;
+  int o, length, distance;
+
+  o = *outputN;
+  while (o <= outputSize - FAST_OUTPUT_BYTES && r->end - r->next >= FAST_INPUT_BYTES) {
+    _stream_fill(r);
+
+    entry = _decode(r, context->tableLiterals, context->tableLiteralsBits);
+    if (ENTRY_TYPE(entry) == ENTRY_SLOW)
+      entry = _decode_slow(r, entry, context->codeLengthLiterals, context->codeLiterals, 286, ALPHABET_LITERALS);
 
-    /* a loose literal? */
-    if (b < 256) {
-      output[j++] = b;
+    if (ENTRY_TYPE(entry) == ENTRY_LITERAL) {
+      output[o++] = ENTRY_VALUE(entry);
       continue;
     }
 
-    /* end of archive? */
-    if (b == 256)
+    if (ENTRY_TYPE(entry) == ENTRY_END) {
+      stream->state = (stream->last == 1) ? STREAM_END : STREAM_BLOCK;
       break;
+    }
+
+    if (ENTRY_TYPE(entry) != ENTRY_BASE) {
+      *outputN = o;
+      return INFLATE_CORRUPTED;
+    }
+
+    length = ENTRY_VALUE(entry) + bitReaderRead(r, ENTRY_EXTRA_BITS(entry));
+
+    if (r->bitsN < TABLE_CODE_MAX_BITS)
+      _stream_fill(r);
+
+    entry = _decode(r, context->tableDistances, context->tableDistancesBits);
+    if (ENTRY_TYPE(entry) == ENTRY_SLOW)
+      entry = _decode_slow(r, entry, context->codeLengthDistances, context->codeDistances, 30, ALPHABET_DISTANCES);
+    if (ENTRY_TYPE(entry) != ENTRY_BASE) {
+      *outputN = o;
+      return INFLATE_CORRUPTED;
+    }
+
+    distance = ENTRY_VALUE(entry) + bitReaderRead(r, ENTRY_EXTRA_BITS(entry));
+    if (distance > o + stream->windowN) {
+      *outputN = o;
+      return INFLATE_BAD_DISTANCE;
+    }
 
-    /* ... so it is a [length, distance] tuple... */
-    b -= 257;
+    _stream_copy(stream, output, o, distance, length, 1);
+    o += length;
+  }
 
-    /* get length */
-    length = baseValueLengths[b];
+  *outputN = o;
+
+  return INFLATE_OK;
+}
 
-    /* parse the extra bits */
-    b = extraBitsLengths[b];
-    if (b > 0) {
-      e = 0;
-      while (b > 0) {
-        if (k == -1) {
-          k = 7;
-          i++;
+
+/* runs the states of the stream until the input runs out, the output is full, the stream ends or it's
+   found to be broken. a symbol is used only when all of its bits, the extra bits included, are in the
+   buffer, otherwise its first bits wait there for the rest. returns INFLATE_NEED_INPUT,
+   INFLATE_NEED_OUTPUT, INFLATE_OK at the end of the stream, or an error */
+static int _stream_run(struct InflateStream *stream, struct bitReader *r, unsigned char *output, int outputSize, int *outputN) {
+
+  struct InflateContext *context = &stream->context;
+  unsigned int id, entry;
+  int code, n, m, b, e, o, count;
+
+  o = 0;
+  code = -1;
+  while (code < 0) {
+    if (stream->state == STREAM_HEADER) {
+      /* the header is read a byte at a time, until its first bytes tell how long it is */
+      n = 4;
+      if (stream->headerN >= 4) {
+        if (stream->header[0] != 'D' || stream->header[1] != 'E' || stream->header[2] != 'F' ||
+            (stream->header[3] != 'c' && stream->header[3] != 'd')) {
+          code = INFLATE_WRONG_HEADER;
+          break;
         }
 
-        e = (e << 1) | ((data[i] >> k) & 1);
-        k--;
-        b--;
+        n = 8;
+        if (stream->header[3] == 'd') {
+          n = 5;
+          if (stream->headerN >= 5) {
+            b = stream->header[4];
+            if ((b & 3) == 3 || b > 7) {
+              code = INFLATE_UNSUPPORTED;
+              break;
+            }
+            n = 5 + ((b & 2) == 0 ? 4 : 0) + ((b & 1) == 1 ? 4 : 0) + ((b & 4) == 4 ? 4 : 0);
+          }
+        }
       }
 
-      /* add the extra bits */
-      length += e;
-    }
+      if (stream->headerN < n) {
+        _stream_fill(r);
+        if (r->bitsN < 8) {
+          code = INFLATE_NEED_INPUT;
+          break;
+        }
+        stream->header[stream->headerN++] = (unsigned char)bitReaderRead(r, 8);
+        continue;
+      }
 
-    /*
-      fprintf(stderr, "  length = %d\n", length);
-    */
+      /* the dictionary must be the one the file was compressed with */
+      if (stream->header[3] == 'd' && (stream->header[4] & 4) == 4) {
+        id = stream->header[n-4] | (stream->header[n-3] << 8) | (stream->header[n-2] << 16) | ((unsigned int)stream->header[n-1] << 24);
+        if (stream->dictionary == 0 || stream->dictionaryId != id) {
+          code = INFLATE_WRONG_DICTIONARY;
+          break;
+        }
+      }
 
-    /* parse distance */
-    node = context->treeDistances;
+      stream->state = STREAM_BLOCK;
+    }
+    else if (stream->state == STREAM_BLOCK) {
+      /* DEFc files have one block, DEFd files have a sequence of them */
+      if (stream->header[3] == 'c') {
+        stream->last = 1;
+        stream->state = STREAM_TREES;
+        continue;
+      }
 
-    while (node->literal < 0) {
-      /* parse one bit */
-      if (k == -1) {
-        k = 7;
-        i++;
+      _stream_fill(r);
+      if (r->bitsN < 3) {
+        code = INFLATE_NEED_INPUT;
+        break;
       }
 
-      if ((data[i] >> k) & 1)
-        node = node->right;
+      stream->last = bitReaderRead(r, 1);
+      b = bitReaderRead(r, 2);
+
+      if (b == 0) {
+        /* a stored block is byte aligned. the buffer has only whole bytes, so it's skipped to one */
+        BIT_READER_SKIP(r, r->bitsN & 7);
+        stream->state = STREAM_STORED_LENGTH;
+      }
+      else if (b == 1)
+        stream->state = STREAM_TABLE_SET;
+      else if (b == 2)
+        stream->state = STREAM_TREES;
       else
-        node = node->left;
+        code = INFLATE_UNSUPPORTED;
+    }
+    else if (stream->state == STREAM_TABLE_SET) {
+      _stream_fill(r);
+      if (r->bitsN < TABLE_SET_BITS) {
+        code = INFLATE_NEED_INPUT;
+        break;
+      }
+
+      b = bitReaderRead(r, TABLE_SET_BITS);
+      if (b >= TABLE_SETS_N) {
+        code = INFLATE_UNSUPPORTED;
+        break;
+      }
+
+      /* a stream doesn't know how long the block is, so the tables are built right away */
+      e = _build_table_set(b, context);
+      if (e != INFLATE_OK) {
+        code = e;
+        break;
+      }
+
+      stream->state = STREAM_LITERALS;
+    }
+    else if (stream->state == STREAM_STORED_LENGTH) {
+      _stream_fill(r);
+      if (r->bitsN < 32) {
+        code = INFLATE_NEED_INPUT;
+        break;
+      }
+
+      b = bitReaderRead(r, 8);
+      b |= bitReaderRead(r, 8) << 8;
+      e = bitReaderRead(r, 8);
+      e |= bitReaderRead(r, 8) << 8;
+      if (e != (~b & 0xFFFF)) {
+        code = INFLATE_CORRUPTED;
+        break;
+      }
+
+      stream->length = b;
+      stream->state = STREAM_STORED;
+    }
+    else if (stream->state == STREAM_STORED) {
+      /* the bytes already in the buffer first, then the rest straight from the input */
+      while (stream->length > 0 && r->bitsN >= 8 && o < outputSize) {
+        output[o++] = (unsigned char)bitReaderRead(r, 8);
+        stream->length--;
+      }
+
+      if (stream->length > 0 && r->bitsN == 0) {
+        /* the buffer may still hold the bytes that are copied here */
+        r->bits = 0;
+
+        count = stream->length;
+        if (count > outputSize - o)
+          count = outputSize - o;
+        if (count > r->end - r->next)
+          count = (int)(r->end - r->next);
+
+        memcpy(output + o, r->next, count);
+        o += count;
+        r->next += count;
+        stream->length -= count;
+      }
+
+      if (stream->length > 0) {
+        code = (o == outputSize) ? INFLATE_NEED_OUTPUT : INFLATE_NEED_INPUT;
+        break;
+      }
+
+      stream->state = (stream->last == 1) ? STREAM_END : STREAM_BLOCK;
+    }
+    else if (stream->state == STREAM_TREES) {
+      _stream_fill(r);
+      if (r->bitsN < 8 + 3) {
+        code = INFLATE_NEED_INPUT;
+        break;
+      }
+
+      /* the number of code lengths, and the bits per code length */
+      stream->codesN = bitReaderRead(r, 8);
+      stream->codeBits = bitReaderRead(r, 3);
+      if (stream->codesN > 119) {
+        code = INFLATE_CORRUPTED;
+        break;
+      }
+
+      stream->codeLengthsN = 0;
+      stream->state = STREAM_COMBINED;
+    }
+    else if (stream->state == STREAM_COMBINED) {
+      /* the combined code lengths */
+      while (stream->codeLengthsN < stream->codesN) {
+        if (r->bitsN < stream->codeBits) {
+          _stream_fill(r);
+          if (r->bitsN < stream->codeBits)
+            break;
+        }
+        context->codeLengthCombined[stream->codeLengthsN++] = bitReaderRead(r, stream->codeBits);
+      }
+
+      if (stream->codeLengthsN < stream->codesN) {
+        code = INFLATE_NEED_INPUT;
+        break;
+      }
+
+      e = _build_table(context->tableCombined, INFLATE_TABLE_COMBINED_SIZE, INFLATE_TABLE_COMBINED_BITS, &context->tableCombinedBits,
+                       context->codeLengthCombined, context->codeCombined, stream->codesN, ALPHABET_COMBINED, context);
+      if (e != INFLATE_OK) {
+        code = e;
+        break;
+      }
 
-      k--;
+      stream->codeLengthsN = 0;
+      stream->codeLengthPrevious = 0;
+      stream->state = STREAM_LENGTHS;
     }
+    else if (stream->state == STREAM_LENGTHS) {
+      /* the literal/length and distance code lengths, a code length and its repeat count at a time */
+      while (stream->codeLengthsN < 286 + 30) {
+        _stream_fill(r);
+        n = _stream_peek(r, context->tableCombined, context->tableCombinedBits, context->codeLengthCombined, context->codeCombined,
+                         stream->codesN, ALPHABET_COMBINED, &entry);
+        if (n == 0)
+          break;
+        if (ENTRY_TYPE(entry) != ENTRY_LITERAL) {
+          code = INFLATE_CORRUPTED;
+          break;
+        }
 
-    b = node->literal;
+        b = ENTRY_VALUE(entry);
+        if (b <= stream->codesN - 4)
+          e = 0;
+        else if (b == stream->codesN - 4 + 1)
+          e = 2;
+        else if (b == stream->codesN - 4 + 2)
+          e = 3;
+        else
+          e = 7;
+
+        if (n + e > r->bitsN)
+          break;
+        BIT_READER_SKIP(r, n);
+
+        m = 1;
+        if (e > 0) {
+          m = bitReaderRead(r, e) + ((e == 7) ? 11 : 3);
+          b = (b == stream->codesN - 4 + 1) ? stream->codeLengthPrevious : 0;
+        }
 
-    /* get length */
-    distance = baseValueDistances[b];
+        /* a repeat can't run past the last code length */
+        if (stream->codeLengthsN + m > 286 + 30) {
+          code = INFLATE_CORRUPTED;
+          break;
+        }
 
-    /* parse the extra bits */
-    b = extraBitsDistances[b];
-    if (b > 0) {
-      e = 0;
-      while (b > 0) {
-        if (k == -1) {
-          k = 7;
-          i++;
+        while (m > 0) {
+          if (stream->codeLengthsN < 286)
+            context->codeLengthLiterals[stream->codeLengthsN] = b;
+          else
+            context->codeLengthDistances[stream->codeLengthsN - 286] = b;
+          stream->codeLengthsN++;
+          m--;
         }
 
-        e = (e << 1) | ((data[i] >> k) & 1);
-        k--;
-        b--;
+        stream->codeLengthPrevious = b;
+      }
+
+      if (code >= 0)
+        break;
+      if (stream->codeLengthsN < 286 + 30) {
+        code = INFLATE_NEED_INPUT;
+        break;
+      }
+
+      /* build the tables, they replace the ones of the predefined table set */
+      context->tableSet = -1;
+      e = _build_table(context->tableLiterals, INFLATE_TABLE_LITERALS_SIZE, INFLATE_TABLE_LITERALS_BITS, &context->tableLiteralsBits,
+                       context->codeLengthLiterals, context->codeLiterals, 286, ALPHABET_LITERALS, context);
+      if (e == INFLATE_OK)
+        e = _build_table(context->tableDistances, INFLATE_TABLE_DISTANCES_SIZE, INFLATE_TABLE_DISTANCES_BITS, &context->tableDistancesBits,
+                         context->codeLengthDistances, context->codeDistances, 30, ALPHABET_DISTANCES, context);
+      if (e != INFLATE_OK) {
+        code = e;
+        break;
       }
 
-      /* add the extra bits */
-      distance += e;
+      stream->state = STREAM_LITERALS;
+    }
+    else if (stream->state == STREAM_LITERALS) {
+      /* far from the ends of the input and the output the symbols are decoded without suspending */
+      e = _stream_fast(stream, r, output, outputSize, &o);
+      if (e != INFLATE_OK) {
+        code = e;
+        break;
+      }
+      if (stream->state != STREAM_LITERALS)
+        continue;
+
+      while (1) {
+        _stream_fill(r);
+        n = _stream_peek(r, context->tableLiterals, context->tableLiteralsBits, context->codeLengthLiterals, context->codeLiterals,
+                         286, ALPHABET_LITERALS, &entry);
+        if (n == 0) {
+          code = INFLATE_NEED_INPUT;
+          break;
+        }
+
+        if (ENTRY_TYPE(entry) == ENTRY_LITERAL) {
+          if (o == outputSize) {
+            code = INFLATE_NEED_OUTPUT;
+            break;
+          }
+          BIT_READER_SKIP(r, n);
+          output[o++] = ENTRY_VALUE(entry);
+          continue;
+        }
+
+        if (ENTRY_TYPE(entry) == ENTRY_END) {
+          BIT_READER_SKIP(r, n);
+          stream->state = (stream->last == 1) ? STREAM_END : STREAM_BLOCK;
+          break;
+        }
+
+        if (ENTRY_TYPE(entry) != ENTRY_BASE) {
+          code = INFLATE_CORRUPTED;
+          break;
+        }
+
+        /* the length waits for its extra bits */
+        if (n + (int)ENTRY_EXTRA_BITS(entry) > r->bitsN) {
+          code = INFLATE_NEED_INPUT;
+          break;
+        }
+        BIT_READER_SKIP(r, n);
+        stream->length = ENTRY_VALUE(entry) + bitReaderRead(r, ENTRY_EXTRA_BITS(entry));
+        stream->state = STREAM_DISTANCE;
+        break;
+      }
     }
+    else if (stream->state == STREAM_DISTANCE) {
+      _stream_fill(r);
+      n = _stream_peek(r, context->tableDistances, context->tableDistancesBits, context->codeLengthDistances, context->codeDistances,
+                       30, ALPHABET_DISTANCES, &entry);
+      if (n == 0 || n + (int)ENTRY_EXTRA_BITS(entry) > r->bitsN) {
+        code = INFLATE_NEED_INPUT;
+        break;
+      }
+      if (ENTRY_TYPE(entry) != ENTRY_BASE) {
+        code = INFLATE_CORRUPTED;
+        break;
+      }
+
+      BIT_READER_SKIP(r, n);
+      stream->distance = ENTRY_VALUE(entry) + bitReaderRead(r, ENTRY_EXTRA_BITS(entry));
+
+      /* the match can reach back into the window, but not past it */
+      if (stream->distance > o + stream->windowN) {
+        code = INFLATE_BAD_DISTANCE;
+        break;
+      }
 
-    /*
-      fprintf(stderr, "  distance = %d\n", distance);
-    */
+      stream->state = STREAM_COPY;
+    }
+    else if (stream->state == STREAM_COPY) {
+      /* as much of the match as the output has room for */
+      count = stream->length;
+      if (count > outputSize - o)
+        count = outputSize - o;
+
+      _stream_copy(stream, output, o, stream->distance, count, (count + MATCH_COPY_SLACK <= outputSize - o) ? 1 : 0);
+      o += count;
+      stream->length -= count;
+
+      if (stream->length > 0) {
+        code = INFLATE_NEED_OUTPUT;
+        break;
+      }
 
-    /* de-lz77 */
-    n = j - distance;
-    for (b = 0; b < length; b++)
-      output[j++] = output[n++];
+      stream->state = STREAM_LITERALS;
+    }
+    else
+      code = INFLATE_OK;
   }
 
-  /*
-    fprintf(stderr, "inflate(): Orginal size = %d, uncompressed size = %d.\n", inflatedSize, j);
-  */
+  *outputN = o;
+
+  return code;
+}
+
+
+/* inflates the next piece of the input into the output. the input that was used (and can be thrown away)
+   goes to *inputUsed, and the bytes inflated to *outputUsed. returns INFLATE_NEED_INPUT when all of the
+   input has been used, INFLATE_NEED_OUTPUT when the output is full (feed the unused input again), and
+   INFLATE_OK when the stream has ended. an error stops the stream, and every call after it returns it */
+int inflateStreamFeed(struct InflateStream *stream, unsigned char *input, int inputSize, int *inputUsed,
+                      unsigned char *output, int outputSize, int *outputUsed) {
+
+  struct bitReader r;
+  int code, o, bytes;
+
+  *inputUsed = 0;
+  *outputUsed = 0;
+
+  if (stream->error != INFLATE_OK)
+    return stream->error;
+
+  bitReaderInit(&r, input, input + inputSize);
+  r.bits = stream->bits;
+  r.bitsN = stream->bitsN;
+
+  code = _stream_run(stream, &r, output, outputSize, &o);
+
+  /* at the end of the stream the whole bytes left in the buffer follow it, and when the output is full they
+     are fed again. either way they are given back, as far as they came from this input */
+  if (code == INFLATE_OK || code == INFLATE_NEED_OUTPUT) {
+    bytes = r.bitsN >> 3;
+    if (bytes > r.next - input)
+      bytes = (int)(r.next - input);
+    r.next -= bytes;
+    r.bitsN -= bytes << 3;
+  }
+
+  /* the bits under the bitsN valid ones can be the input after them, which the next call may not have */
+  stream->bits = (r.bitsN < 64) ? r.bits & ~(~(uint64_t)0 >> r.bitsN) : r.bits;
+  stream->bitsN = r.bitsN;
+
+  _stream_window(stream, output, o);
+
+  if (code != INFLATE_OK && code != INFLATE_NEED_INPUT && code != INFLATE_NEED_OUTPUT)
+    stream->error = code;
+
+  *inputUsed = (int)(r.next - input);
+  *outputUsed = o;
+
+  return code;
+}
+
+
+/* returns INFLATE_OK if the stream got to its end, INFLATE_TRUNCATED if its input ended too soon, or the
+   error that stopped it. nothing was allocated, so the stream can be simply dropped after this */
+int inflateStreamEnd(struct InflateStream *stream) {
+
+  if (stream->error != INFLATE_OK)
+    return stream->error;
+
+  if (stream->state != STREAM_END)
+    return INFLATE_TRUNCATED;
 
   return INFLATE_OK;
 }
@@ -2,6 +2,8 @@
 #ifndef INFLATE_H
 #define INFLATE_H
 
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -9,11 +11,14 @@ extern "C" {
 /* the number of bits we can have in a code */
 #define HUFFMAN_CODE_MAX_BITS 32
 
-struct InflateNode {
-  struct InflateNode *left;
-  struct InflateNode *right;
-  int literal;
-};
+/* the decoding tables: a primary table indexed by the next 9 (literals/lengths) or 7 (distances and code
+   lengths) bits, followed by the subtables of the longer codes */
+#define INFLATE_TABLE_LITERALS_BITS  9
+#define INFLATE_TABLE_DISTANCES_BITS 7
+#define INFLATE_TABLE_COMBINED_BITS  7
+#define INFLATE_TABLE_LITERALS_SIZE  2048
+#define INFLATE_TABLE_DISTANCES_SIZE 1024
+#define INFLATE_TABLE_COMBINED_SIZE  1024
 
 /* the inflate context */
 struct InflateContext {
@@ -21,31 +26,112 @@ struct InflateContext {
   int tmpCount[HUFFMAN_CODE_MAX_BITS];
   int nextCode[HUFFMAN_CODE_MAX_BITS+1];
 
-  /* code lengths */
-  int codeLengthLiterals[286];
+  /* code lengths. the predefined table sets have 288 literals/lengths */
+  int codeLengthLiterals[288];
   int codeLengthDistances[30];
   int codeLengthCombined[119];
 
   /* codes */
-  int codeLiterals[286];
+  int codeLiterals[288];
   int codeDistances[30];
   int codeCombined[119];
 
-  /* the huffman trees */
-  struct InflateNode *treeLiterals;
-  struct InflateNode *treeDistances;
-  struct InflateNode *treeCombined;
+  /* the decoding tables, and the number of bits their primary tables are indexed by */
+  unsigned int tableLiterals[INFLATE_TABLE_LITERALS_SIZE];
+  unsigned int tableDistances[INFLATE_TABLE_DISTANCES_SIZE];
+  unsigned int tableCombined[INFLATE_TABLE_COMBINED_SIZE];
+  int tableLiteralsBits;
+  int tableDistancesBits;
+  int tableCombinedBits;
+
+  /* the predefined table set the literal/length and distance tables hold, or -1 */
+  int tableSet;
+};
 
-  /* the free tree nodes */
-  int treeNodesFreeCurrent;
-  struct InflateNode treeNodesFree[1024];
+/* a preset dictionary, see inflateDictionaryInit() */
+struct InflateDictionary {
+  unsigned char *data;
+  int size;
+  /* the Adler-32 of the data, deflateTT writes it into the header */
+  unsigned int id;
+};
+
+/* the streaming inflate keeps the last 32K of the output, the matches can reach that far back */
+#define INFLATE_WINDOW_SIZE 0x8000
+
+/* a stream inflated a piece at a time, see inflateStreamInit(). it's all the memory a stream takes */
+struct InflateStream {
+  struct InflateContext context;
+
+  /* the last INFLATE_WINDOW_SIZE bytes of the output, after the dictionary. windowNext is where the next
+     byte goes */
+  unsigned char window[INFLATE_WINDOW_SIZE];
+  int windowNext;
+  int windowN;
+
+  /* 1 if the window starts with a dictionary, and its Adler-32 */
+  int dictionary;
+  unsigned int dictionaryId;
+
+  /* the bits read from the input but not used yet, the next one is the highest bit */
+  uint64_t bits;
+  int bitsN;
+
+  /* where the previous call stopped, and the error that stopped the stream for good */
+  int state;
+  int error;
+
+  /* the header, the last block flag, the code lengths being read, and the match being copied */
+  unsigned char header[17];
+  int headerN;
+  int last;
+  int codesN;
+  int codeBits;
+  int codeLengthsN;
+  int codeLengthPrevious;
+  int length;
+  int distance;
 };
 
 /* the return values */
-#define INFLATE_OK           0
-#define INFLATE_WRONG_HEADER 1
+#define INFLATE_OK               0
+#define INFLATE_WRONG_HEADER     1
+#define INFLATE_UNSUPPORTED      2
+#define INFLATE_WRONG_DICTIONARY 3
+#define INFLATE_NOT_FOUND        4
+#define INFLATE_CORRUPTED        5
+/* the input ends in the middle of the stream (only when its size is known), the output has no room for it
+   (inflateSafe() only), a match reaches back past the output and the dictionary, a Huffman code doesn't
+   fit into the code space */
+#define INFLATE_TRUNCATED        6
+#define INFLATE_OVERFLOW         7
+#define INFLATE_BAD_DISTANCE     8
+#define INFLATE_OVERSUBSCRIBED   9
+/* inflateStreamFeed() has used all of the input, or filled the output, before the stream ended */
+#define INFLATE_NEED_INPUT       10
+#define INFLATE_NEED_OUTPUT      11
 
+/* the size of the compressed data isn't known, so the input is read a byte at a time, as the codes need
+   it, and nothing past the compressed data is read. inflateSafe() is faster, if the size is known */
 int inflate(unsigned char *data, unsigned char *output, struct InflateContext *context);
+int inflateWithDictionary(unsigned char *data, unsigned char *output, struct InflateDictionary *dictionary, struct InflateContext *context);
+void inflateDictionaryInit(struct InflateDictionary *dictionary, unsigned char *data, int size);
+
+/* checks the input and the output against their sizes, for data that can't be trusted. the number of bytes
+   inflated goes to *inflatedSize */
+int inflateSafe(unsigned char *data, int dataSize, unsigned char *output, int outputSize, int *inflatedSize,
+                struct InflateDictionary *dictionary, struct InflateContext *context);
+
+/* the streaming inflate, for decompressing while the data is still being read. the input and the output
+   can be split anywhere, even in the middle of a symbol */
+void inflateStreamInit(struct InflateStream *stream, struct InflateDictionary *dictionary);
+int inflateStreamFeed(struct InflateStream *stream, unsigned char *input, int inputSize, int *inputUsed,
+                      unsigned char *output, int outputSize, int *outputUsed);
+int inflateStreamEnd(struct InflateStream *stream);
+
+/* packs made by deflateTT --pack */
+unsigned char *inflatePackFind(unsigned char *pack, const char *name, int *inflatedSize);
+int inflatePackMember(unsigned char *pack, const char *name, unsigned char *output, struct InflateDictionary *dictionary, struct InflateContext *context);
 
 #ifdef __cplusplus
 }
@@ -5,18 +5,32 @@
  * Specification version 1.3), only the header is different. I was too lazy
  * to implement them the standard way.
  *
+ * The input is mapped into memory, and so is the output when the header
+ * tells its size: the file is created at its full size up front, and the
+ * data is inflated right into it. Pipes, - (stdin/stdout) and the outputs
+ * of unknown size go through ordinary buffers instead.
+ *
  * Programmed by Ville Helin <vhelin#iki.fi> in 2007.
  *
  * This code is under GNU General Public Licence (GPL), version 2, June 1991.
  */
 
+/* for mmap() */
+#define _POSIX_C_SOURCE 200112L
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
 
 #include "defines.h"
 #include "main.h"
+#include "bitreader.h"
 
 
 /* code lengths */
@@ -94,6 +108,122 @@ const int baseValueDistances[] = {
 */ 
 
 
+/* the predefined table sets, the same ones deflateTT has in tables.c. 0 is the fixed codes of RFC-1951 */
+const struct tableSet tableSets[TABLE_SETS_N] = {
+  /* fixed, RFC-1951 section 3.2.6. 286 and 287 are never used, but they have codes */
+  {
+    /* the number of literal/length codes of each length */
+    {
+      0, 0, 0, 0, 0, 0, 0, 24, 152, 112, 0, 0, 0, 0, 0, 0
+    },
+    /* the literals/lengths in code order */
+    {
+      256, 257, 258, 259, 260, 261, 262, 263, 264, 265, 266, 267, 268, 269, 270, 271,
+      272, 273, 274, 275, 276, 277, 278, 279, 0, 1, 2, 3, 4, 5, 6, 7,
+      8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23,
+      24, 25, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39,
+      40, 41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, 52, 53, 54, 55,
+      56, 57, 58, 59, 60, 61, 62, 63, 64, 65, 66, 67, 68, 69, 70, 71,
+      72, 73, 74, 75, 76, 77, 78, 79, 80, 81, 82, 83, 84, 85, 86, 87,
+      88, 89, 90, 91, 92, 93, 94, 95, 96, 97, 98, 99, 100, 101, 102, 103,
+      104, 105, 106, 107, 108, 109, 110, 111, 112, 113, 114, 115, 116, 117, 118, 119,
+      120, 121, 122, 123, 124, 125, 126, 127, 128, 129, 130, 131, 132, 133, 134, 135,
+      136, 137, 138, 139, 140, 141, 142, 143, 280, 281, 282, 283, 284, 285, 286, 287,
+      144, 145, 146, 147, 148, 149, 150, 151, 152, 153, 154, 155, 156, 157, 158, 159,
+      160, 161, 162, 163, 164, 165, 166, 167, 168, 169, 170, 171, 172, 173, 174, 175,
+      176, 177, 178, 179, 180, 181, 182, 183, 184, 185, 186, 187, 188, 189, 190, 191,
+      192, 193, 194, 195, 196, 197, 198, 199, 200, 201, 202, 203, 204, 205, 206, 207,
+      208, 209, 210, 211, 212, 213, 214, 215, 216, 217, 218, 219, 220, 221, 222, 223,
+      224, 225, 226, 227, 228, 229, 230, 231, 232, 233, 234, 235, 236, 237, 238, 239,
+      240, 241, 242, 243, 244, 245, 246, 247, 248, 249, 250, 251, 252, 253, 254, 255
+    },
+    /* the number of distance codes of each length */
+    {
+      0, 0, 0, 0, 0, 30, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+    },
+    /* the distances in code order */
+    {
+      0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+      16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29
+    }
+  },
+  /* text */
+  {
+    /* the number of literal/length codes of each length */
+    {
+      0, 0, 0, 0, 2, 10, 14, 24, 23, 21, 13, 12, 6, 5, 0, 156
+    },
+    /* the literals/lengths in code order */
+    {
+      32, 257, 97, 101, 105, 111, 114, 115, 116, 258, 259, 260, 10, 46, 99, 100,
+      108, 109, 110, 112, 117, 261, 262, 263, 265, 269, 44, 47, 65, 67, 69, 73,
+      76, 78, 79, 82, 83, 84, 95, 98, 102, 103, 104, 119, 121, 264, 266, 267,
+      268, 270, 34, 39, 40, 41, 42, 45, 48, 49, 50, 58, 66, 68, 70, 77,
+      80, 85, 107, 118, 120, 256, 271, 272, 273, 35, 51, 52, 54, 56, 59, 60,
+      61, 62, 71, 72, 86, 87, 89, 91, 92, 93, 124, 274, 275, 277, 43, 53,
+      55, 57, 63, 64, 75, 106, 113, 122, 123, 125, 276, 33, 37, 38, 74, 88,
+      94, 96, 126, 278, 279, 281, 285, 36, 81, 90, 280, 282, 283, 9, 169, 194,
+      195, 284, 0, 1, 2, 3, 4, 5, 6, 7, 8, 11, 12, 13, 14, 15,
+      16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31,
+      127, 128, 129, 130, 131, 132, 133, 134, 135, 136, 137, 138, 139, 140, 141, 142,
+      143, 144, 145, 146, 147, 148, 149, 150, 151, 152, 153, 154, 155, 156, 157, 158,
+      159, 160, 161, 162, 163, 164, 165, 166, 167, 168, 170, 171, 172, 173, 174, 175,
+      176, 177, 178, 179, 180, 181, 182, 183, 184, 185, 186, 187, 188, 189, 190, 191,
+      192, 193, 196, 197, 198, 199, 200, 201, 202, 203, 204, 205, 206, 207, 208, 209,
+      210, 211, 212, 213, 214, 215, 216, 217, 218, 219, 220, 221, 222, 223, 224, 225,
+      226, 227, 228, 229, 230, 231, 232, 233, 234, 235, 236, 237, 238, 239, 240, 241,
+      242, 243, 244, 245, 246, 247, 248, 249, 250, 251, 252, 253, 254, 255
+    },
+    /* the number of distance codes of each length */
+    {
+      0, 0, 0, 0, 11, 6, 6, 3, 1, 1, 2, 0, 0, 0, 0, 0
+    },
+    /* the distances in code order */
+    {
+      10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 8, 9, 21, 22, 23,
+      24, 0, 5, 6, 7, 25, 26, 4, 27, 28, 29, 3, 1, 2
+    }
+  },
+  /* binary */
+  {
+    /* the number of literal/length codes of each length */
+    {
+      0, 0, 0, 1, 1, 3, 6, 22, 47, 88, 90, 17, 3, 4, 4, 0
+    },
+    /* the literals/lengths in code order */
+    {
+      257, 258, 259, 260, 261, 0, 72, 232, 262, 265, 267, 1, 2, 15, 32, 65,
+      76, 97, 101, 114, 115, 116, 117, 131, 137, 139, 141, 233, 255, 263, 264, 266,
+      270, 3, 4, 5, 6, 8, 10, 14, 16, 24, 36, 40, 45, 46, 48, 49,
+      56, 57, 61, 64, 68, 69, 73, 77, 80, 84, 95, 98, 99, 100, 102, 104,
+      105, 108, 109, 110, 111, 112, 120, 128, 132, 133, 144, 192, 235, 248, 269, 285,
+      7, 9, 11, 12, 13, 17, 18, 20, 21, 26, 28, 29, 31, 34, 37, 41,
+      44, 47, 50, 51, 52, 53, 54, 58, 59, 60, 63, 66, 67, 70, 71, 74,
+      78, 79, 82, 83, 85, 86, 88, 91, 92, 93, 96, 103, 107, 118, 119, 121,
+      124, 129, 134, 136, 140, 152, 160, 168, 176, 182, 184, 186, 190, 193, 194, 195,
+      196, 197, 198, 199, 200, 201, 208, 210, 216, 224, 230, 236, 237, 239, 240, 246,
+      247, 249, 250, 251, 252, 253, 254, 268, 19, 22, 23, 25, 27, 30, 33, 35,
+      38, 39, 42, 43, 55, 62, 75, 81, 87, 89, 90, 94, 106, 113, 122, 123,
+      125, 126, 127, 130, 135, 138, 142, 143, 145, 146, 148, 149, 150, 151, 153, 154,
+      156, 162, 164, 166, 170, 172, 175, 178, 180, 183, 185, 187, 188, 189, 191, 202,
+      203, 204, 205, 206, 207, 209, 211, 212, 213, 214, 215, 217, 218, 219, 220, 221,
+      222, 223, 225, 226, 227, 228, 229, 231, 234, 238, 241, 242, 243, 244, 245, 271,
+      272, 273, 147, 155, 157, 158, 159, 161, 163, 165, 167, 169, 171, 173, 174, 177,
+      179, 181, 274, 275, 276, 277, 256, 278, 280, 281, 279, 282, 283, 284
+    },
+    /* the number of distance codes of each length */
+    {
+      0, 0, 0, 0, 8, 13, 5, 1, 1, 2, 0, 0, 0, 0, 0, 0
+    },
+    /* the distances in code order */
+    {
+      5, 7, 8, 10, 11, 12, 14, 16, 9, 13, 15, 17, 18, 19, 20, 21,
+      22, 23, 24, 25, 26, 0, 3, 6, 27, 28, 29, 4, 1, 2
+    }
+  }
+};
+
+
 void huffmanConstructTree(struct node **root, int *codes, int *codeLengths, int n) {
 
   struct node *node;
@@ -201,351 +331,832 @@ void huffmanRecreateCodes(int n, int *lengths, int *codes) {
 }
 
 
-int main(int argc, char *argv[]) {
+/* decodes a symbol using a predefined table set, returns -1 if the code is not in the set. the codes
+   are canonical, so the codes of each length follow the codes of the previous length */
+static int _decode_symbol(struct bitReader *r, const unsigned short *counts, const unsigned short *symbols) {
 
-  int fileSize, i, j, k, m, n, length, b, e, distance, inflatedSize, codesN, bPrevious;
-  unsigned char *data, *tmp;
-  struct node *node;
-  FILE *f;
+  int code, first, index, length, bits;
 
-  if (argc != 3) {
-    fprintf(stderr, "inflateTT v1.1 Written by Ville Helin 2007\n");
-    fprintf(stderr, "USAGE: %s <IN DEF> <OUT RAW>\n", argv[0]);
-    return 1;
+  if (r->bitsN < 15)
+    bitReaderRefill(r);
+
+  bits = BIT_READER_PEEK(r, 15);
+  code = 0;
+  first = 0;
+  index = 0;
+  for (length = 1; length < 16; length++) {
+    code |= (bits >> (15 - length)) & 1;
+
+    if (code - first < counts[length]) {
+      BIT_READER_SKIP(r, length);
+      return symbols[index + code - first];
+    }
+
+    index += counts[length];
+    first = (first + counts[length]) << 1;
+    code <<= 1;
   }
 
-  /********************************************************************************/
-  /* INPUT */
-  /********************************************************************************/
+  return -1;
+}
 
-  /* read the DEF file */
-  f = fopen(argv[1], "rb");
-  if (f == NULL) {
-    fprintf(stderr, "main(): Could not open file \"%s\" for reading.\n", argv[1]);
-    return 1;
+
+/* walks the tree down to a leaf, one bit at a time. the codes are 31 bits at most, so one refill is enough */
+static int _decode_tree(struct bitReader *r, struct node *node) {
+
+  bitReaderRefill(r);
+
+  while (node->literal < 0) {
+    if (BIT_READER_PEEK(r, 1) != 0)
+      node = node->right;
+    else
+      node = node->left;
+
+    BIT_READER_SKIP(r, 1);
   }
 
-  /* get the file size */
-  fseek(f, 0, SEEK_END);
-  fileSize = ftell(f);
-  fseek(f, 0, SEEK_SET);
+  return node->literal;
+}
 
-  data = malloc(fileSize);
-  if (data == NULL) {
-    fprintf(stderr, "main(): Out of memory error [1].\n");
-    fclose(f);
-    return 1;
+
+/* copies a match of length bytes from distance bytes back. the matches 16 and 8 bytes back, or further,
+   are copied 16 and 8 bytes at a time, a run of one byte is a memset(), and the pattern of a shorter
+   distance is first repeated one byte at a time until it's at least 8 bytes long. writes up to
+   MATCH_COPY_SLACK - 1 bytes of garbage past the match, the output has room for them */
+static void _copy_match(unsigned char *output, int distance, int length) {
+
+  unsigned char *source = output - distance, *end = output + length;
+  int i, step;
+
+  if (distance >= 16) {
+    do {
+      memcpy(output, source, 16);
+      output += 16;
+      source += 16;
+    } while (output < end);
+    return;
   }
 
-  fread(data, 1, fileSize, f);
-  fclose(f);
+  if (distance == 1) {
+    memset(output, *source, length);
+    return;
+  }
 
-  /********************************************************************************/
-  /* HUFFMAN */
-  /********************************************************************************/
+  if (distance < 8) {
+    step = distance;
+    while (step < 8)
+      step += distance;
 
-  /* check header */
-  if (data[0] != 'D' || data[1] != 'E' || data[2] != 'F' || data[3] != 'c') {
-    fprintf(stderr, "main(): File \"%s\" doesn't start with \"DEFc\".\n", argv[1]);
-    return 1;
+    for (i = 0; i < step; i++)
+      output[i] = source[i];
+
+    /* the output repeats itself every step bytes from here on */
+    source = output;
+    output += step;
   }
 
-  i = 4;
+  while (output < end) {
+    memcpy(output, source, 8);
+    output += 8;
+    source += 8;
+  }
+}
 
-  /* parse inflated size */
-  inflatedSize = data[i] | (data[i+1] << 8) | (data[i+2] << 16) | (data[i+3] << 24);
-  i += 4;
 
-  tmp = malloc(inflatedSize);
-  if (tmp == NULL) {
-    fprintf(stderr, "main(): Out of memory error [2].\n");
-    return 1;
+/* the Adler-32 checksum of the dictionary, deflateTT writes it into the header */
+static unsigned long _dictionary_id(unsigned char *data, int size) {
+
+  unsigned long a = 1, b = 0;
+  int i;
+
+  for (i = 0; i < size; i++) {
+    a = (a + data[i]) % 65521;
+    b = (b + a) % 65521;
   }
 
-  /*
-    fprintf(stderr, "main(): Inflated size = %d\n", inflatedSize);
-  */
+  return (b << 16) | a;
+}
+
+
+static unsigned long _read_u32(unsigned char *data) {
+
+  return data[0] | (data[1] << 8) | (data[2] << 16) | ((unsigned long)data[3] << 24);
+}
 
-  /* read the number of code lengths */
-  codesN = data[i++];
 
-  /* read bits per code length */
-  k = 7;
+/* FNV-1a of the member name, like in deflateTT --pack */
+static unsigned long _pack_hash(char *name) {
 
-  m = 0;
-  for (n = 0; n < 3; n++) {
-    /* parse one bit */
-    b = (data[i] >> k) & 1;
-    k--;
+  unsigned long h = 2166136261ul;
 
-    m = (m << 1) | b;
+  while (*name != 0) {
+    h ^= (unsigned char)*name++;
+    h = (h * 16777619ul) & 0xFFFFFFFF;
   }
 
-  /*
-    fprintf(stderr, "main(): Number of items = %d. Bits per item = %d.\n", codesN, m);
-  */
+  return h;
+}
 
-  /* read the combined code lengths */
-  for (j = 0; j < codesN; j++) {
-    codeLengthCombined[j] = 0;
 
-    for (n = 0; n < m; n++) {
-      /* parse one bit */
-      if (k == -1) {
-        k = 7;
-        i++;
+/* finds the member in the pack using binary search on the sorted index, returns its offset or -1 */
+static int _pack_find(unsigned char *pack, int packSize, char *name) {
+
+  unsigned long hash, h;
+  int first, last, middle, membersN;
+  unsigned char *entry;
+
+  if (packSize < 16 || pack[0] != 'D' || pack[1] != 'E' || pack[2] != 'F' || pack[3] != 'p') {
+    fprintf(stderr, "_pack_find(): The file is not a pack made by deflateTT --pack.\n");
+    return -1;
+  }
+
+  membersN = (int)_read_u32(pack + 4);
+  if (membersN < 0 || membersN > (packSize - 16) / 16) {
+    fprintf(stderr, "_pack_find(): The index of the pack is corrupted.\n");
+    return -1;
+  }
+
+  hash = _pack_hash(name);
+  first = 0;
+  last = membersN - 1;
+  while (first <= last) {
+    middle = (first + last) >> 1;
+    entry = pack + 16 + middle*16;
+    h = _read_u32(entry);
+
+    if (h == hash) {
+      if (_read_u32(entry + 4) + _read_u32(entry + 8) > (unsigned long)packSize) {
+        fprintf(stderr, "_pack_find(): Member \"%s\" is beyond the end of the pack.\n", name);
+        return -1;
       }
+      return (int)_read_u32(entry + 4);
+    }
+
+    if (h < hash)
+      first = middle + 1;
+    else
+      last = middle - 1;
+  }
+
+  fprintf(stderr, "_pack_find(): The pack has no member \"%s\".\n", name);
+
+  return -1;
+}
+
+
+/* reads the whole input, mapping it if it's a file. returns NULL if it can't be read */
+static unsigned char *_read_input(char *name, int *size, int *mapped) {
+
+  unsigned char *data, *tmp;
+  struct stat st;
+  int n, dataSize, fd;
+
+  n = 0;
+  *mapped = NO;
+  fd = (strcmp(name, "-") == 0) ? STDIN_FILENO : open(name, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "_read_input(): Could not open file \"%s\" for reading.\n", name);
+    return NULL;
+  }
+
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 && st.st_size <= 0x7FFFFFFF) {
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data != MAP_FAILED) {
+      if (fd != STDIN_FILENO)
+        close(fd);
+      *size = (int)st.st_size;
+      *mapped = YES;
+      return data;
+    }
+  }
 
-      b = (data[i] >> k) & 1;
-      k--;
+  /* a pipe, read it until it ends */
+  *size = 0;
+  dataSize = 1 << 20;
+  data = malloc(dataSize);
+  while (data != NULL) {
+    n = read(fd, data + *size, dataSize - *size);
+    if (n <= 0)
+      break;
 
-      codeLengthCombined[j] = (codeLengthCombined[j] << 1) | b;
+    *size += n;
+    if (*size == dataSize) {
+      dataSize *= 2;
+      tmp = realloc(data, dataSize);
+      if (tmp == NULL)
+        free(data);
+      data = tmp;
     }
+  }
+
+  if (fd != STDIN_FILENO)
+    close(fd);
 
-    /*
-      fprintf(stderr, "main(): codeLengthCombined[%d] = %d\n", j, codeLengthCombined[j]);
-    */
+  if (data == NULL) {
+    fprintf(stderr, "_read_input(): Out of memory error.\n");
+    return NULL;
+  }
+  if (n < 0) {
+    fprintf(stderr, "_read_input(): Could not read file \"%s\".\n", name);
+    return NULL;
   }
 
-  /* create the codes from code lengths */
-  huffmanRecreateCodes(codesN, codeLengthCombined, codeCombined);
+  return data;
+}
 
-  /* free all huffman tree nodes */
-  treeNodesFreeCurrent = 0;
 
-  /* build the huffman tree */
-  huffmanConstructTree(&treeCombined, codeCombined, codeLengthCombined, codesN);
+/* the time in seconds, from some fixed point */
+static double _now(void) {
 
-  /* inflate */
-  j = 0;
-  bPrevious = 0;
-  while (j < 286 + 30) {
-    node = treeCombined;
+  struct timespec t;
 
-    while (node->literal < 0) {
-      /* parse one bit */
-      if (k == -1) {
-        k = 7;
-        i++;
-      }
+  clock_gettime(CLOCK_MONOTONIC, &t);
 
-      if ((data[i] >> k) & 1)
-        node = node->right;
-      else
-        node = node->left;
+  return t.tv_sec + t.tv_nsec / 1000000000.0;
+}
+
+
+/* --stats: bits per symbol needs the symbols, which are counted only when built using make STATS=1 */
+static void _print_stats(int print, struct stats *s, int inputSize, int outputSize, double total) {
+
+  static const char *names[STATS_PHASES_N] = { "read", "tables", "decode", "write" };
+  int i;
+
+  if (print == STATS_PRINT_JSON) {
+    fprintf(stderr, "{\"inputSize\": %d, \"outputSize\": %d, \"blocks\": %d, \"treesBuilt\": %d, \"phases\": {", inputSize, outputSize, s->blocksN, s->treesBuilt);
+    for (i = 0; i < STATS_PHASES_N; i++)
+      fprintf(stderr, "%s\"%s\": %.6f", i > 0 ? ", " : "", names[i], s->phases[i]);
+    fprintf(stderr, "}, \"total\": %.6f, \"payloadBits\": %.0f, ", total, s->payloadBits);
+#ifdef STATS
+    fprintf(stderr, "\"symbols\": %lu, \"bitsPerSymbol\": %.3f}\n", s->symbols, s->symbols > 0 ? s->payloadBits / s->symbols : 0.0);
+#else
+    fprintf(stderr, "\"symbols\": null, \"bitsPerSymbol\": null}\n");
+#endif
+    return;
+  }
+
+  fprintf(stderr, "main(): Phases:");
+  for (i = 0; i < STATS_PHASES_N; i++)
+    fprintf(stderr, " %s %.3fs |", names[i], s->phases[i]);
+  fprintf(stderr, " total %.3fs.\n", total);
+#ifdef STATS
+  fprintf(stderr, "main(): %d block(s), %d tree(s) built | %lu symbols | %.3f bits per symbol.\n", s->blocksN, s->treesBuilt, s->symbols,
+          s->symbols > 0 ? s->payloadBits / s->symbols : 0.0);
+#else
+  fprintf(stderr, "main(): %d block(s), %d tree(s) built, use make STATS=1 to count the bits per symbol.\n", s->blocksN, s->treesBuilt);
+#endif
+}
+
+
+/* the output file while it's being written, it's removed if we fail */
+static char *_outputName = NULL;
+
+
+static void _remove_output(void) {
+
+  if (_outputName != NULL)
+    remove(_outputName);
+}
+
+
+/* creates the output file at its full size, and maps it. returns NULL if it can't be mapped, e.g., it's stdout */
+static unsigned char *_map_output(char *name, int size, int *fd) {
+
+  unsigned char *output;
+
+  if (strcmp(name, "-") == 0)
+    return NULL;
+
+  *fd = open(name, O_RDWR | O_CREAT | O_TRUNC, 0666);
+  if (*fd < 0)
+    return NULL;
+
+  if (ftruncate(*fd, size) != 0) {
+    close(*fd);
+    return NULL;
+  }
+
+  output = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, *fd, 0);
+  if (output == MAP_FAILED) {
+    close(*fd);
+    return NULL;
+  }
+
+  _outputName = name;
+  atexit(_remove_output);
+
+  return output;
+}
+
+
+/* doubles the output buffer. a mapped output has the size from the header, and going past it means the data is corrupted */
+static unsigned char *_grow_output(unsigned char *output, int *outputSize, int mapped) {
+
+  unsigned char *tmp;
+
+  if (mapped == YES) {
+    fprintf(stderr, "_grow_output(): The data is longer than its header says, it's corrupted.\n");
+    return NULL;
+  }
+
+  *outputSize *= 2;
+  tmp = realloc(output, *outputSize);
+  if (tmp == NULL)
+    fprintf(stderr, "_grow_output(): Out of memory error.\n");
+
+  return tmp;
+}
 
-      k--;
+
+int main(int argc, char *argv[]) {
+
+  int fileSize, i, j, m, n, o, length, b, e, distance, inflatedSize, outputSize, codesN, bPrevious, last, flags, dictionarySize;
+  int inputMapped, outputMapped, fd, print;
+  unsigned char *data, *end, *tmp, *dictionary, *stored;
+  unsigned long id;
+  char *memberName;
+  const struct tableSet *table;
+  struct bitReader r;
+  struct stats stats;
+  double start, time;
+  FILE *f;
+
+  dictionary = NULL;
+  dictionarySize = 0;
+  memberName = NULL;
+  print = STATS_PRINT_NONE;
+
+  /* parse the options */
+  while (argc > 3) {
+    if (strcmp(argv[1], "--stats") == 0 || strcmp(argv[1], "--stats=json") == 0) {
+      print = (argv[1][7] == '=') ? STATS_PRINT_JSON : STATS_PRINT_TEXT;
+      argv++;
+      argc--;
+      continue;
+    }
+
+    if (argc > 4 && strcmp(argv[1], "--extract") == 0) {
+      memberName = argv[2];
+      argv += 2;
+      argc -= 2;
+      continue;
     }
 
-    b = node->literal;
+    if (argc <= 4 || strcmp(argv[1], "--dictionary") != 0)
+      break;
 
-    /*
-      fprintf(stderr, "i = %.3d: got %d\n", j, b);
-    */
+    /* the dictionary is the last 32K of the file at most, like in deflateTT */
+    f = fopen(argv[2], "rb");
+    if (f == NULL) {
+      fprintf(stderr, "main(): Could not open file \"%s\" for reading.\n", argv[2]);
+      return 1;
+    }
 
-    if (b <= codesN - 4)
-      n = 1;
-    else if (b == codesN - 4 + 1)
-      n = 2;
-    else if (b == codesN - 4 + 2)
-      n = 3;
+    fseek(f, 0, SEEK_END);
+    dictionarySize = ftell(f);
+    if (dictionarySize > 0x8000) {
+      fseek(f, dictionarySize - 0x8000, SEEK_SET);
+      dictionarySize = 0x8000;
+    }
     else
-      n = 7;
+      fseek(f, 0, SEEK_SET);
 
-    /* pump more bits? */
-    if (n > 1) {
-      if (n == 2 || n == 3)
-        m = 3;
-      else
-        m = 11;
+    dictionary = malloc(dictionarySize + 1);
+    if (dictionary == NULL) {
+      fprintf(stderr, "main(): Out of memory error [4].\n");
+      fclose(f);
+      return 1;
+    }
 
-      e = 0;
+    fread(dictionary, 1, dictionarySize, f);
+    fclose(f);
 
-      while (n > 0) {
-        /* parse one bit */
-        if (k == -1) {
-          k = 7;
-          i++;
-        }
+    argv += 2;
+    argc -= 2;
+  }
 
-        e = (e << 1) | ((data[i] >> k) & 1);
+  if (argc != 3) {
+    fprintf(stderr, "inflateTT v1.3 Written by Ville Helin 2007\n");
+    fprintf(stderr, "USAGE: %s [--dictionary FILE] [--extract NAME] [--stats[=json]] <IN DEF/PACK> <OUT RAW>\n", argv[0]);
+    fprintf(stderr, "Use - as the file name to read from stdin or to write to stdout.\n");
+    fprintf(stderr, "--extract NAME  Inflate member NAME of a pack made by deflateTT --pack\n");
+    fprintf(stderr, "--stats[=json]  Print the time spent in each phase, and the bits per symbol\n");
+    return 1;
+  }
 
-        k--;
-        n--;
-      }
+  /********************************************************************************/
+  /* INPUT */
+  /********************************************************************************/
 
-      /*
-        fprintf(stderr, "e = %d\n", e);
-      */
+  stats.phases[STATS_READ] = 0;
+  stats.phases[STATS_TABLES] = 0;
+  stats.phases[STATS_DECODE] = 0;
+  stats.phases[STATS_WRITE] = 0;
+  stats.payloadBits = 0;
+  stats.symbols = 0;
+  stats.blocksN = 0;
+  stats.treesBuilt = 0;
 
-      n = e + m;
+  start = _now();
 
-      if (b == codesN - 4 + 1) {
-        b = bPrevious;
-        /*
-          fprintf(stderr, "%d repeats %d\n", b, n);
-        */
-      }
-      else
-        b = 0;
+  /* read the DEF file */
+  data = _read_input(argv[1], &fileSize, &inputMapped);
+  if (data == NULL)
+    return 1;
+
+  stats.phases[STATS_READ] = _now() - start;
+
+  /* the reader doesn't go past the end of the input */
+  end = data + fileSize;
+
+  /* --extract: the member is inflated where it is in the pack */
+  if (memberName != NULL) {
+    i = _pack_find(data, fileSize, memberName);
+    if (i < 0)
+      return 1;
+    data += i;
+  }
+
+  /********************************************************************************/
+  /* HUFFMAN */
+  /********************************************************************************/
+
+  /* check header */
+  if (data[0] != 'D' || data[1] != 'E' || data[2] != 'F' || (data[3] != 'c' && data[3] != 'd')) {
+    fprintf(stderr, "main(): File \"%s\" doesn't start with \"DEFc\" or \"DEFd\".\n", argv[1]);
+    return 1;
+  }
+
+  i = 4;
+
+  /* DEFd has flags: 1 - the size is a u64, 2 - it's not known (the file was compressed from a pipe),
+     4 - the file was compressed using a preset dictionary */
+  flags = 0;
+  if (data[3] == 'd')
+    flags = data[i++];
+
+  if ((flags & 3) == 3 || flags > 7) {
+    fprintf(stderr, "main(): File \"%s\" uses unsupported features (flags %d).\n", argv[1], flags);
+    return 1;
+  }
+
+  /* parse inflated size */
+  inflatedSize = -1;
+  if ((flags & 2) == 0) {
+    inflatedSize = data[i] | (data[i+1] << 8) | (data[i+2] << 16) | (data[i+3] << 24);
+    i += 4;
+  }
+  if ((flags & 1) == 1) {
+    /* the size must fit in an int, with room for the dictionary before it and the longest match after it */
+    if (inflatedSize < 0 || inflatedSize > 0x7FFFFFFF - 0x8000 - OUTPUT_ROOM || data[i] != 0 || data[i+1] != 0 || data[i+2] != 0 || data[i+3] != 0) {
+      fprintf(stderr, "main(): File \"%s\" is too big for inflateTT.\n", argv[1]);
+      return 1;
     }
+    i += 4;
+  }
 
-    while (n > 0) {
-      if (j < 286)
-        codeLengthLiterals[j] = b;
-      else
-        codeLengthDistances[j - 286] = b;
-      j++;
-      n--;
+  /* the preset dictionary must be the one the file was compressed with */
+  if ((flags & 4) == 4) {
+    id = data[i] | (data[i+1] << 8) | (data[i+2] << 16) | ((unsigned long)data[i+3] << 24);
+    i += 4;
+
+    if (dictionary == NULL) {
+      fprintf(stderr, "main(): File \"%s\" needs a dictionary, use --dictionary.\n", argv[1]);
+      return 1;
     }
+    if (_dictionary_id(dictionary, dictionarySize) != id) {
+      fprintf(stderr, "main(): File \"%s\" was compressed using a different dictionary.\n", argv[1]);
+      return 1;
+    }
+  }
+  else
+    dictionarySize = 0;
+
+  /* if we don't know the size, we'll grow the buffer on the way */
+  if (inflatedSize < 0)
+    outputSize = 1 << 20;
+  else
+    outputSize = inflatedSize + OUTPUT_ROOM;
+
+  /* the dictionary goes in front of the output, so the matches can reach it */
+  outputSize += dictionarySize;
+
+  /* when we know the size, the data is inflated right into the output file */
+  outputMapped = NO;
+  tmp = NULL;
+  if (inflatedSize >= 0 && dictionarySize == 0) {
+    tmp = _map_output(argv[2], outputSize, &fd);
+    if (tmp != NULL)
+      outputMapped = YES;
+  }
 
-    bPrevious = b;
+  if (tmp == NULL)
+    tmp = malloc(outputSize);
+  if (tmp == NULL) {
+    fprintf(stderr, "main(): Out of memory error [2].\n");
+    return 1;
   }
 
-  /* create the codes from code lengths */
-  huffmanRecreateCodes(286, codeLengthLiterals, codeLiterals);
-  huffmanRecreateCodes(30, codeLengthDistances, codeDistances);
+  if (dictionarySize > 0)
+    memcpy(tmp, dictionary, dictionarySize);
 
-  /* free all huffman tree nodes */
-  treeNodesFreeCurrent = 0;
+  /*
+    fprintf(stderr, "main(): Inflated size = %d\n", inflatedSize);
+  */
+
+  bitReaderInit(&r, data + i, end);
+  o = dictionarySize;
+  last = YES;
+
+  /* DEFc files have one block, DEFd files have a sequence of them */
+  do {
+    table = NULL;
+    stats.blocksN++;
+    time = _now();
+
+    if (data[3] == 'd') {
+      /* is this the last block? */
+      last = bitReaderRead(&r, 1);
+
+      /* block type */
+      b = bitReaderRead(&r, 2);
+
+      /* a stored block is byte aligned, and its bytes are copied as they are */
+      if (b == 0) {
+        stored = bitReaderAlign(&r);
+        if (end - stored < 4) {
+          fprintf(stderr, "main(): The data is truncated.\n");
+          return 1;
+        }
 
-  /* build the huffman trees */
-  huffmanConstructTree(&treeLiterals, codeLiterals, codeLengthLiterals, 286);
-  huffmanConstructTree(&treeDistances, codeDistances, codeLengthDistances, 30);
+        length = stored[0] | (stored[1] << 8);
+        if ((stored[2] | (stored[3] << 8)) != (~length & 0xFFFF)) {
+          fprintf(stderr, "main(): The size of a stored block is corrupted.\n");
+          return 1;
+        }
+        stored += 4;
+        if (end - stored < length) {
+          fprintf(stderr, "main(): The data is truncated.\n");
+          return 1;
+        }
 
-  /* inflate */
-  j = 0;
-  while (1) {
-    node = treeLiterals;
+        while (o + length > outputSize - OUTPUT_ROOM) {
+          tmp = _grow_output(tmp, &outputSize, outputMapped);
+          if (tmp == NULL)
+            return 1;
+        }
 
-    while (node->literal < 0) {
-      /* parse one bit */
-      if (k == -1) {
-        k = 7;
-        i++;
+        memcpy(tmp + o, stored, length);
+        o += length;
+        r.next = stored + length;
+        stats.phases[STATS_DECODE] += _now() - time;
+        continue;
       }
 
-      if ((data[i] >> k) & 1)
-        node = node->right;
-      else
-        node = node->left;
-
-      k--;
+      /* a predefined table set instead of the trees */
+      if (b == 1) {
+        b = bitReaderRead(&r, TABLE_SET_BITS);
+        if (b >= TABLE_SETS_N) {
+          fprintf(stderr, "main(): Unsupported table set %d.\n", b);
+          return 1;
+        }
+        table = &tableSets[b];
+      }
+      else if (b != 2) {
+        fprintf(stderr, "main(): Unsupported block type %d.\n", b);
+        return 1;
+      }
     }
 
-    b = node->literal;
+    /* a predefined table set is ready to be used as it is, otherwise read the trees */
+    if (table == NULL) {
+      /* read the number of code lengths */
+      codesN = bitReaderRead(&r, 8);
 
-    /*
-      fprintf(stderr, "main(): %d\n", b);
-    */
+      /* read bits per code length */
+      m = bitReaderRead(&r, 3);
 
-    /* a loose literal? */
-    if (b < 256) {
-      tmp[j++] = b;
-      continue;
-    }
+      /*
+        fprintf(stderr, "main(): Number of items = %d. Bits per item = %d.\n", codesN, m);
+      */
 
-    /* end of archive? */
-    if (b == 256)
-      break;
+      /* read the combined code lengths */
+      for (j = 0; j < codesN; j++) {
+        codeLengthCombined[j] = bitReaderRead(&r, m);
 
-    /* ... so it is a [length, distance] tuple... */
-    b -= 257;
+        /*
+          fprintf(stderr, "main(): codeLengthCombined[%d] = %d\n", j, codeLengthCombined[j]);
+        */
+      }
+
+      /* create the codes from code lengths */
+      huffmanRecreateCodes(codesN, codeLengthCombined, codeCombined);
+
+      /* free all huffman tree nodes */
+      treeNodesFreeCurrent = 0;
+
+      /* build the huffman tree */
+      huffmanConstructTree(&treeCombined, codeCombined, codeLengthCombined, codesN);
+
+      /* inflate */
+      j = 0;
+      bPrevious = 0;
+      while (j < 286 + 30) {
+        b = _decode_tree(&r, treeCombined);
+
+        /*
+          fprintf(stderr, "i = %.3d: got %d\n", j, b);
+        */
 
-    /* get length */
-    length = baseValueLengths[b];
+        if (b <= codesN - 4)
+          n = 1;
+        else if (b == codesN - 4 + 1)
+          n = 2;
+        else if (b == codesN - 4 + 2)
+          n = 3;
+        else
+          n = 7;
+
+        /* pump more bits? */
+        if (n > 1) {
+          if (n == 2 || n == 3)
+            m = 3;
+          else
+            m = 11;
+
+          e = bitReaderRead(&r, n);
+
+          /*
+            fprintf(stderr, "e = %d\n", e);
+          */
+
+          n = e + m;
+
+          if (b == codesN - 4 + 1) {
+            b = bPrevious;
+            /*
+              fprintf(stderr, "%d repeats %d\n", b, n);
+            */
+          }
+          else
+            b = 0;
+        }
 
-    /* parse the extra bits */
-    b = extraBitsLengths[b];
-    if (b > 0) {
-      e = 0;
-      while (b > 0) {
-        if (k == -1) {
-          k = 7;
-          i++;
+        while (n > 0) {
+          if (j < 286)
+            codeLengthLiterals[j] = b;
+          else
+            codeLengthDistances[j - 286] = b;
+          j++;
+          n--;
         }
 
-        e = (e << 1) | ((data[i] >> k) & 1);
-        k--;
-        b--;
+        bPrevious = b;
       }
 
-      /* add the extra bits */
-      length += e;
+      /* create the codes from code lengths */
+      huffmanRecreateCodes(286, codeLengthLiterals, codeLiterals);
+      huffmanRecreateCodes(30, codeLengthDistances, codeDistances);
+
+      /* free all huffman tree nodes */
+      treeNodesFreeCurrent = 0;
+
+      /* build the huffman trees */
+      huffmanConstructTree(&treeLiterals, codeLiterals, codeLengthLiterals, 286);
+      huffmanConstructTree(&treeDistances, codeDistances, codeLengthDistances, 30);
+      stats.treesBuilt++;
     }
 
-    /*
-      fprintf(stderr, "  length = %d\n", length);
-    */
+    stats.phases[STATS_TABLES] += _now() - time;
+    time = _now();
 
-    /* parse distance */
-    node = treeDistances;
+    /* the bits the payload takes */
+    stats.payloadBits -= BIT_READER_POSITION(&r);
 
-    while (node->literal < 0) {
-      /* parse one bit */
-      if (k == -1) {
-        k = 7;
-        i++;
+    /* inflate */
+    while (1) {
+      /* room for the longest match? */
+      if (o > outputSize - OUTPUT_ROOM) {
+        tmp = _grow_output(tmp, &outputSize, outputMapped);
+        if (tmp == NULL)
+          return 1;
       }
 
-      if ((data[i] >> k) & 1)
-        node = node->right;
+      if (table != NULL) {
+        b = _decode_symbol(&r, table->literalCounts, table->literals);
+        if (b < 0 || b > 285) {
+          fprintf(stderr, "main(): The data is corrupted.\n");
+          return 1;
+        }
+      }
       else
-        node = node->left;
+        b = _decode_tree(&r, treeLiterals);
 
-      k--;
-    }
+      STATS_COUNT(stats.symbols, 1);
+
+      /*
+        fprintf(stderr, "main(): %d\n", b);
+      */
 
-    b = node->literal;
+      /* a loose literal? */
+      if (b < 256) {
+        tmp[o++] = b;
+        continue;
+      }
 
-    /* get length */
-    distance = baseValueDistances[b];
+      /* end of block? */
+      if (b == 256)
+        break;
 
-    /* parse the extra bits */
-    b = extraBitsDistances[b];
-    if (b > 0) {
-      e = 0;
-      while (b > 0) {
-        if (k == -1) {
-          k = 7;
-          i++;
-        }
+      /* ... so it is a [length, distance] tuple... */
+      b -= 257;
+
+      /* get length */
+      length = baseValueLengths[b];
+
+      /* add the extra bits */
+      length += bitReaderRead(&r, extraBitsLengths[b]);
+
+      /*
+        fprintf(stderr, "  length = %d\n", length);
+      */
 
-        e = (e << 1) | ((data[i] >> k) & 1);
-        k--;
-        b--;
+      /* parse distance */
+      if (table != NULL) {
+        b = _decode_symbol(&r, table->distanceCounts, table->distances);
+        if (b < 0) {
+          fprintf(stderr, "main(): The data is corrupted.\n");
+          return 1;
+        }
       }
+      else
+        b = _decode_tree(&r, treeDistances);
+
+      /* get length */
+      distance = baseValueDistances[b];
 
       /* add the extra bits */
-      distance += e;
-    }
+      distance += bitReaderRead(&r, extraBitsDistances[b]);
 
-    /*
-      fprintf(stderr, "  distance = %d\n", distance);
-    */
+      /*
+        fprintf(stderr, "  distance = %d\n", distance);
+      */
 
-    /* de-lz77 */
-    n = j - distance;
-    for (b = 0; b < length; b++)
-      tmp[j++] = tmp[n++];
-  }
+      /* de-lz77 */
+      _copy_match(tmp + o, distance, length);
+      o += length;
+    }
 
-  fprintf(stderr, "main(): Orginal size = %d, uncompressed size = %d.\n", inflatedSize, j);
+    stats.payloadBits += BIT_READER_POSITION(&r);
+    stats.phases[STATS_DECODE] += _now() - time;
+  } while (last == NO);
+
+  if (print != STATS_PRINT_JSON)
+    fprintf(stderr, "main(): Orginal size = %d, uncompressed size = %d.\n", inflatedSize, o - dictionarySize);
 
   /********************************************************************************/
   /* OUTPUT (RAW) */
   /********************************************************************************/
 
-  /* write the RAW file */
-  f = fopen(argv[2], "wb");
-  if (f == NULL) {
-    fprintf(stderr, "main(): Could not open file \"%s\" for writing.\n", argv[2]);
-    return 1;
+  time = _now();
+
+  /* a mapped output is already in the file, it only loses the room for the longest match */
+  if (outputMapped == YES) {
+    munmap(tmp, outputSize);
+    if (ftruncate(fd, o) != 0) {
+      fprintf(stderr, "main(): Could not write file \"%s\".\n", argv[2]);
+      return 1;
+    }
+    close(fd);
+    _outputName = NULL;
+  }
+  else {
+    /* write the RAW file */
+    if (strcmp(argv[2], "-") == 0)
+      f = stdout;
+    else {
+      f = fopen(argv[2], "wb");
+      if (f == NULL) {
+        fprintf(stderr, "main(): Could not open file \"%s\" for writing.\n", argv[2]);
+        return 1;
+      }
+    }
+
+    if (fwrite(tmp + dictionarySize, 1, o - dictionarySize, f) != (size_t)(o - dictionarySize)) {
+      fprintf(stderr, "main(): Could not write file \"%s\".\n", argv[2]);
+      return 1;
+    }
+
+    if (f != stdout)
+      fclose(f);
+    else
+      fflush(f);
   }
 
-  fwrite(tmp, 1, j, f);
+  stats.phases[STATS_WRITE] = _now() - time;
 
-  fclose(f);
+  if (print != STATS_PRINT_NONE)
+    _print_stats(print, &stats, fileSize, o - dictionarySize, _now() - start);
 
   return 0;
 }
@@ -8,4 +8,50 @@ struct node {
   int literal;
 };
 
+/* a block of type 1 names a predefined table set in this many bits */
+#define TABLE_SET_BITS 3
+#define TABLE_SETS_N   3
+
+/* a predefined table set: the number of codes of each length, and the symbols in the order of their codes */
+struct tableSet {
+  unsigned short literalCounts[16];
+  unsigned short literals[288];
+  unsigned short distanceCounts[16];
+  unsigned short distances[30];
+};
+
+/* the output keeps this much room after it: the longest match, and the bytes the match copy can write
+   past its end, see _copy_match() */
+#define MATCH_COPY_SLACK 16
+#define OUTPUT_ROOM      (258 + MATCH_COPY_SLACK)
+
+/* the phases --stats times. tables reads the code lengths and builds the trees out of them */
+#define STATS_READ     0
+#define STATS_TABLES   1
+#define STATS_DECODE   2
+#define STATS_WRITE    3
+#define STATS_PHASES_N 4
+
+/* --stats and --stats=json */
+#define STATS_PRINT_NONE 0
+#define STATS_PRINT_TEXT 1
+#define STATS_PRINT_JSON 2
+
+/* the counters in the decoding loop are built in only using make STATS=1, otherwise they compile to nothing */
+#ifdef STATS
+#define STATS_COUNT(counter, n) ((counter) += (n))
+#else
+#define STATS_COUNT(counter, n)
+#endif
+
+struct stats {
+  /* seconds spent in each phase */
+  double phases[STATS_PHASES_N];
+  /* the bits the compressed blocks take after their trees, and the symbols decoded out of them */
+  double payloadBits;
+  unsigned long symbols;
+  int blocksN;
+  int treesBuilt;
+};
+
 #endif